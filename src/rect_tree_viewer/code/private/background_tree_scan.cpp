@@ -0,0 +1,186 @@
+#include "background_tree_scan.hpp"
+
+#include <algorithm>
+#include <ranges>
+
+#include "klgl/error_handling.hpp"
+#include "tracing.hpp"
+
+BackgroundTreeScan::BackgroundTreeScan(
+    std::optional<std::string> root_node_name,
+    std::vector<std::filesystem::path> root_paths,
+    const ReadDirectoryTreeParams& params)
+    : root_node_name_(std::move(root_node_name)),
+      root_paths_(std::move(root_paths)),
+      params_(params),
+      start_time_(std::chrono::steady_clock::now())
+{
+    params_.listener = this;
+
+    // Same numbering as ReadDirectoryTreeMulti: the common root goes first, then root paths in order
+    const NodeId first_root = root_node_name_ ? 1 : 0;
+    for (const size_t path_index : std::views::iota(size_t{0}, root_paths_.size()))
+    {
+        root_node_id_to_path_index_[first_root + static_cast<NodeId>(path_index)] = path_index;
+    }
+
+    if (params_.previous_tree.nodes) expected_nodes_count_ = params_.previous_tree.nodes->Size();
+
+    thread_ = std::jthread([this](std::stop_token stop_token) { Scan(std::move(stop_token)); });
+}
+
+BackgroundTreeScan::~BackgroundTreeScan() = default;
+
+void BackgroundTreeScan::Scan(std::stop_token stop_token)
+{
+    TRACE_THREAD_NAME("Background scan");
+    params_.stop_token = std::move(stop_token);
+    try
+    {
+        result_.nodes = ReadDirectoryTreeMulti(
+            root_node_name_,
+            root_paths_,
+            &result_.root_node_id_to_path_index,
+            params_,
+            &result_.stats);
+    }
+    catch (...)
+    {
+        exception_ = std::current_exception();
+    }
+
+    finished_.store(true, std::memory_order_release);
+}
+
+void BackgroundTreeScan::OnDirectoryListed(const ReadDirectoryTreeListing& listing)
+{
+    nodes_count_.fetch_add(listing.names.size(), std::memory_order_relaxed);
+    found_directories_count_.fetch_add(listing.directories.size(), std::memory_order_relaxed);
+    if (listing.parent_key != ReadDirectoryTreeListing::kNoParent)
+    {
+        listed_directories_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    const std::lock_guard lock(incoming_mutex_);
+    incoming_.headers.push_back({
+        .parent_key = listing.parent_key,
+        .first_key = listing.first_key,
+        .entries_count = static_cast<uint32_t>(listing.names.size()),
+        .directories_count = static_cast<uint32_t>(listing.directories.size()),
+    });
+
+    for (const std::string_view name : listing.names)
+    {
+        incoming_.names += name;
+        incoming_.name_sizes.push_back(static_cast<uint32_t>(name.size()));
+    }
+
+    incoming_.values.insert(incoming_.values.end(), listing.values.begin(), listing.values.end());
+    incoming_.directories.insert(incoming_.directories.end(), listing.directories.begin(), listing.directories.end());
+}
+
+void BackgroundTreeScan::ApplyListings(TreeNodes& nodes, TreeChanges& changes, std::chrono::nanoseconds time_budget)
+{
+    const auto deadline = std::chrono::steady_clock::now() + time_budget;
+    do
+    {
+        if (cursor_.header == outgoing_.headers.size())
+        {
+            outgoing_.Clear();
+            cursor_ = {};
+
+            std::unique_lock lock(incoming_mutex_, std::try_to_lock);
+            if (!lock.owns_lock() || incoming_.headers.empty()) return;
+            std::swap(incoming_, outgoing_);
+        }
+
+        ApplyListing(nodes, changes);
+    } while (std::chrono::steady_clock::now() < deadline);
+}
+
+void BackgroundTreeScan::ApplyListing(TreeNodes& nodes, TreeChanges& changes)
+{
+    const ListingsBuffer::Header& header = outgoing_.headers[cursor_.header++];
+
+    // Each directory is listed once, its key is not needed after that
+    NodeId parent = kInvalidNodeId;
+    if (header.parent_key != ReadDirectoryTreeListing::kNoParent)
+    {
+        const auto it = directory_key_to_node_.find(header.parent_key);
+        klgl::ErrorHandling::Ensure(it != directory_key_to_node_.end(), "Listing of an unknown directory");
+        parent = it->second;
+        directory_key_to_node_.erase(it);
+    }
+
+    const auto first_node = static_cast<NodeId>(nodes.Size());
+    uint64_t total_value = 0;
+    for (size_t i = 0; i != header.entries_count; ++i)
+    {
+        const uint32_t name_size = outgoing_.name_sizes[cursor_.entry];
+        const uint64_t value = outgoing_.values[cursor_.entry];
+        const std::string_view name = std::string_view{outgoing_.names}.substr(cursor_.name_offset, name_size);
+        const NodeId node_id = nodes.Add(name, value);
+        if (parent != kInvalidNodeId) nodes.LinkChild(parent, node_id);
+        cursor_.name_offset += name_size;
+        ++cursor_.entry;
+        total_value += value;
+    }
+
+    for (size_t i = 0; i != header.directories_count; ++i)
+    {
+        const uint32_t index = outgoing_.directories[cursor_.directory++];
+        directory_key_to_node_[header.first_key + index] = first_node + index;
+    }
+
+    if (parent != kInvalidNodeId)
+    {
+        nodes.AddValueDelta(parent, static_cast<int64_t>(total_value));
+        changes.MarkDirty(nodes, parent);
+    }
+    else if (header.entries_count != 0)
+    {
+        changes.MarkDirty(nodes, first_node);
+    }
+}
+
+BackgroundTreeScanProgress BackgroundTreeScan::GetProgress() const
+{
+    BackgroundTreeScanProgress progress;
+    progress.nodes_count = nodes_count_.load(std::memory_order_relaxed);
+    progress.listed_directories_count = listed_directories_count_.load(std::memory_order_relaxed);
+    const size_t found_directories_count = found_directories_count_.load(std::memory_order_relaxed);
+    progress.queued_directories_count =
+        found_directories_count - std::min(found_directories_count, progress.listed_directories_count);
+    progress.elapsed = std::chrono::steady_clock::now() - start_time_;
+
+    const double elapsed = std::chrono::duration<double>(progress.elapsed).count();
+    std::optional<double> remaining;
+    if (expected_nodes_count_)
+    {
+        // Trees usually change little between scans. A grown tree is reported as almost done
+        const auto expected_nodes_count = static_cast<double>(std::max(*expected_nodes_count_, size_t{1}));
+        const double done = std::min(static_cast<double>(progress.nodes_count) / expected_nodes_count, 0.99);
+        if (done > 0) remaining = elapsed * (1 - done) / done;
+    }
+    else if (progress.listed_directories_count != 0)
+    {
+        const double listing_rate = static_cast<double>(progress.listed_directories_count) / elapsed;
+        remaining = static_cast<double>(progress.queued_directories_count) / listing_rate;
+        progress.remaining_is_lower_bound = true;
+    }
+
+    if (remaining)
+    {
+        progress.remaining =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(*remaining));
+    }
+
+    return progress;
+}
+
+BackgroundTreeScanResult BackgroundTreeScan::TakeResult()
+{
+    klgl::ErrorHandling::Ensure(IsFinished(), "The background scan is not finished");
+    if (exception_) std::rethrow_exception(exception_);
+    return std::move(result_);
+}
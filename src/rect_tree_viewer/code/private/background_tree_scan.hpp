@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "read_directory_tree.hpp"
+#include "tree.hpp"
+#include "tree_changes.hpp"
+
+struct BackgroundTreeScanProgress
+{
+    size_t nodes_count = 0;
+    size_t listed_directories_count = 0;
+
+    // Directories found but not listed yet
+    size_t queued_directories_count = 0;
+    std::chrono::nanoseconds elapsed{};
+
+    // Estimated time left. Incremental scans compare the nodes count with the previous tree, full scans only know
+    // how long the current queue takes to drain at the current rate, so it is a lower bound for them.
+    std::optional<std::chrono::nanoseconds> remaining;
+    bool remaining_is_lower_bound = false;
+};
+
+struct BackgroundTreeScanResult
+{
+    TreeNodes nodes;
+    std::unordered_map<NodeId, size_t> root_node_id_to_path_index;
+    ReadDirectoryTreeStats stats;
+};
+
+// Runs ReadDirectoryTreeMulti on its own thread and streams listed directories to the render thread, which grows a
+// preview tree from them with ApplyListings. Scan threads append listings to a shared buffer under a mutex, the render
+// thread swaps it with its own buffer only when try_lock succeeds, so it never waits for the scan. When the scan is
+// finished the preview is replaced by the merged tree from TakeResult.
+class BackgroundTreeScan final : public IReadDirectoryTreeListener
+{
+public:
+    // previous_tree must stay alive until the scan is finished
+    BackgroundTreeScan(
+        std::optional<std::string> root_node_name,
+        std::vector<std::filesystem::path> root_paths,
+        const ReadDirectoryTreeParams& params);
+    BackgroundTreeScan(const BackgroundTreeScan&) = delete;
+    BackgroundTreeScan& operator=(const BackgroundTreeScan&) = delete;
+
+    // Cancels the scan and waits for it
+    ~BackgroundTreeScan() override;
+
+    // The scan stops soon after and finishes with the directories listed so far
+    void Cancel() { thread_.request_stop(); }
+    [[nodiscard]] bool IsCancelled() const { return thread_.get_stop_token().stop_requested(); }
+    [[nodiscard]] bool IsFinished() const { return finished_.load(std::memory_order_acquire); }
+
+    // Adds received listings to the preview tree until the time budget is spent. The preview tree must be empty on
+    // the first call and must not be edited elsewhere.
+    void ApplyListings(TreeNodes& nodes, TreeChanges& changes, std::chrono::nanoseconds time_budget);
+
+    // Root nodes of the preview tree. They have the same ids in the final tree
+    [[nodiscard]] const std::unordered_map<NodeId, size_t>& GetRootNodeIdToPathIndex() const
+    {
+        return root_node_id_to_path_index_;
+    }
+
+    [[nodiscard]] BackgroundTreeScanProgress GetProgress() const;
+
+    // Only after the scan is finished. Rethrows the exception of the scan thread
+    [[nodiscard]] BackgroundTreeScanResult TakeResult();
+
+    void OnDirectoryListed(const ReadDirectoryTreeListing& listing) override;
+
+private:
+    // Listings packed into flat arrays, so that a buffer reaches its peak size once and then only gets reused
+    struct ListingsBuffer
+    {
+        struct Header
+        {
+            uint64_t parent_key = 0;
+            uint64_t first_key = 0;
+            uint32_t entries_count = 0;
+            uint32_t directories_count = 0;
+        };
+
+        void Clear()
+        {
+            headers.clear();
+            names.clear();
+            name_sizes.clear();
+            values.clear();
+            directories.clear();
+        }
+
+        std::vector<Header> headers;
+        std::string names;
+        std::vector<uint32_t> name_sizes;
+        std::vector<uint64_t> values;
+        std::vector<uint32_t> directories;
+    };
+
+    // Read positions in the render thread buffer
+    struct ListingsCursor
+    {
+        size_t header = 0;
+        size_t name_offset = 0;
+        size_t entry = 0;
+        size_t directory = 0;
+    };
+
+    void Scan(std::stop_token stop_token);
+    void ApplyListing(TreeNodes& nodes, TreeChanges& changes);
+
+    std::optional<std::string> root_node_name_;
+    std::vector<std::filesystem::path> root_paths_;
+    ReadDirectoryTreeParams params_;
+    std::unordered_map<NodeId, size_t> root_node_id_to_path_index_;
+
+    // Number of tree nodes in the previous tree, if any
+    std::optional<size_t> expected_nodes_count_;
+
+    std::chrono::steady_clock::time_point start_time_;
+    std::atomic<size_t> nodes_count_ = 0;
+    std::atomic<size_t> listed_directories_count_ = 0;
+    std::atomic<size_t> found_directories_count_ = 0;
+
+    std::mutex incoming_mutex_;
+    ListingsBuffer incoming_;
+
+    // Render thread state
+    ListingsBuffer outgoing_;
+    ListingsCursor cursor_;
+    std::unordered_map<uint64_t, NodeId> directory_key_to_node_;
+
+    BackgroundTreeScanResult result_;
+    std::exception_ptr exception_;
+    std::atomic<bool> finished_ = false;
+
+    // Last member: the thread has to be stopped and joined before the rest is destroyed
+    std::jthread thread_;
+};
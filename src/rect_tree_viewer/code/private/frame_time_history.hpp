@@ -0,0 +1,45 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+
+namespace rect_tree_viewer
+{
+
+// Durations of the last frames and their percentiles for the stats overlay
+class FrameTimeHistory
+{
+public:
+    static constexpr size_t kFramesCount = 256;
+
+    void Add(std::chrono::duration<float, std::milli> frame_time)
+    {
+        frame_times_[next_frame_] = frame_time.count();
+        next_frame_ = (next_frame_ + 1) % kFramesCount;
+        frames_count_ = std::min(frames_count_ + 1, kFramesCount);
+    }
+
+    // Milliseconds, percentile is in [0, 1]. Zero until the first frame
+    [[nodiscard]] float GetPercentile(float percentile) const
+    {
+        if (frames_count_ == 0) return 0.f;
+
+        const auto begin = sorted_frame_times_.begin();
+        const auto end = std::copy_n(frame_times_.begin(), frames_count_, begin);
+        const auto index = static_cast<size_t>(percentile * static_cast<float>(frames_count_ - 1) + 0.5f);
+        std::nth_element(begin, begin + static_cast<std::ptrdiff_t>(index), end);
+        return sorted_frame_times_[index];
+    }
+
+    [[nodiscard]] size_t GetFramesCount() const { return frames_count_; }
+
+private:
+    std::array<float, kFramesCount> frame_times_{};
+    mutable std::array<float, kFramesCount> sorted_frame_times_{};
+    size_t next_frame_ = 0;
+    size_t frames_count_ = 0;
+};
+
+}  // namespace rect_tree_viewer
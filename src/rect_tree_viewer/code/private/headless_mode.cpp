@@ -0,0 +1,210 @@
+#include "headless_mode.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "disk_usage_import.hpp"
+#include "fmt/chrono.h"
+#include "fmt/std.h"  // IWYU pragma: keep
+#include "klgl/error_handling.hpp"
+#include "path_helpers.hpp"
+#include "rect_tree_draw_data.hpp"
+#include "tree_child_index.hpp"
+#include "tree_json.hpp"
+
+namespace rect_tree_viewer
+{
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+[[nodiscard]] std::chrono::milliseconds ToMilliseconds(Clock::duration duration)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(duration);
+}
+
+void AppendEscaped(std::string& buffer, std::string_view name)
+{
+    for (const char c : name)
+    {
+        switch (c)
+        {
+        case '\t':
+            buffer += "\\t";
+            break;
+        case '\n':
+            buffer += "\\n";
+            break;
+        case '\r':
+            buffer += "\\r";
+            break;
+        case '\\':
+            buffer += "\\\\";
+            break;
+        default:
+            buffer += c;
+            break;
+        }
+    }
+}
+
+void WriteNodes(
+    std::FILE* file,
+    const TreeNodes& nodes,
+    const TreeChildIndex& child_index,
+    const std::vector<Rect2d>& rects,
+    const std::vector<std::filesystem::path>& root_paths,
+    const std::unordered_map<NodeId, size_t>& root_node_id_to_path_index)
+{
+    // Lines are formatted into a buffer that is flushed in big chunks
+    constexpr size_t kFlushSize = size_t{1} << 20;
+    std::string buffer;
+    buffer.reserve(kFlushSize + 4096);
+    auto flush = [&]
+    {
+        klgl::ErrorHandling::Ensure(
+            std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size(),
+            "Failed to write the output");
+        buffer.clear();
+    };
+
+    buffer += "# id\tparent\tvalue\tx\ty\twidth\theight\tname\n";
+    if (nodes.IsEmpty())
+    {
+        flush();
+        return;
+    }
+
+    // Depth first from the root, children are pushed in reverse so that the biggest one comes out first
+    std::vector<NodeId> stack{0};
+    while (!stack.empty())
+    {
+        const NodeId node_id = stack.back();
+        stack.pop_back();
+        const std::span<const NodeId> children = child_index.GetChildren(node_id);
+        stack.insert(stack.end(), children.rbegin(), children.rend());
+
+        const NodeId parent = nodes.GetParent(node_id);
+        const Rect2d& rect = rects[node_id];
+        auto inserter = std::back_inserter(buffer);
+        fmt::format_to(inserter, "{}\t", node_id);
+        if (parent != kInvalidNodeId) fmt::format_to(inserter, "{}", parent);
+        fmt::format_to(
+            inserter,
+            "\t{}\t{}\t{}\t{}\t{}\t",
+            nodes.GetValue(node_id),
+            rect.bottom_left.x(),
+            rect.bottom_left.y(),
+            rect.size.x(),
+            rect.size.y());
+
+        if (const auto it = root_node_id_to_path_index.find(node_id); it != root_node_id_to_path_index.end())
+        {
+            AppendEscaped(buffer, PathHelpers::PathToUTF8(root_paths[it->second]));
+        }
+        else
+        {
+            AppendEscaped(buffer, nodes.GetName(node_id));
+        }
+
+        buffer += '\n';
+        if (buffer.size() >= kFlushSize) flush();
+    }
+
+    flush();
+}
+
+}  // namespace
+
+void RunHeadlessMode(const HeadlessModeOptions& options)
+{
+    klgl::ErrorHandling::Ensure(
+        !options.root_paths.empty() || options.load_snapshot_path || options.previous_snapshot_path ||
+            !options.dump_paths.empty(),
+        "Expected at least one path, a snapshot or a disk usage dump");
+
+    const auto start_time = Clock::now();
+    TreeNodes nodes;
+    std::vector<std::filesystem::path> root_paths = options.root_paths;
+    std::unordered_map<NodeId, size_t> root_node_id_to_path_index;
+    if (options.load_snapshot_path || !options.dump_paths.empty())
+    {
+        TreeSnapshot snapshot = options.load_snapshot_path ? LoadTreeFile(*options.load_snapshot_path)
+                                                           : ImportDiskUsageDumps(options.dump_paths);
+        nodes = std::move(snapshot.nodes);
+        root_paths = std::move(snapshot.root_paths);
+        root_node_id_to_path_index = std::move(snapshot.root_node_id_to_path_index);
+        fmt::println(stderr, "Load: {} nodes in {}", nodes.Size(), ToMilliseconds(Clock::now() - start_time));
+    }
+    else
+    {
+        // Released before the snapshot is saved: it may be the same file
+        std::optional<TreeSnapshot> previous_snapshot;
+        ReadDirectoryTreeParams scan_params = options.scan_params;
+        if (options.previous_snapshot_path)
+        {
+            previous_snapshot = LoadTreeFile(*options.previous_snapshot_path);
+            if (root_paths.empty()) root_paths = previous_snapshot->root_paths;
+            scan_params.previous_tree = {
+                .nodes = &previous_snapshot->nodes,
+                .root_paths = previous_snapshot->root_paths,
+                .root_node_id_to_path_index = &previous_snapshot->root_node_id_to_path_index,
+            };
+        }
+
+        std::optional<std::string_view> root_node_name;
+        if (root_paths.size() != 1) root_node_name = "SELECTION";
+
+        ReadDirectoryTreeStats stats;
+        nodes = ReadDirectoryTreeMulti(root_node_name, root_paths, &root_node_id_to_path_index, scan_params, &stats);
+        PrintScanStats(stderr, stats);
+    }
+
+    if (options.save_snapshot_path)
+    {
+        const auto save_start = Clock::now();
+        WriteTreeFile(
+            *options.save_snapshot_path,
+            nodes,
+            root_paths,
+            root_node_id_to_path_index,
+            options.compact_json);
+        fmt::println(stderr, "Save snapshot: {}", ToMilliseconds(Clock::now() - save_start));
+    }
+
+    const auto index_start = Clock::now();
+    TreeChildIndex child_index;
+    child_index.Build(nodes);
+    fmt::println(stderr, "Child index: {}", ToMilliseconds(Clock::now() - index_start));
+
+    const auto layout_start = Clock::now();
+    const std::vector<Rect2d> rects = RectTreeDrawData::Create(nodes, child_index);
+    fmt::println(stderr, "Layout: {}", ToMilliseconds(Clock::now() - layout_start));
+
+    const auto write_start = Clock::now();
+    if (options.output_path)
+    {
+        std::unique_ptr<std::FILE, decltype(&std::fclose)> file(
+            PathHelpers::OpenFileForWriting(*options.output_path),
+            &std::fclose);
+        klgl::ErrorHandling::Ensure(file != nullptr, "Failed to open {}", *options.output_path);
+        WriteNodes(file.get(), nodes, child_index, rects, root_paths, root_node_id_to_path_index);
+        klgl::ErrorHandling::Ensure(std::fclose(file.release()) == 0, "Failed to write {}", *options.output_path);
+    }
+    else
+    {
+        WriteNodes(stdout, nodes, child_index, rects, root_paths, root_node_id_to_path_index);
+        std::fflush(stdout);
+    }
+
+    fmt::println(stderr, "Write: {}", ToMilliseconds(Clock::now() - write_start));
+    fmt::println(stderr, "Total: {}", ToMilliseconds(Clock::now() - start_time));
+}
+
+}  // namespace rect_tree_viewer
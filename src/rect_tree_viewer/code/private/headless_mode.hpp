@@ -0,0 +1,32 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include "read_directory_tree.hpp"
+
+namespace rect_tree_viewer
+{
+
+struct HeadlessModeOptions
+{
+    std::vector<std::filesystem::path> root_paths;
+    ReadDirectoryTreeParams scan_params;
+    std::optional<std::filesystem::path> load_snapshot_path;
+    std::optional<std::filesystem::path> save_snapshot_path;
+    std::optional<std::filesystem::path> previous_snapshot_path;
+    bool compact_json = false;
+    std::vector<std::filesystem::path> dump_paths;
+
+    // Standard output if not set
+    std::optional<std::filesystem::path> output_path;
+};
+
+// Scans (or loads) the tree and lays it out without a window, then writes every node with its rectangle as tab
+// separated lines: id, parent, value, x, y, width, height and name. Nodes go depth first, children of a node from the
+// biggest one. Roots are named by their full path, tabs, new lines and backslashes in names are escaped. Timings of
+// each phase go to the standard error.
+void RunHeadlessMode(const HeadlessModeOptions& options);
+
+}  // namespace rect_tree_viewer
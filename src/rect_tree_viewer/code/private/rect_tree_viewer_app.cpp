@@ -1,16 +1,38 @@
 #include "rect_tree_viewer_app.hpp"
 
-#include <random>
+#include <algorithm>
+#include <chrono>
 #include <ranges>
 
+#include "allocation_counter.hpp"
+#include "disk_usage_import.hpp"
+#include "fmt/chrono.h"
 #include "klgl/events/event_listener_method.hpp"
 #include "klgl/events/event_manager.hpp"
 #include "klgl/opengl/gl_api.hpp"
-#include "read_directory_tree.hpp"
+#include "tracing.hpp"
+#include "tree_json.hpp"
 
 namespace rect_tree_viewer
 {
 
+namespace
+{
+
+// Matches of the name search are drawn in this color, their ancestors halfway between it and their own
+const Vec4u8 kSearchMatchColor{255, 220, 0, 255};
+
+[[nodiscard]] Vec4u8 MixColors(const Vec4u8& a, const Vec4u8& b)
+{
+    auto mix = [](uint8_t x, uint8_t y)
+    {
+        return static_cast<uint8_t>((x + y) / 2);
+    };
+    return {mix(a.x(), b.x()), mix(a.y(), b.y()), mix(a.z(), b.z()), 255};
+}
+
+}  // namespace
+
 void RectTreeViewerApp::Initialize()
 {
     event_listener_ = klgl::events::EventListenerMethodCallbacks<&RectTreeViewerApp::OnMouseScroll>::CreatePtr(this);
@@ -22,6 +44,7 @@ void RectTreeViewerApp::Initialize()
     GetWindow().SetTitle("Rect Tree Viewer");
     SetTargetFramerate(60.f);
     painter_ = std::make_unique<klgl::Painter2d>();
+    draw_backend_ = std::make_unique<PainterRectDrawBackend>(*painter_);
 
     big_font_ = [&](float pixel_size)
     {
@@ -34,29 +57,278 @@ void RectTreeViewerApp::Initialize()
         return font;
     }(45);
 
-    if (root_paths_.size() == 1)
+    LoadTree();
+}
+
+Vec4u8 RectTreeViewerApp::MakeRandomColor()
+{
+    std::uniform_int_distribution<int> color_distribution(0, 255);
+    auto get_color_value = [&]
+    {
+        return static_cast<uint8_t>(color_distribution(colors_random_));
+    };
+    return {get_color_value(), get_color_value(), get_color_value(), 255};
+}
+
+void RectTreeViewerApp::LoadTree()
+{
+    if (!load_snapshot_path_ && dump_paths_.empty())
+    {
+        StartScan();
+        return;
+    }
+
+    const auto load_start = std::chrono::steady_clock::now();
+    TreeSnapshot snapshot =
+        load_snapshot_path_ ? LoadTreeFile(*load_snapshot_path_) : ImportDiskUsageDumps(dump_paths_);
+    nodes_ = std::move(snapshot.nodes);
+    root_paths_ = std::move(snapshot.root_paths);
+    root_node_id_to_path_index_ = std::move(snapshot.root_node_id_to_path_index);
+    fmt::println(
+        "Loaded {} nodes from {} in {}",
+        nodes_.Size(),
+        load_snapshot_path_ ? *load_snapshot_path_ : dump_paths_.front(),
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - load_start));
+
+    OnTreeLoaded();
+}
+
+void RectTreeViewerApp::StartScan()
+{
+    ReadDirectoryTreeParams scan_params = scan_params_;
+    if (previous_snapshot_path_)
+    {
+        previous_snapshot_ = LoadTreeFile(*previous_snapshot_path_);
+        if (root_paths_.empty()) root_paths_ = previous_snapshot_->root_paths;
+        scan_params.previous_tree = {
+            .nodes = &previous_snapshot_->nodes,
+            .root_paths = previous_snapshot_->root_paths,
+            .root_node_id_to_path_index = &previous_snapshot_->root_node_id_to_path_index,
+        };
+    }
+
+    std::optional<std::string> root_node_name;
+    if (root_paths_.size() != 1)
+    {
+        root_node_name = "SELECTION";
+    }
+
+    background_scan_ = std::make_unique<BackgroundTreeScan>(std::move(root_node_name), root_paths_, scan_params);
+    root_node_id_to_path_index_ = background_scan_->GetRootNodeIdToPathIndex();
+    hovered_node_path_.SetRoots(root_paths_, root_node_id_to_path_index_);
+}
+
+void RectTreeViewerApp::UpdateBackgroundScan()
+{
+    if (!background_scan_->IsFinished())
+    {
+        TreeChanges changes;
+        background_scan_->ApplyListings(nodes_, changes, kScanPreviewBudget);
+        changes.Finalize();
+        ApplyTreeChanges(changes);
+        return;
+    }
+
+    // The merged tree is numbered differently, it replaces the one built from listings. The previous snapshot is
+    // released before the save in OnTreeLoaded: it may be the same file.
+    BackgroundTreeScanResult result = background_scan_->TakeResult();
+    background_scan_.reset();
+    previous_snapshot_.reset();
+    nodes_ = std::move(result.nodes);
+    root_node_id_to_path_index_ = std::move(result.root_node_id_to_path_index);
+    PrintScanStats(stdout, result.stats);
+    OnTreeLoaded();
+}
+
+void RectTreeViewerApp::UpdateSubtreeExpansion()
+{
+    if (subtree_expansion_ && subtree_expansion_->IsFinished())
+    {
+        TreeChanges changes;
+        if (const NodeId subtree = subtree_expansion_->Splice(nodes_, changes); subtree == kInvalidNodeId)
+        {
+            failed_expansions_.push_back(subtree_expansion_->GetNodeId());
+        }
+        else if (watcher_)
+        {
+            watcher_->OnSubtreeReplaced(nodes_, subtree_expansion_->GetNodeId(), subtree);
+        }
+
+        subtree_expansion_.reset();
+        changes.Finalize();
+        ApplyTreeChanges(changes);
+    }
+
+    if (subtree_expansion_ || expansion_candidate_ == kInvalidNodeId) return;
+
+    // The scan limits apply again from the expanded directory, deeper levels are listed by later expansions
+    ReadDirectoryTreeParams params = scan_params_;
+    params.previous_tree = {};
+    params.listener = nullptr;
+    // Built apart from the hover path cache, which has to keep the path of the hovered node
+    subtree_expansion_ = std::make_unique<SubtreeExpansion>(
+        expansion_candidate_,
+        PathHelpers::PathFromUTF8(
+            PathHelpers::GetNodeFullPath(nodes_, root_paths_, root_node_id_to_path_index_, expansion_candidate_)),
+        params);
+    expansion_candidate_ = kInvalidNodeId;
+}
+
+void RectTreeViewerApp::OnTreeLoaded()
+{
+    fmt::println(
+        "Tree takes {} bytes ({:.1f} bytes per node)",
+        nodes_.GetMemoryUsage(),
+        static_cast<double>(nodes_.GetMemoryUsage()) / static_cast<double>(std::max(nodes_.Size(), size_t{1})));
+    hovered_node_path_.SetRoots(root_paths_, root_node_id_to_path_index_);
+
+    if (save_snapshot_path_)
+    {
+        WriteTreeFile(*save_snapshot_path_, nodes_, root_paths_, root_node_id_to_path_index_, compact_json_);
+        fmt::println("Saved snapshot to {}", *save_snapshot_path_);
+    }
+
+    child_index_.Build(nodes_);
+    if (lazy_layout_)
     {
-        nodes_ = ReadDirectoryTreeMulti(std::nullopt, root_paths_, &root_node_id_to_path_index_);
+        lazy_layout_->Clear();
     }
     else
     {
-        nodes_ = ReadDirectoryTreeMulti("SELECTION", root_paths_, &root_node_id_to_path_index_);
+        rects_ = RectTreeDrawData::Create(
+            nodes_,
+            child_index_,
+            RectTreeDrawData::kDefaultPaddingFactor,
+            0,
+            &spatial_index_);
     }
 
-    rects_ = RectTreeDrawData::Create(nodes_);
+    // Same colors as if the tree was never shown while scanning
+    colors_random_.seed(0);
+    colors_.resize(nodes_.Size());
+    for (const NodeId i : nodes_.Ids())
+    {
+        colors_[i] = MakeRandomColor();
+    }
 
-    colors_.resize(nodes_.size());
-    unsigned kSeed = 0;
-    std::mt19937 rnd(kSeed);  // NOLINT
-    std::uniform_int_distribution<int> color_distribution(0, 255);
-    auto get_color_value = [&]
+    if (!lazy_layout_) draw_list_.Rebuild(rects_, colors_);
+
+    // Node ids changed and colors are new, so the highlight starts over
+    highlighted_nodes_.clear();
+    is_highlighted_.clear();
+    highlighted_matches_count_ = 0;
+    recolored_nodes_.clear();
+    name_search_.Restart();
+
+    if (watch_)
     {
-        return static_cast<uint8_t>(color_distribution(rnd));
-    };
-    for (const size_t i : std::views::iota(size_t{0}, nodes_.size()))
+        watcher_ = std::make_unique<TreeWatcher>(nodes_, root_paths_, root_node_id_to_path_index_);
+        fmt::println(
+            "Watching {} directories ({} could not be watched)",
+            watcher_->GetWatchesCount(),
+            watcher_->GetFailedWatchesCount());
+    }
+}
+
+void RectTreeViewerApp::ApplyTreeChanges(const TreeChanges& changes)
+{
+    if (changes.events_lost) fmt::println("File system events were lost, listing all watched directories again");
+    if (changes.IsEmpty()) return;
+
+    // Nodes may be renamed or moved
+    hovered_node_path_.Invalidate();
+
+    colors_.reserve(nodes_.Size());
+    while (colors_.size() < nodes_.Size()) colors_.push_back(MakeRandomColor());
+    child_index_.Update(nodes_, changes.dirty_nodes);
+
+    // A running scan only adds nodes, which the name search gets to in later updates. Other edits may rename, move or
+    // unlink matches
+    if (!background_scan_)
+    {
+        ClearSearchHighlight();
+        name_search_.Restart();
+    }
+
+    if (lazy_layout_)
+    {
+        lazy_layout_->Invalidate(changes.dirty_nodes);
+        return;
+    }
+
+    // Unlinked subtrees are no longer laid out, hide them
+    std::vector<NodeId> stack(changes.unlinked_nodes.begin(), changes.unlinked_nodes.end());
+    while (!stack.empty())
+    {
+        const NodeId node_id = stack.back();
+        stack.pop_back();
+        rects_[node_id] = {};
+        const std::span<const NodeId> children = child_index_.GetChildren(node_id);
+        stack.insert(stack.end(), children.begin(), children.end());
+    }
+
+    moved_nodes_.clear();
+    RectTreeDrawData::Update(
+        nodes_,
+        child_index_,
+        changes.dirty_nodes,
+        rects_,
+        RectTreeDrawData::kDefaultPaddingFactor,
+        &spatial_index_,
+        &moved_nodes_);
+    draw_list_.Update(rects_, colors_, moved_nodes_);
+}
+
+void RectTreeViewerApp::UpdateNameSearch()
+{
+    name_search_.Update(nodes_, kNameSearchBudget);
+
+    // Ancestors tinted for an earlier match have theirs tinted as well
+    const std::span<const NodeId> matches = name_search_.GetMatches();
+    is_highlighted_.resize(nodes_.Size());
+    for (const NodeId node_id : matches.subspan(highlighted_matches_count_))
+    {
+        const bool was_highlighted = is_highlighted_[node_id];
+        if (!was_highlighted)
+        {
+            is_highlighted_[node_id] = true;
+            highlighted_nodes_.emplace_back(node_id, colors_[node_id]);
+        }
+
+        colors_[node_id] = kSearchMatchColor;
+        recolored_nodes_.push_back(node_id);
+        if (was_highlighted) continue;
+
+        for (NodeId parent_id = nodes_.GetParent(node_id); parent_id != kInvalidNodeId && !is_highlighted_[parent_id];
+             parent_id = nodes_.GetParent(parent_id))
+        {
+            is_highlighted_[parent_id] = true;
+            highlighted_nodes_.emplace_back(parent_id, colors_[parent_id]);
+            colors_[parent_id] = MixColors(colors_[parent_id], kSearchMatchColor);
+            recolored_nodes_.push_back(parent_id);
+        }
+    }
+
+    highlighted_matches_count_ = matches.size();
+    TRACE_COUNTER("Highlighted nodes", highlighted_nodes_.size());
+
+    if (recolored_nodes_.empty()) return;
+    if (!lazy_layout_) draw_list_.Update(rects_, colors_, recolored_nodes_);
+    recolored_nodes_.clear();
+}
+
+void RectTreeViewerApp::ClearSearchHighlight()
+{
+    // The draw list is repacked by the next UpdateNameSearch
+    for (const auto& [node_id, color] : highlighted_nodes_)
     {
-        colors_[i] = {get_color_value(), get_color_value(), get_color_value(), 255};
+        colors_[node_id] = color;
+        recolored_nodes_.push_back(node_id);
     }
+
+    highlighted_nodes_.clear();
+    is_highlighted_.clear();
+    highlighted_matches_count_ = 0;
 }
 
 void RectTreeViewerApp::OnMouseScroll(const klgl::events::OnMouseScroll& event)
@@ -96,86 +368,128 @@ Vec2f RectTreeViewerApp::GetMousePositionInWorldCoordinates() const
     return edt::Math::TransformPos(transforms_.screen_to_world, p);
 }
 
-std::optional<size_t> RectTreeViewerApp::FindNodeAt(const Vec2f& position) const
+Rect2d RectTreeViewerApp::GetViewRectInWorldCoordinates() const
 {
-    if (rects_.empty() || !rects_.front().Contains(position)) return std::nullopt;
-
-    size_t parent = 0;
-    std::vector<size_t> children;
-
-    while (true)
-    {
-        children.clear();
-        TreeHelper::GetChildren(nodes_, parent, children);
-
-        bool found_child = false;
-        for (size_t child : children)
-        {
-            if (rects_[child].Contains(position))
-            {
-                found_child = true;
-                parent = child;
-                break;
-            }
-        }
+    const auto screen_size = GetWindow().GetSize2f();
+    const Vec2f a = edt::Math::TransformPos(transforms_.screen_to_world, Vec2f{});
+    const Vec2f b = edt::Math::TransformPos(transforms_.screen_to_world, screen_size);
+    const Vec2f bottom_left{std::min(a.x(), b.x()), std::min(a.y(), b.y())};
+    const Vec2f top_right{std::max(a.x(), b.x()), std::max(a.y(), b.y())};
+    return {.bottom_left = bottom_left, .size = top_right - bottom_left};
+}
 
-        if (!found_child)
-        {
-            break;
-        }
-    }
+std::optional<NodeId> RectTreeViewerApp::FindNodeAt(const Vec2f& position) const
+{
+    TRACE_SCOPE("FindNodeAt");
+    if (lazy_layout_) return lazy_layout_->FindNodeAt(child_index_, position);
+    return spatial_index_.FindNodeAt(rects_, position);
+}
 
-    return parent;
+std::string_view RectTreeViewerApp::GetNodeFullPath(NodeId in_node_id)
+{
+    return hovered_node_path_.GetFullPath(nodes_, in_node_id);
 }
 
-std::string RectTreeViewerApp::GetNodeFullPath(size_t in_node_id) const
+std::tuple<long double, std::string_view> RectTreeViewerApp::PickSizeUnit(long double size)
 {
-    std::string path;
-    std::string buffer;
+    if (auto value = (size / 1'000'000'000'000'000); value > 1.001L) return {value, "PB"};
+    if (auto value = (size / 1'000'000'000'000); value > 1.001L) return {value, "TB"};
+    if (auto value = (size / 1'000'000'000); value > 1.001L) return {value, "GB"};
+    if (auto value = (size / 1'000'000); value > 1.001L) return {value, "MB"};
+    if (auto value = (size / 1'000); value > 1.001L) return {value, "kB"};
+    return {size, "b"};
+}
 
-    std::optional<size_t> node_id = in_node_id;
-    while (node_id)
+void RectTreeViewerApp::DrawScanProgress()
+{
+    const BackgroundTreeScanProgress progress = background_scan_->GetProgress();
+    auto to_seconds = [](std::chrono::nanoseconds duration)
     {
-        auto& node = nodes_[*node_id];
-        auto inserter = std::back_inserter(buffer);
-        const bool is_root = root_node_id_to_path_index_.contains(*node_id);
+        return std::chrono::duration_cast<std::chrono::seconds>(duration);
+    };
 
-        const auto format = fmt::runtime(path.empty() ? "{}" : "{}/{}");
+    text_buffer_.clear();
+    FormatToBuffer(
+        text_buffer_,
+        "Scanning: {} nodes, {} directories queued, {}",
+        progress.nodes_count,
+        progress.queued_directories_count,
+        to_seconds(progress.elapsed));
+    if (progress.remaining)
+    {
+        FormatToBuffer(
+            text_buffer_,
+            ", {}{} left",
+            progress.remaining_is_lower_bound ? "at least " : "",
+            to_seconds(*progress.remaining));
+    }
 
-        if (is_root)
-        {
-            fmt::format_to(inserter, format, root_paths_[root_node_id_to_path_index_.at(*node_id)], path);
-        }
-        else
-        {
-            fmt::format_to(inserter, format, node.name, path);
-        }
+    ImGui::TextUnformatted(text_buffer_.data(), text_buffer_.data() + text_buffer_.size());  // NOLINT
 
-        std::swap(path, buffer);
-        buffer.clear();
-        node_id = is_root ? std::nullopt : node.parent;
+    if (!background_scan_->IsCancelled())
+    {
+        ImGui::SameLine();
+        if (ImGui::Button("Cancel")) background_scan_->Cancel();
     }
+}
 
-    for (char& c : path)
+void RectTreeViewerApp::DrawNameSearch()
+{
+    ImGui::SetNextItemWidth(ImGui::GetContentRegionAvail().x * 0.4f);
+    if (ImGui::InputText("Search", name_search_input_.data(), name_search_input_.size()))
     {
-        if (c == '\\') c = '/';
+        ClearSearchHighlight();
+        name_search_.SetQuery(name_search_input_.data());
     }
 
-    return path;
+    if (name_search_.GetQuery().empty()) return;
+
+    ImGui::SameLine();
+    const char* mode = name_search_.GetMode() == NameSearchMode::Glob ? "glob" : "substring";
+    if (name_search_.IsFinished(nodes_))
+    {
+        ImGuiText("{} matches ({})", name_search_.GetMatches().size(), mode);
+    }
+    else
+    {
+        ImGuiText(
+            "{} matches in {} of {} nodes ({})",
+            name_search_.GetMatches().size(),
+            name_search_.GetSearchedNodesCount(),
+            nodes_.Size(),
+            mode);
+    }
 }
 
-std::tuple<long double, std::string_view> RectTreeViewerApp::PickSizeUnit(long double size)
+void RectTreeViewerApp::DrawStatsOverlay()
 {
-    if (auto value = (size / 1'000'000'000'000'000); value > 1.001L) return {value, "PB"};
-    if (auto value = (size / 1'000'000'000'000); value > 1.001L) return {value, "TB"};
-    if (auto value = (size / 1'000'000'000); value > 1.001L) return {value, "GB"};
-    if (auto value = (size / 1'000'000); value > 1.001L) return {value, "MB"};
-    if (auto value = (size / 1'000); value > 1.001L) return {value, "kB"};
-    return {size, "b"};
+    constexpr int flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoInputs |
+                          ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings |
+                          ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav;
+
+    // Top right corner
+    const Vec2f position{GetWindow().GetSize2f().x() - 10, 10};
+    ImGui::SetNextWindowPos(ToImVec(position), ImGuiCond_Always, ImVec2(1, 0));
+    ImGui::SetNextWindowBgAlpha(0.5f);
+    if (ImGui::Begin("Stats", nullptr, flags))
+    {
+        ImGuiText(
+            "Frame: p50 {:.2f} ms, p99 {:.2f} ms",
+            frame_times_.GetPercentile(0.5f),
+            frame_times_.GetPercentile(0.99f));
+        if constexpr (AllocationCounter::kEnabled)
+        {
+            ImGuiText("Allocated: {} bytes per frame", frame_allocated_bytes_);
+        }
+    }
+    ImGui::End();
 }
 
 void RectTreeViewerApp::DrawGUI()
 {
+    TRACE_SCOPE("DrawGUI");
+    if (stats_overlay_) DrawStatsOverlay();
+
     {
         const Vec2f window_padding{10, 10};
 
@@ -196,12 +510,25 @@ void RectTreeViewerApp::DrawGUI()
 
         if (ImGui::Begin("Counter", nullptr, flags))
         {
+            if (background_scan_) DrawScanProgress();
+            if (subtree_expansion_) ImGuiText("Expanding: {}", subtree_expansion_->GetPath());
+            DrawNameSearch();
+
+            ImGuiText("Drawn: {} nodes, culled: {}", drawn_nodes_count_, culled_nodes_count_);
+
+            const uint64_t allocations_count = AllocationCounter::GetThreadAllocationsCount();
             if (auto opt_node_id = FindNodeAt(GetMousePositionInWorldCoordinates()))
             {
                 ImGuiText("Cursor: {}", GetNodeFullPath(*opt_node_id));
 
-                const auto [value, unit] = PickSizeUnit(nodes_[*opt_node_id].value);
-                ImGuiText("  Size: {} {}", value, unit);
+                const auto [value, unit] = PickSizeUnit(static_cast<long double>(nodes_.GetValue(*opt_node_id)));
+                const bool estimated = IsUnexpandedDirectory(nodes_, *opt_node_id);
+                ImGuiText("  Size: {} {}{}", value, unit, estimated ? " (estimated, not listed yet)" : "");
+            }
+            hover_allocations_count_ = AllocationCounter::GetThreadAllocationsCount() - allocations_count;
+            if constexpr (AllocationCounter::kEnabled)
+            {
+                if (hover_allocations_count_ != 0) ImGuiText("Hover text allocated {} times", hover_allocations_count_);
             }
             ImGui::End();
         }
@@ -211,22 +538,94 @@ void RectTreeViewerApp::DrawGUI()
     }
 }
 
+void RectTreeViewerApp::DrawTree()
+{
+    TRACE_SCOPE("DrawTree");
+    const Rect2d view = GetViewRectInWorldCoordinates();
+    const Vec2f window_size = GetWindow().GetSize2f();
+    const Vec2f pixel_size{view.size.x() / window_size.x(), view.size.y() / window_size.y()};
+    drawn_nodes_count_ = 0;
+
+    // Only trees from a finished scan with depth or time limits have unexpanded directories
+    expansion_candidate_ = kInvalidNodeId;
+    const bool pick_expansion_candidate = !background_scan_ && !subtree_expansion_ &&
+                                          (scan_params_.max_depth != 0 || scan_params_.time_budget.count() != 0);
+    float expansion_candidate_area = kExpansionMinPixelArea * pixel_size.x() * pixel_size.y();
+    auto consider_expansion = [&](NodeId node_id, const Rect2d& rect)
+    {
+        const float area = rect.size.x() * rect.size.y();
+        if (area < expansion_candidate_area || !IsUnexpandedDirectory(nodes_, node_id)) return;
+        if (std::ranges::find(failed_expansions_, node_id) != failed_expansions_.end()) return;
+        expansion_candidate_ = node_id;
+        expansion_candidate_area = area;
+    };
+
+    if (lazy_layout_)
+    {
+        lazy_layout_->Update(nodes_, child_index_, view, kLazyLayoutMinPixels * pixel_size.x());
+        for (const auto& [node_id, rect] : lazy_layout_->GetVisibleNodes())
+        {
+            painter_->FillRect(rect.ToPainterRect(colors_[node_id]));
+            if (pick_expansion_candidate) consider_expansion(node_id, rect);
+        }
+
+        drawn_nodes_count_ = lazy_layout_->GetVisibleNodes().size();
+    }
+    else
+    {
+        // Off-screen subtrees are skipped, rectangles below min_pixel_area_ are drawn without their children
+        const float min_area = min_pixel_area_ * pixel_size.x() * pixel_size.y();
+        visible_nodes_.clear();
+        bool parents_go_first = true;
+        spatial_index_.VisitIntersecting(
+            rects_,
+            view,
+            [&](NodeId node_id, const Rect2d& rect)
+            {
+                visible_nodes_.push_back(node_id);
+                if (pick_expansion_candidate) consider_expansion(node_id, rect);
+                parents_go_first = parents_go_first && (node_id == 0 || nodes_.GetParent(node_id) < node_id);
+                return rect.size.x() * rect.size.y() >= min_area;
+            });
+
+        // Ids of siblings from a scan are consecutive, so in id order they make long batches. Children have to be
+        // drawn over their parents, which id order keeps unless edits moved a node under a newer directory
+        if (parents_go_first) std::ranges::sort(visible_nodes_);
+
+        draw_list_.Upload(*draw_backend_);
+        draw_list_.Draw(*draw_backend_, visible_nodes_);
+        drawn_nodes_count_ = visible_nodes_.size();
+    }
+
+    culled_nodes_count_ = nodes_.Size() - std::min(drawn_nodes_count_, nodes_.Size());
+    TRACE_COUNTER("Drawn rects", drawn_nodes_count_);
+}
+
 void RectTreeViewerApp::Tick()
 {
+    TRACE_SCOPE("Tick");
+    const auto frame_start = std::chrono::steady_clock::now();
+    if (last_frame_start_) frame_times_.Add(frame_start - *last_frame_start_);
+    last_frame_start_ = frame_start;
+    const uint64_t allocated_bytes = AllocationCounter::GetThreadAllocatedBytes();
+
+    if (background_scan_) UpdateBackgroundScan();
+    if (watcher_) ApplyTreeChanges(watcher_->Poll(nodes_));
+    if (!background_scan_) UpdateSubtreeExpansion();
+    UpdateNameSearch();
+
     UpdateCamera();
 
     painter_->BeginDraw();
 
     painter_->SetViewMatrix(transforms_.world_to_view.Transposed());
-
-    for (const size_t i : std::views::iota(size_t{0}, nodes_.size()))
-    {
-        painter_->FillRect(rects_[i].ToPainterRect(colors_[i]));
-    }
-
+    DrawTree();
     painter_->EndDraw();
 
     DrawGUI();
+
+    frame_allocated_bytes_ = AllocationCounter::GetThreadAllocatedBytes() - allocated_bytes;
+    TRACE_COUNTER("Allocated bytes per frame", frame_allocated_bytes_);
 }
 
 }  // namespace rect_tree_viewer
@@ -3,22 +3,33 @@
 #include <imgui.h>
 
 #include <EverydayTools/Math/Math.hpp>
+#include <array>
+#include <chrono>
 #include <filesystem>
 #include <klgl/ui/simple_type_widget.hpp>
 #include <optional>
+#include <random>
 
+#include "background_tree_scan.hpp"
 #include "fmt/std.h"  // IWYU pragma: keep
+#include "frame_time_history.hpp"
 #include "klgl/application.hpp"
 #include "klgl/camera/camera_2d.hpp"
 #include "klgl/error_handling.hpp"
 #include "klgl/events/event_listener_interface.hpp"
 #include "klgl/events/mouse_events.hpp"
-#include "klgl/filesystem/filesystem.hpp"
 #include "klgl/reflection/matrix_reflect.hpp"  // IWYU pragma: keep
 #include "klgl/rendering/painter2d.hpp"
 #include "klgl/window.hpp"
-#include "nlohmann/json.hpp"
+#include "name_search.hpp"
+#include "path_helpers.hpp"
+#include "read_directory_tree.hpp"
+#include "rect_draw_list.hpp"
 #include "rect_tree_draw_data.hpp"
+#include "subtree_expansion.hpp"
+#include "tree_child_index.hpp"
+#include "tree_json.hpp"
+#include "tree_watcher.hpp"
 
 namespace rect_tree_viewer
 {
@@ -36,41 +47,95 @@ using namespace edt::lazy_matrix_aliases;  // NOLINT
     return {v.x, v.y};
 }
 
-inline void WriteNodesGraphToJSON(std::span<const TreeNode> nodes, const fs::path& path)
+struct RectTreeViewerAppOptions
 {
-    nlohmann::json json;
-    auto& nodes_json = json["nodes"];
-    for (const TreeNode& node : nodes)
-    {
-        nlohmann::json& node_json = nodes_json.emplace_back(nlohmann::json::object());
-        node_json["name"] = node.name;
-        node_json["value"] = node.value;
+    std::vector<fs::path> root_paths;
+    ReadDirectoryTreeParams scan_params;
 
-        if (node.parent) node_json["parent"] = *node.parent;
-        if (node.first_child) node_json["first_child"] = *node.first_child;
-        if (node.next_sibling) node_json["next_sibling"] = *node.next_sibling;
-    }
+    // Read the tree from a snapshot instead of scanning root paths. Snapshots ending in .json are JSON (tree_json.hpp)
+    std::optional<fs::path> load_snapshot_path;
+    std::optional<fs::path> save_snapshot_path;
 
-    klgl::Filesystem::WriteFile(path, json.dump(2, ' '));
-}
+    // Save JSON snapshots without indentation
+    bool compact_json = false;
+
+    // Show disk usage dumps (ncdu -o, du -ab) instead of scanning root paths
+    std::vector<fs::path> dump_paths;
+
+    // Scan incrementally, reusing unchanged directories of this snapshot. Root paths default to the snapshot ones
+    std::optional<fs::path> previous_snapshot_path;
+
+    // Keep the tree up to date with changes on disk
+    bool watch = false;
+
+    // Lay out only visible nodes, see LazyRectTreeDrawData
+    bool lazy_layout = false;
+
+    // Children of smaller rectangles are not drawn
+    float min_pixel_area = 1.f;
+
+    // Show frame time percentiles, drawn rectangles and allocations per frame
+    bool stats_overlay = false;
+};
 
 class RectTreeViewerApp : public klgl::Application
 {
 public:
     static constexpr auto kAspectRatioPolicy = klgl::AspectRatioPolicy::Stretch;
 
-    explicit RectTreeViewerApp(std::vector<fs::path> paths) : klgl::Application(), root_paths_(std::move(paths))
+    explicit RectTreeViewerApp(RectTreeViewerAppOptions options)
+        : klgl::Application(),
+          root_paths_(std::move(options.root_paths)),
+          scan_params_(options.scan_params),
+          load_snapshot_path_(std::move(options.load_snapshot_path)),
+          save_snapshot_path_(std::move(options.save_snapshot_path)),
+          compact_json_(options.compact_json),
+          dump_paths_(std::move(options.dump_paths)),
+          previous_snapshot_path_(std::move(options.previous_snapshot_path)),
+          watch_(options.watch),
+          min_pixel_area_(options.min_pixel_area),
+          stats_overlay_(options.stats_overlay)
     {
-        klgl::ErrorHandling::Ensure(!root_paths_.empty(), "Expected at least one path");
+        if (options.lazy_layout) lazy_layout_ = std::make_unique<LazyRectTreeDrawData>();
+
+        klgl::ErrorHandling::Ensure(
+            !root_paths_.empty() || load_snapshot_path_ || previous_snapshot_path_ || !dump_paths_.empty(),
+            "Expected at least one path, a snapshot or a disk usage dump");
     }
 
+    // Time per frame spent growing the tree from a running scan
+    static constexpr std::chrono::milliseconds kScanPreviewBudget{4};
+
+    // Time per frame spent searching names, the rest of the tree is searched by the next frames
+    static constexpr std::chrono::milliseconds kNameSearchBudget{4};
+
+    // Children of smaller rectangles are not laid out in lazy layout mode
+    static constexpr float kLazyLayoutMinPixels = 2.f;
+
+    // Unexpanded directories of a shallow scan are listed once their rectangle takes this many pixels
+    static constexpr float kExpansionMinPixelArea = 64.f * 64.f;
+
     void Initialize() override;
+    void LoadTree();
+    void StartScan();
+    void UpdateBackgroundScan();
+    void UpdateSubtreeExpansion();
+    void OnTreeLoaded();
+    void ApplyTreeChanges(const TreeChanges& changes);
+    Vec4u8 MakeRandomColor();
+    void UpdateNameSearch();
+    void ClearSearchHighlight();
     void OnMouseScroll(const klgl::events::OnMouseScroll& event);
     void UpdateCamera();
     Vec2f GetMousePositionInWorldCoordinates() const;
-    std::optional<size_t> FindNodeAt(const Vec2f& position) const;
-    std::string GetNodeFullPath(size_t in_node_id) const;
+    Rect2d GetViewRectInWorldCoordinates() const;
+    std::optional<NodeId> FindNodeAt(const Vec2f& position) const;
+    std::string_view GetNodeFullPath(NodeId in_node_id);
     static std::tuple<long double, std::string_view> PickSizeUnit(long double size);
+    void DrawScanProgress();
+    void DrawNameSearch();
+    void DrawTree();
+    void DrawStatsOverlay();
     void DrawGUI();
     void Tick() override;
 
@@ -95,13 +160,71 @@ public:
 
     std::string text_buffer_;
 
-    std::vector<TreeNode> nodes_;
-    std::unordered_map<size_t, size_t> root_node_id_to_path_index_;
+    TreeNodes nodes_;
+    std::unordered_map<NodeId, size_t> root_node_id_to_path_index_;
+
+    // Sorted children of nodes_ for the layout and hit testing, kept up to date with every edit
+    TreeChildIndex child_index_;
 
+    // Rectangles of all nodes, empty in lazy layout mode
     std::vector<Rect2d> rects_;
+    RectTreeSpatialIndex spatial_index_;
+
+    // Packed rectangles and colors of rects_, changed only with the layout
+    RectDrawList draw_list_;
+    std::unique_ptr<IRectDrawBackend> draw_backend_;
+    std::vector<NodeId> visible_nodes_;
+    std::vector<NodeId> moved_nodes_;
+    std::unique_ptr<LazyRectTreeDrawData> lazy_layout_;
     std::vector<Vec4u8> colors_;
     std::unique_ptr<klgl::Painter2d> painter_;
     std::vector<fs::path> root_paths_;
+    ReadDirectoryTreeParams scan_params_;
+    std::optional<fs::path> load_snapshot_path_;
+    std::optional<fs::path> save_snapshot_path_;
+    bool compact_json_ = false;
+    std::vector<fs::path> dump_paths_;
+    std::optional<fs::path> previous_snapshot_path_;
+    bool watch_ = false;
+    float min_pixel_area_ = 1.f;
+    bool stats_overlay_ = false;
+
+    // Nodes drawn by the last frame and the rest of the tree
+    size_t drawn_nodes_count_ = 0;
+    size_t culled_nodes_count_ = 0;
+
+    // Path of the hovered node and heap allocations made by the hover text in the last frame, zero once the buffers
+    // have grown
+    NodeFullPathCache hovered_node_path_;
+    uint64_t hover_allocations_count_ = 0;
+
+    // Time between the starts of consecutive frames and bytes allocated by the last frame on the main thread
+    FrameTimeHistory frame_times_;
+    std::optional<std::chrono::steady_clock::time_point> last_frame_start_;
+    uint64_t frame_allocated_bytes_ = 0;
+
+    // Incremental scans read the previous tree until they finish
+    std::optional<TreeSnapshot> previous_snapshot_;
+
+    // Set while the tree is being scanned, nodes_ then grows with each frame
+    std::unique_ptr<BackgroundTreeScan> background_scan_;
+    std::unique_ptr<TreeWatcher> watcher_;
+
+    // Scans limited by depth or time leave unexpanded directories. The largest one on screen is listed in the
+    // background with the same limits and spliced into the tree, one at a time
+    std::unique_ptr<SubtreeExpansion> subtree_expansion_;
+    NodeId expansion_candidate_ = kInvalidNodeId;
+    std::vector<NodeId> failed_expansions_;
+
+    // Matches of the search box are highlighted in colors_, which keeps the own colors of tinted nodes here. Matches
+    // before highlighted_matches_count_ are tinted already
+    NameSearch name_search_;
+    std::array<char, 256> name_search_input_{};
+    std::vector<std::pair<NodeId, Vec4u8>> highlighted_nodes_;
+    std::vector<bool> is_highlighted_;
+    size_t highlighted_matches_count_ = 0;
+    std::vector<NodeId> recolored_nodes_;
+    std::mt19937 colors_random_{0};
 
     float zoom_power_ = 0.f;
 
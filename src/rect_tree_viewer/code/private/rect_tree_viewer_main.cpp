@@ -1,14 +1,22 @@
 #include <imgui.h>
 
 #include <EverydayTools/Math/Math.hpp>
+#include <algorithm>
+#include <charconv>
+#include <chrono>
 #include <filesystem>
 #include <klgl/ui/simple_type_widget.hpp>
-#include <ranges>
+#include <limits>
+#include <span>
+#include <string_view>
 
+#include "disk_usage_import.hpp"
 #include "fmt/std.h"  // IWYU pragma: keep
 #include "klgl/error_handling.hpp"
+#include "headless_mode.hpp"
 #include "klgl/reflection/matrix_reflect.hpp"  // IWYU pragma: keep
 #include "rect_tree_viewer_app.hpp"
+#include "tracing.hpp"
 
 #ifdef _WIN32
 #include "open_file_dialog.hpp"
@@ -33,14 +41,196 @@ bool IsRelativeTo(const fs::path& path, const fs::path& parent_path)
     return true;
 }
 
-tl::expected<std::vector<fs::path>, std::string> ParseCLI(int argc, char** argv)
+struct CommandLineOptions
 {
-    std::vector<fs::path> paths;
-    paths.reserve(static_cast<size_t>(argc) - 1);
+    RectTreeViewerAppOptions app;
 
-    for (const int arg_index : std::views::iota(0, argc) | std::views::drop(1))
+    // Scan, lay out and write the result without a window
+    bool headless = false;
+    std::optional<fs::path> output_path;
+
+    // Record phases of the run and write them as a Chrome trace on exit
+    std::optional<fs::path> trace_path;
+};
+
+tl::expected<size_t, std::string> ParseSizeOption(std::string_view option, std::string_view value)
+{
+    size_t result = 0;
+    const char* value_end = value.data() + value.size();  // NOLINT
+    const auto [end, err] = std::from_chars(value.data(), value_end, result);
+    if (err != std::errc{} || end != value_end)
+    {
+        return tl::make_unexpected(fmt::format("Invalid value \"{}\" for {}", value, option));
+    }
+
+    return result;
+}
+
+tl::expected<float, std::string> ParseFloatOption(std::string_view option, std::string_view value)
+{
+    float result = 0;
+    const char* value_end = value.data() + value.size();  // NOLINT
+    const auto [end, err] = std::from_chars(value.data(), value_end, result);
+    if (err != std::errc{} || end != value_end || result < 0)
+    {
+        return tl::make_unexpected(fmt::format("Invalid value \"{}\" for {}", value, option));
+    }
+
+    return result;
+}
+
+tl::expected<ReadDirectoryTreeBackend, std::string> ParseScanBackendOption(std::string_view value)
+{
+    if (value == "auto") return ReadDirectoryTreeBackend::Auto;
+    if (value == "filesystem") return ReadDirectoryTreeBackend::Filesystem;
+    if (value == "linux") return ReadDirectoryTreeBackend::Linux;
+    if (value == "io_uring") return ReadDirectoryTreeBackend::IoUring;
+    return tl::make_unexpected(
+        fmt::format("Invalid scan backend \"{}\", expected auto, filesystem, linux or io_uring", value));
+}
+
+tl::expected<CommandLineOptions, std::string> ParseCLI(int argc, char** argv)
+{
+    CommandLineOptions options;
+    options.app.root_paths.reserve(static_cast<size_t>(argc) - 1);
+
+    const std::span<char*> args(argv, static_cast<size_t>(argc));
+    for (size_t arg_index = 1; arg_index < args.size(); ++arg_index)
     {
-        fs::path path{argv[arg_index]};  // NOLINT
+        const std::string_view arg = args[arg_index];
+
+        if (arg == "--watch")
+        {
+            options.app.watch = true;
+            continue;
+        }
+
+        if (arg == "--lazy-layout")
+        {
+            options.app.lazy_layout = true;
+            continue;
+        }
+
+        if (arg == "--headless")
+        {
+            options.headless = true;
+            continue;
+        }
+
+        if (arg == "--compact-json")
+        {
+            options.app.compact_json = true;
+            continue;
+        }
+
+        if (arg == "--stats-overlay")
+        {
+            options.app.stats_overlay = true;
+            continue;
+        }
+
+        if (arg.starts_with("--"))
+        {
+            if (arg_index + 1 == args.size())
+            {
+                return tl::make_unexpected(fmt::format("Expected a value after {}", arg));
+            }
+
+            const std::string_view value = args[++arg_index];
+            if (arg == "--scan-threads")
+            {
+                auto thread_count = ParseSizeOption(arg, value);
+                if (!thread_count) return tl::make_unexpected(std::move(thread_count.error()));
+                options.app.scan_params.thread_count = *thread_count;
+            }
+            else if (arg == "--scan-backend")
+            {
+                auto backend = ParseScanBackendOption(value);
+                if (!backend) return tl::make_unexpected(std::move(backend.error()));
+                options.app.scan_params.backend = *backend;
+            }
+            else if (arg == "--node-budget")
+            {
+                auto node_budget = ParseSizeOption(arg, value);
+                if (!node_budget) return tl::make_unexpected(std::move(node_budget.error()));
+                options.app.scan_params.node_budget = *node_budget;
+            }
+            else if (arg == "--scan-depth")
+            {
+                auto max_depth = ParseSizeOption(arg, value);
+                if (!max_depth) return tl::make_unexpected(std::move(max_depth.error()));
+                options.app.scan_params.max_depth = *max_depth;
+            }
+            else if (arg == "--scan-time-budget")
+            {
+                auto time_budget = ParseSizeOption(arg, value);
+                if (!time_budget) return tl::make_unexpected(std::move(time_budget.error()));
+                options.app.scan_params.time_budget = std::chrono::milliseconds{*time_budget};
+            }
+            else if (arg == "--rotational-concurrency")
+            {
+                auto concurrency = ParseSizeOption(arg, value);
+                if (!concurrency) return tl::make_unexpected(std::move(concurrency.error()));
+                options.app.scan_params.rotational_device_concurrency = *concurrency;
+            }
+            else if (arg == "--io-uring-queue-depth")
+            {
+                auto queue_depth = ParseSizeOption(arg, value);
+                if (!queue_depth) return tl::make_unexpected(std::move(queue_depth.error()));
+                options.app.scan_params.io_uring_queue_depth =
+                    static_cast<uint32_t>(std::min(*queue_depth, size_t{std::numeric_limits<uint32_t>::max()}));
+            }
+            else if (arg == "--min-file-fraction")
+            {
+                auto min_file_fraction = ParseFloatOption(arg, value);
+                if (!min_file_fraction) return tl::make_unexpected(std::move(min_file_fraction.error()));
+                if (*min_file_fraction > 1)
+                {
+                    return tl::make_unexpected(fmt::format("Invalid value \"{}\" for {}", value, arg));
+                }
+
+                options.app.scan_params.min_file_fraction = *min_file_fraction;
+            }
+            else if (arg == "--min-pixel-area")
+            {
+                auto min_pixel_area = ParseFloatOption(arg, value);
+                if (!min_pixel_area) return tl::make_unexpected(std::move(min_pixel_area.error()));
+                options.app.min_pixel_area = *min_pixel_area;
+            }
+            else if (arg == "--output")
+            {
+                // "-" is the standard output
+                if (value != "-") options.output_path = fs::absolute(fs::path{value});
+            }
+            else if (arg == "--trace")
+            {
+#ifdef RECT_TREE_VIEWER_TRACING
+                options.trace_path = fs::absolute(fs::path{value});
+#else
+                return tl::make_unexpected("--trace requires a build with RECT_TREE_VIEWER_TRACING");
+#endif
+            }
+            else if (arg == "--load-snapshot")
+            {
+                options.app.load_snapshot_path = fs::absolute(fs::path{value});
+            }
+            else if (arg == "--save-snapshot")
+            {
+                options.app.save_snapshot_path = fs::absolute(fs::path{value});
+            }
+            else if (arg == "--previous-snapshot")
+            {
+                options.app.previous_snapshot_path = fs::absolute(fs::path{value});
+            }
+            else
+            {
+                return tl::make_unexpected(fmt::format("Unknown option {}", arg));
+            }
+
+            continue;
+        }
+
+        fs::path path{arg};
 
         path = fs::absolute(path);
 
@@ -49,25 +239,97 @@ tl::expected<std::vector<fs::path>, std::string> ParseCLI(int argc, char** argv)
             return tl::make_unexpected(fmt::format("Path \"{}\" does not exist", path));
         }
 
+        // Files are disk usage dumps collected elsewhere
+        if (fs::is_regular_file(path))
+        {
+            if (!IsDiskUsageDump(path))
+            {
+                return tl::make_unexpected(
+                    fmt::format("File \"{}\" is neither an ncdu export nor du -ab output", path));
+            }
+
+            options.app.dump_paths.push_back(std::move(path));
+            continue;
+        }
+
         if (!fs::is_directory(path))
         {
             return tl::make_unexpected(fmt::format("Path \"{}\" is not a directory", path));
         }
 
-        paths.push_back(std::move(path));
+        options.app.root_paths.push_back(std::move(path));
+    }
+
+    if (!options.app.dump_paths.empty())
+    {
+        if (!options.app.root_paths.empty())
+        {
+            return tl::make_unexpected("Directories to scan cannot be combined with disk usage dumps");
+        }
+
+        if (options.app.load_snapshot_path || options.app.previous_snapshot_path)
+        {
+            return tl::make_unexpected("Snapshots cannot be combined with disk usage dumps");
+        }
+
+        // Dumps may come from other machines, their paths are not watched
+        if (options.app.watch)
+        {
+            return tl::make_unexpected("--watch cannot be combined with disk usage dumps");
+        }
     }
 
-    return {tl::in_place, paths};
+    if (options.app.load_snapshot_path)
+    {
+        if (!options.app.root_paths.empty())
+        {
+            return tl::make_unexpected("Paths to scan cannot be combined with --load-snapshot");
+        }
+
+        if (options.app.previous_snapshot_path)
+        {
+            return tl::make_unexpected("--previous-snapshot cannot be combined with --load-snapshot");
+        }
+
+        // The loaded tree keeps using the mapped file
+        if (options.app.load_snapshot_path == options.app.save_snapshot_path)
+        {
+            return tl::make_unexpected("Cannot save the snapshot to the file it is loaded from");
+        }
+    }
+
+    // Unexpanded directories have no stamps to compare
+    const ReadDirectoryTreeParams& scan_params = options.app.scan_params;
+    if ((scan_params.max_depth != 0 || scan_params.time_budget.count() != 0) && options.app.previous_snapshot_path)
+    {
+        return tl::make_unexpected("--previous-snapshot cannot be combined with --scan-depth or --scan-time-budget");
+    }
+
+    if (options.output_path && !options.headless)
+    {
+        return tl::make_unexpected("--output requires --headless");
+    }
+
+    for (const auto& snapshot_path : {options.app.load_snapshot_path, options.app.previous_snapshot_path})
+    {
+        if (snapshot_path && !fs::is_regular_file(*snapshot_path))
+        {
+            return tl::make_unexpected(fmt::format("Snapshot \"{}\" does not exist", *snapshot_path));
+        }
+    }
+
+    return options;
 }
 
-tl::expected<std::vector<fs::path>, std::string> TakePathsFromDialogIfNoCLI(std::vector<fs::path> paths)
+tl::expected<CommandLineOptions, std::string> TakePathsFromDialogIfNoCLI(CommandLineOptions options)
 {
-    if (paths.empty())
+    if (!options.headless && options.app.root_paths.empty() && options.app.dump_paths.empty() &&
+        !options.app.load_snapshot_path && !options.app.previous_snapshot_path)
     {
 #ifdef _WIN32
         try
         {
-            paths = OpenFileDialog({.multiselect = true, .pick_folders = true});
+            options.app.root_paths = OpenFileDialog({.multiselect = true, .pick_folders = true});
         }
         catch (const cpptrace::exception_with_message& ex)
         {
@@ -80,20 +342,45 @@ tl::expected<std::vector<fs::path>, std::string> TakePathsFromDialogIfNoCLI(std:
 #endif
     }
 
-    return {tl::in_place, paths};
+    return options;
 }
 
 int Main(int argc, char** argv)
 {
-    if (const auto maybe_paths = ParseCLI(argc, argv).and_then(TakePathsFromDialogIfNoCLI); maybe_paths.has_value())
+    if (const auto maybe_options = ParseCLI(argc, argv).and_then(TakePathsFromDialogIfNoCLI); maybe_options.has_value())
     {
-        RectTreeViewerApp app(maybe_paths.value());
-        app.Run();
+        if (maybe_options->trace_path)
+        {
+            Tracing::Enable();
+            TRACE_THREAD_NAME("Main");
+        }
+
+        if (maybe_options->headless)
+        {
+            const RectTreeViewerAppOptions& app_options = maybe_options->app;
+            RunHeadlessMode({
+                .root_paths = app_options.root_paths,
+                .scan_params = app_options.scan_params,
+                .load_snapshot_path = app_options.load_snapshot_path,
+                .save_snapshot_path = app_options.save_snapshot_path,
+                .previous_snapshot_path = app_options.previous_snapshot_path,
+                .compact_json = app_options.compact_json,
+                .dump_paths = app_options.dump_paths,
+                .output_path = maybe_options->output_path,
+            });
+        }
+        else
+        {
+            RectTreeViewerApp app(maybe_options->app);
+            app.Run();
+        }
+
+        if (maybe_options->trace_path) Tracing::WriteChromeTrace(*maybe_options->trace_path);
         return 0;
     }
     else
     {
-        fmt::println(stderr, "Error: {}", maybe_paths.error());
+        fmt::println(stderr, "Error: {}", maybe_options.error());
         return 1;
     }
 }
@@ -0,0 +1,49 @@
+#include "subtree_expansion.hpp"
+
+#include "klgl/error_handling.hpp"
+#include "tracing.hpp"
+
+SubtreeExpansion::SubtreeExpansion(NodeId node_id, std::filesystem::path path, const ReadDirectoryTreeParams& params)
+    : node_id_(node_id),
+      path_(std::move(path)),
+      params_(params)
+{
+    thread_ = std::jthread([this](std::stop_token stop_token) { Scan(std::move(stop_token)); });
+}
+
+SubtreeExpansion::~SubtreeExpansion() = default;
+
+void SubtreeExpansion::Scan(std::stop_token stop_token)
+{
+    TRACE_THREAD_NAME("Subtree expansion");
+    params_.stop_token = std::move(stop_token);
+    try
+    {
+        result_ = ReadDirectoryTreeMulti(std::nullopt, {&path_, 1}, nullptr, params_);
+    }
+    catch (...)
+    {
+        exception_ = std::current_exception();
+    }
+
+    finished_.store(true, std::memory_order_release);
+}
+
+NodeId SubtreeExpansion::Splice(TreeNodes& nodes, TreeChanges& changes)
+{
+    klgl::ErrorHandling::Ensure(IsFinished(), "The subtree expansion is not finished");
+    if (exception_) std::rethrow_exception(exception_);
+
+    const NodeId parent = nodes.GetParent(node_id_);
+    if (parent == kInvalidNodeId || result_.IsEmpty() || IsUnexpandedDirectory(result_, 0)) return kInvalidNodeId;
+
+    // The estimated value of the node is replaced by the actual one
+    const uint64_t estimated_value = nodes.GetValue(node_id_);
+    const NodeId subtree = nodes.AppendTree(result_);
+    nodes.Unlink(node_id_);
+    nodes.LinkChild(parent, subtree);
+    nodes.AddValueDelta(parent, static_cast<int64_t>(nodes.GetValue(subtree) - estimated_value));
+    changes.unlinked_nodes.push_back(node_id_);
+    changes.MarkDirty(nodes, parent);
+    return subtree;
+}
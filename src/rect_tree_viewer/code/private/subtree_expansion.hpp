@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <filesystem>
+#include <thread>
+
+#include "read_directory_tree.hpp"
+#include "tree.hpp"
+#include "tree_changes.hpp"
+
+// Lists an unexpanded directory (see IsUnexpandedDirectory) with ReadDirectoryTreeMulti on its own thread. The
+// result replaces the node in the tree, other nodes keep their ids, so only the new subtree and the ancestors of the
+// node have to be laid out again.
+class SubtreeExpansion
+{
+public:
+    SubtreeExpansion(NodeId node_id, std::filesystem::path path, const ReadDirectoryTreeParams& params);
+    SubtreeExpansion(const SubtreeExpansion&) = delete;
+    SubtreeExpansion& operator=(const SubtreeExpansion&) = delete;
+
+    // Cancels the scan and waits for it
+    ~SubtreeExpansion();
+
+    [[nodiscard]] NodeId GetNodeId() const { return node_id_; }
+    [[nodiscard]] const std::filesystem::path& GetPath() const { return path_; }
+    [[nodiscard]] bool IsFinished() const { return finished_.load(std::memory_order_acquire); }
+
+    // Only after the scan is finished. Appends the scanned subtree and links it in place of the node, which is
+    // unlinked. Returns the root of the subtree, or kInvalidNodeId and leaves the tree as is when the directory could
+    // not be listed. Rethrows the exception of the scan thread
+    NodeId Splice(TreeNodes& nodes, TreeChanges& changes);
+
+private:
+    void Scan(std::stop_token stop_token);
+
+    NodeId node_id_ = kInvalidNodeId;
+    std::filesystem::path path_;
+    ReadDirectoryTreeParams params_;
+    TreeNodes result_;
+    std::exception_ptr exception_;
+    std::atomic<bool> finished_ = false;
+
+    // Last member: the thread has to be stopped and joined before the rest is destroyed
+    std::jthread thread_;
+};
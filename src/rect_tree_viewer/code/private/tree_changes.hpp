@@ -0,0 +1,41 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "tree.hpp"
+
+// Edits of a tree made since the last layout update
+struct TreeChanges
+{
+    [[nodiscard]] bool IsEmpty() const { return dirty_nodes.empty(); }
+
+    // Marks the node and all its ancestors
+    void MarkDirty(const TreeNodes& nodes, NodeId node_id)
+    {
+        for (; node_id != kInvalidNodeId; node_id = nodes.GetParent(node_id))
+        {
+            dirty_nodes.push_back(node_id);
+        }
+    }
+
+    // Sorts dirty nodes and removes duplicates
+    void Finalize()
+    {
+        std::ranges::sort(dirty_nodes);
+        const auto [unique_end, end] = std::ranges::unique(dirty_nodes);
+        dirty_nodes.erase(unique_end, end);
+    }
+
+    // Sorted after Finalize. Nodes whose children were added, removed or changed their values, with all their
+    // ancestors
+    std::vector<NodeId> dirty_nodes;
+
+    // Roots of subtrees that were unlinked from the tree
+    std::vector<NodeId> unlinked_nodes;
+
+    size_t events_count = 0;
+
+    // The kernel queue overflowed. All watched directories were compared with the disk to catch up
+    bool events_lost = false;
+};
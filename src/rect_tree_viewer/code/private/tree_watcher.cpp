@@ -0,0 +1,553 @@
+#include "tree_watcher.hpp"
+
+#include "klgl/error_handling.hpp"
+
+#ifdef __linux__
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <exception>
+#include <map>
+#include <ranges>
+#include <span>
+#include <thread>
+#include <utility>
+
+#include "linux_directory_lister.hpp"
+#include "path_helpers.hpp"
+#include "read_directory_tree.hpp"
+#include "tracing.hpp"
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+constexpr uint32_t kWatchMask =
+    IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+enum class EntryKind : uint8_t
+{
+    Missing,
+    File,
+    Directory,
+    Other,
+};
+
+struct EntryState
+{
+    EntryKind kind = EntryKind::Missing;
+    uint64_t size = 0;
+    DirectoryStamp stamp;
+};
+
+EntryState StatEntry(const fs::path& path)
+{
+    struct statx entry_stat{};
+    constexpr int stat_flags = AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT;
+    constexpr unsigned stat_mask = STATX_TYPE | STATX_SIZE | LinuxDirectoryLister::kStampMask;
+    if (statx(AT_FDCWD, path.c_str(), stat_flags, stat_mask, &entry_stat) != 0) return {};
+
+    if (S_ISREG(entry_stat.stx_mode)) return {.kind = EntryKind::File, .size = entry_stat.stx_size, .stamp = {}};
+    if (S_ISDIR(entry_stat.stx_mode))
+    {
+        return {.kind = EntryKind::Directory, .size = 0, .stamp = LinuxDirectoryLister::MakeStamp(entry_stat)};
+    }
+
+    return {.kind = EntryKind::Other, .size = 0, .stamp = {}};
+}
+
+bool IsDirectory(const TreeNodes& nodes, NodeId node_id)
+{
+    return nodes.FindDirectoryStamp(node_id) != nullptr;
+}
+
+// A directory deleted and created again under the same name gets a new inode, its old subtree and watch are stale.
+// Directories that were not listed have no stamp to compare with
+bool IsSameDirectory(const DirectoryStamp& stored, const DirectoryStamp& current)
+{
+    return !stored.IsValid() || (stored.device == current.device && stored.inode == current.inode);
+}
+
+// Visits the node and all its descendants that are directories
+template <typename Callback>
+void ForEachDirectory(const TreeNodes& nodes, NodeId subtree_root, Callback&& callback)
+{
+    std::vector<NodeId> stack{subtree_root};
+    while (!stack.empty())
+    {
+        const NodeId node_id = stack.back();
+        stack.pop_back();
+        callback(node_id);
+
+        for (NodeId child = nodes.GetFirstChild(node_id); child != kInvalidNodeId; child = nodes.GetNextSibling(child))
+        {
+            if (IsDirectory(nodes, child)) stack.push_back(child);
+        }
+    }
+}
+
+}  // namespace
+
+// Lists new directories one after another on its own thread, like SubtreeExpansion does for one directory
+class TreeWatcher::DirectoryScan
+{
+public:
+    explicit DirectoryScan(std::vector<NewDirectory> directories)
+        : directories_(std::move(directories))
+    {
+        thread_ = std::jthread([this](std::stop_token stop_token) { Scan(std::move(stop_token)); });
+    }
+
+    [[nodiscard]] std::span<const NewDirectory> GetDirectories() const { return directories_; }
+    [[nodiscard]] bool IsFinished() const { return finished_.load(std::memory_order_acquire); }
+
+    // Only after the scan is finished. One tree per directory, empty ones could not be listed. Rethrows the exception
+    // of the scan thread
+    [[nodiscard]] std::span<TreeNodes> GetSubtrees()
+    {
+        klgl::ErrorHandling::Ensure(IsFinished(), "The directory scan is not finished");
+        if (exception_) std::rethrow_exception(exception_);
+        return subtrees_;
+    }
+
+private:
+    void Scan(std::stop_token stop_token)
+    {
+        TRACE_THREAD_NAME("Watcher scan");
+        ReadDirectoryTreeParams params;
+        params.thread_count = 1;
+        params.stop_token = std::move(stop_token);
+        try
+        {
+            subtrees_.reserve(directories_.size());
+            for (const NewDirectory& directory : directories_)
+            {
+                subtrees_.push_back(ReadDirectoryTreeMulti(std::nullopt, {&directory.path, 1}, nullptr, params));
+            }
+        }
+        catch (...)
+        {
+            exception_ = std::current_exception();
+        }
+
+        finished_.store(true, std::memory_order_release);
+    }
+
+    std::vector<NewDirectory> directories_;
+    std::vector<TreeNodes> subtrees_;
+    std::exception_ptr exception_;
+    std::atomic<bool> finished_ = false;
+
+    // Last member: the thread has to be stopped and joined before the rest is destroyed
+    std::jthread thread_;
+};
+
+TreeWatcher::TreeWatcher(
+    const TreeNodes& nodes,
+    std::vector<fs::path> root_paths,
+    std::unordered_map<NodeId, size_t> root_node_id_to_path_index)
+    : root_paths_(std::move(root_paths)),
+      root_node_id_to_path_index_(std::move(root_node_id_to_path_index))
+{
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    klgl::ErrorHandling::Ensure(inotify_fd_ >= 0, "Failed to initialize inotify");
+
+    if (!nodes.IsEmpty()) WatchSubtree(nodes, 0, false);
+}
+
+TreeWatcher::~TreeWatcher()
+{
+    close(inotify_fd_);
+}
+
+TreeChanges TreeWatcher::Poll(TreeNodes& nodes)
+{
+    TreeChanges changes;
+    SpliceScannedDirectories(nodes, changes);
+
+    std::vector<Move> moves;
+    ReadEvents(changes, moves);
+
+    // The kernel queue overflowed, any directory could have changed
+    if (changes.events_lost)
+    {
+        for (const NodeId node_id : node_to_watch_ | std::views::keys) dirty_directories_[node_id].relist = true;
+    }
+
+    if (!dirty_directories_.empty()) SyncDirectories(nodes, moves, changes);
+    if (!directory_scan_ && !queued_directories_.empty())
+    {
+        directory_scan_ = std::make_unique<DirectoryScan>(std::exchange(queued_directories_, {}));
+    }
+
+    changes.Finalize();
+    return changes;
+}
+
+void TreeWatcher::OnSubtreeReplaced(const TreeNodes& nodes, NodeId old_node, NodeId subtree_root)
+{
+    UnwatchSubtree(nodes, old_node);
+
+    const NodeId parent = nodes.GetParent(subtree_root);
+    if (const auto index = child_indices_.find(parent); index != child_indices_.end())
+    {
+        index->second[std::string{nodes.GetName(subtree_root)}] = subtree_root;
+    }
+
+    WatchSubtree(nodes, subtree_root, true);
+}
+
+void TreeWatcher::WatchSubtree(const TreeNodes& nodes, NodeId subtree_root, bool recheck)
+{
+    ForEachDirectory(
+        nodes,
+        subtree_root,
+        [&](NodeId node_id)
+        {
+            const DirectoryStamp* stamp = nodes.FindDirectoryStamp(node_id);
+            if (!stamp || !stamp->IsValid()) return;
+
+            const std::optional<fs::path> path = GetNodePath(nodes, node_id);
+            if (!path) return;
+
+            const int watch = inotify_add_watch(inotify_fd_, path->c_str(), kWatchMask);
+            if (watch < 0)
+            {
+                ++failed_watches_count_;
+                return;
+            }
+
+            watch_to_node_[watch] = node_id;
+            node_to_watch_[node_id] = watch;
+
+            if (recheck && StatEntry(*path).stamp != *stamp) dirty_directories_[node_id].relist = true;
+        });
+}
+
+void TreeWatcher::UnwatchSubtree(const TreeNodes& nodes, NodeId subtree_root)
+{
+    ForEachDirectory(
+        nodes,
+        subtree_root,
+        [&](NodeId node_id)
+        {
+            child_indices_.erase(node_id);
+
+            const auto it = node_to_watch_.find(node_id);
+            if (it == node_to_watch_.end()) return;
+
+            // Fails if the directory is already deleted, the kernel has removed the watch then
+            inotify_rm_watch(inotify_fd_, it->second);
+            watch_to_node_.erase(it->second);
+            node_to_watch_.erase(it);
+        });
+}
+
+void TreeWatcher::ReadEvents(TreeChanges& changes, std::vector<Move>& moves)
+{
+    // Index in moves by cookie
+    std::unordered_map<uint32_t, size_t> pending_moves;
+
+    alignas(inotify_event) std::array<char, 64 * 1024> buffer;  // NOLINT
+    while (true)
+    {
+        const ssize_t bytes_read = read(inotify_fd_, buffer.data(), buffer.size());
+        if (bytes_read <= 0) break;
+
+        for (ssize_t offset = 0; offset < bytes_read;)
+        {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer.data() + offset);  // NOLINT
+            offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+            ++changes.events_count;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                changes.events_lost = true;
+                continue;
+            }
+
+            // Skip events about watched directories themselves and watches removed by UnwatchSubtree
+            const auto it = watch_to_node_.find(event->wd);
+            if (event->len == 0 || it == watch_to_node_.end()) continue;
+
+            const NodeId directory = it->second;
+            const std::string_view name = event->name;  // NOLINT
+            dirty_directories_[directory].names.emplace_back(name);
+
+            if (event->mask & IN_MOVED_FROM)
+            {
+                pending_moves[event->cookie] = moves.size();
+                moves.push_back({
+                    .from_directory = directory,
+                    .from_name = std::string{name},
+                    .to_directory = kInvalidNodeId,
+                    .to_name = {},
+                });
+            }
+            else if (event->mask & IN_MOVED_TO)
+            {
+                if (const auto move = pending_moves.find(event->cookie); move != pending_moves.end())
+                {
+                    moves[move->second].to_directory = directory;
+                    moves[move->second].to_name = name;
+                }
+            }
+        }
+    }
+
+    // Entries moved out of the watched tree are handled as deleted
+    std::erase_if(moves, [](const Move& move) { return move.to_directory == kInvalidNodeId; });
+}
+
+void TreeWatcher::SyncDirectories(TreeNodes& nodes, const std::vector<Move>& moves, TreeChanges& changes)
+{
+    using EntryKey = std::pair<NodeId, std::string_view>;
+
+    std::map<EntryKey, EntryKey> move_sources;
+    std::map<EntryKey, NodeId> moved_nodes;
+    for (const Move& move : moves)
+    {
+        move_sources[{move.from_directory, move.from_name}] = {move.to_directory, move.to_name};
+        moved_nodes[{move.to_directory, move.to_name}] = kInvalidNodeId;
+    }
+
+    struct Addition
+    {
+        NodeId directory = kInvalidNodeId;
+        std::string name;
+        fs::path path;
+        EntryState state;
+    };
+
+    // First unlink everything that was deleted, replaced or moved away, then add new entries. This way a moved node
+    // is detached before its destination looks for it.
+    const auto dirty_directories = std::exchange(dirty_directories_, {});
+    std::vector<Addition> additions;
+    for (auto& [directory, dirty_directory] : dirty_directories)
+    {
+        const std::optional<fs::path> directory_path = GetNodePath(nodes, directory);
+        if (!directory_path) continue;
+
+        const ChildIndex& children = GetChildIndex(nodes, directory);
+        std::vector<std::string> names = dirty_directory.names;
+        if (dirty_directory.relist)
+        {
+            for (const auto& [name, child] : children) names.emplace_back(name);
+
+            std::error_code err;
+            fs::directory_iterator it(*directory_path, err);
+            for (; !err && it != fs::directory_iterator{}; it.increment(err))
+            {
+                names.push_back(PathHelpers::PathToUTF8(it->path().filename()));
+            }
+        }
+
+        std::ranges::sort(names);
+        const auto [unique_end, end] = std::ranges::unique(names);
+        names.erase(unique_end, end);
+
+        for (std::string& name : names)
+        {
+            fs::path path = *directory_path / PathHelpers::PathFromUTF8(name);
+            const EntryState state = StatEntry(path);
+            const bool is_move_destination = moved_nodes.contains({directory, name});
+
+            if (const auto child = children.find(name); child != children.end())
+            {
+                // Aggregates stand for folded files and have no entry of their own on disk
+                const NodeId child_id = child->second;
+                if (nodes.GetAggregatedFilesCount(child_id) != 0) continue;
+
+                const DirectoryStamp* stamp = nodes.FindDirectoryStamp(child_id);
+                const bool is_same_kind =
+                    stamp ? state.kind == EntryKind::Directory && IsSameDirectory(*stamp, state.stamp)
+                          : state.kind == EntryKind::File;
+                if (is_same_kind && !is_move_destination)
+                {
+                    if (const uint64_t old_size = nodes.GetValue(child_id);
+                        state.kind == EntryKind::File && state.size != old_size)
+                    {
+                        nodes.AddValueDelta(child_id, static_cast<int64_t>(state.size - old_size));
+                        changes.MarkDirty(nodes, directory);
+                    }
+
+                    continue;
+                }
+
+                const auto move_source = move_sources.find({directory, name});
+                const bool is_moved = move_source != move_sources.end() && state.kind == EntryKind::Missing;
+                if (is_moved) moved_nodes[move_source->second] = child_id;
+                Unlink(nodes, child_id, !is_moved, changes);
+            }
+
+            if (state.kind == EntryKind::File || state.kind == EntryKind::Directory)
+            {
+                additions.push_back({.directory = directory, .name = std::move(name), .path = path, .state = state});
+            }
+        }
+    }
+
+    for (const Addition& addition : additions)
+    {
+        NodeId node_id = kInvalidNodeId;
+        const auto moved_node = moved_nodes.find({addition.directory, addition.name});
+        if (moved_node != moved_nodes.end() && moved_node->second != kInvalidNodeId)
+        {
+            node_id = std::exchange(moved_node->second, kInvalidNodeId);
+            if (nodes.GetName(node_id) != addition.name) nodes.Rename(node_id, addition.name);
+            if (addition.state.kind == EntryKind::File) nodes.SetValue(node_id, addition.state.size);
+        }
+        else if (addition.state.kind == EntryKind::File)
+        {
+            node_id = nodes.Add(addition.name, addition.state.size);
+        }
+        else
+        {
+            // Usually an empty directory that was just created. Big ones come here when moved in from outside, so they
+            // are not scanned on this thread. The stamp keeps the node a directory until the scan replaces it
+            node_id = nodes.Add(addition.name, 0);
+            nodes.AddDirectoryStamp(node_id, addition.state.stamp);
+            queued_directories_.push_back({.node_id = node_id, .path = addition.path});
+        }
+
+        nodes.LinkChild(addition.directory, node_id);
+        child_indices_[addition.directory][addition.name] = node_id;
+        nodes.AddValueDelta(addition.directory, static_cast<int64_t>(nodes.GetValue(node_id)));
+        changes.MarkDirty(nodes, addition.directory);
+    }
+
+    // Moved nodes whose destination was not found on disk
+    for (const NodeId node_id : moved_nodes | std::views::values)
+    {
+        if (node_id == kInvalidNodeId) continue;
+        UnwatchSubtree(nodes, node_id);
+        changes.unlinked_nodes.push_back(node_id);
+    }
+}
+
+void TreeWatcher::Unlink(TreeNodes& nodes, NodeId node_id, bool unwatch, TreeChanges& changes)
+{
+    const NodeId parent = nodes.GetParent(node_id);
+    if (const auto index = child_indices_.find(parent); index != child_indices_.end())
+    {
+        index->second.erase(std::string{nodes.GetName(node_id)});
+    }
+
+    nodes.AddValueDelta(parent, -static_cast<int64_t>(nodes.GetValue(node_id)));
+    nodes.Unlink(node_id);
+    changes.MarkDirty(nodes, parent);
+
+    if (unwatch)
+    {
+        UnwatchSubtree(nodes, node_id);
+        changes.unlinked_nodes.push_back(node_id);
+    }
+}
+
+void TreeWatcher::SpliceScannedDirectories(TreeNodes& nodes, TreeChanges& changes)
+{
+    if (!directory_scan_ || !directory_scan_->IsFinished()) return;
+
+    const std::unique_ptr<DirectoryScan> scan = std::move(directory_scan_);
+    const std::span<TreeNodes> subtrees = scan->GetSubtrees();
+    const std::span<const NewDirectory> directories = scan->GetDirectories();
+    for (size_t i = 0; i != subtrees.size(); ++i)
+    {
+        const NewDirectory& directory = directories[i];
+        const TreeNodes& subtree = subtrees[i];
+
+        // Deleted or replaced since then, or could not be listed. Moved ones are scanned again at the new path
+        const std::optional<fs::path> path = GetNodePath(nodes, directory.node_id);
+        if (!path || subtree.IsEmpty() || IsUnexpandedDirectory(subtree, 0)) continue;
+        if (*path != directory.path)
+        {
+            queued_directories_.push_back({.node_id = directory.node_id, .path = *path});
+            continue;
+        }
+
+        const NodeId parent = nodes.GetParent(directory.node_id);
+        const std::string name{nodes.GetName(directory.node_id)};
+        Unlink(nodes, directory.node_id, true, changes);
+
+        const NodeId node_id = nodes.AppendTree(subtree);
+        if (nodes.GetName(node_id) != name) nodes.Rename(node_id, name);
+        nodes.LinkChild(parent, node_id);
+        if (const auto index = child_indices_.find(parent); index != child_indices_.end())
+        {
+            index->second[name] = node_id;
+        }
+
+        nodes.AddValueDelta(parent, static_cast<int64_t>(nodes.GetValue(node_id)));
+        changes.MarkDirty(nodes, parent);
+
+        // Watch paths are built from links, so new directories are watched only after they are linked
+        WatchSubtree(nodes, node_id, true);
+    }
+}
+
+TreeWatcher::ChildIndex& TreeWatcher::GetChildIndex(const TreeNodes& nodes, NodeId directory)
+{
+    const auto [it, inserted] = child_indices_.try_emplace(directory);
+    if (inserted)
+    {
+        std::vector<NodeId> children;
+        TreeHelper::GetChildren(nodes, directory, children);
+        for (const NodeId child : children) it->second.emplace(nodes.GetName(child), child);
+    }
+
+    return it->second;
+}
+
+std::optional<fs::path> TreeWatcher::GetNodePath(const TreeNodes& nodes, NodeId node_id) const
+{
+    std::vector<NodeId> chain;
+    while (!root_node_id_to_path_index_.contains(node_id))
+    {
+        if (node_id == kInvalidNodeId) return std::nullopt;
+        chain.push_back(node_id);
+        node_id = nodes.GetParent(node_id);
+    }
+
+    fs::path path = root_paths_[root_node_id_to_path_index_.at(node_id)];
+    for (const NodeId id : chain | std::views::reverse)
+    {
+        path /= PathHelpers::PathFromUTF8(nodes.GetName(id));
+    }
+
+    return path;
+}
+
+#else
+
+class TreeWatcher::DirectoryScan
+{
+};
+
+TreeWatcher::TreeWatcher(
+    [[maybe_unused]] const TreeNodes& nodes,
+    [[maybe_unused]] std::vector<std::filesystem::path> root_paths,
+    [[maybe_unused]] std::unordered_map<NodeId, size_t> root_node_id_to_path_index)
+{
+    throw klgl::ErrorHandling::RuntimeErrorWithMessage("File system watching is only implemented on Linux");
+}
+
+TreeWatcher::~TreeWatcher() = default;
+
+TreeChanges TreeWatcher::Poll([[maybe_unused]] TreeNodes& nodes)
+{
+    return {};
+}
+
+void TreeWatcher::OnSubtreeReplaced(
+    [[maybe_unused]] const TreeNodes& nodes,
+    [[maybe_unused]] NodeId old_node,
+    [[maybe_unused]] NodeId subtree_root)
+{
+}
+
+#endif
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tree.hpp"
+#include "tree_changes.hpp"
+
+// Watches every directory of a scanned tree with inotify and patches the tree in place. Poll is meant to be called
+// once per frame: it drains all pending events, coalesces them by directory entry and stats every changed entry once.
+// Moves inside the watched tree relink existing nodes. New directories are linked empty and scanned with
+// ReadDirectoryTree on a background thread, a later poll splices the result in. Only implemented on Linux.
+class TreeWatcher
+{
+public:
+    TreeWatcher(
+        const TreeNodes& nodes,
+        std::vector<std::filesystem::path> root_paths,
+        std::unordered_map<NodeId, size_t> root_node_id_to_path_index);
+    TreeWatcher(const TreeWatcher&) = delete;
+    TreeWatcher& operator=(const TreeWatcher&) = delete;
+    ~TreeWatcher();
+
+    [[nodiscard]] TreeChanges Poll(TreeNodes& nodes);
+
+    // Called after someone else linked subtree_root in place of old_node, like SubtreeExpansion does with unexpanded
+    // directories. Watches directories of the new subtree and relists those that changed since they were scanned
+    void OnSubtreeReplaced(const TreeNodes& nodes, NodeId old_node, NodeId subtree_root);
+
+    [[nodiscard]] size_t GetWatchesCount() const { return watch_to_node_.size(); }
+
+    // Directories that could not be watched, usually because of the fs.inotify.max_user_watches limit
+    [[nodiscard]] size_t GetFailedWatchesCount() const { return failed_watches_count_; }
+
+private:
+    // Entries of one directory that changed since the last poll
+    struct DirtyDirectory
+    {
+        std::vector<std::string> names;
+
+        // Compare all entries with the disk
+        bool relist = false;
+    };
+
+    // Entry renamed inside the watched tree: a pair of IN_MOVED_FROM and IN_MOVED_TO events with the same cookie
+    struct Move
+    {
+        NodeId from_directory = kInvalidNodeId;
+        std::string from_name;
+        NodeId to_directory = kInvalidNodeId;
+        std::string to_name;
+    };
+
+    // Directory that appeared in the tree. Its node stays empty until the directory is scanned
+    struct NewDirectory
+    {
+        NodeId node_id = kInvalidNodeId;
+        std::filesystem::path path;
+    };
+
+    class DirectoryScan;
+
+    using ChildIndex = std::unordered_map<std::string, NodeId>;
+
+    // Watches directories of the subtree. With recheck, directories that changed since they were scanned are relisted
+    // on the next poll: their entries could be created before the watch was added.
+    void WatchSubtree(const TreeNodes& nodes, NodeId subtree_root, bool recheck);
+    void UnwatchSubtree(const TreeNodes& nodes, NodeId subtree_root);
+    void ReadEvents(TreeChanges& changes, std::vector<Move>& moves);
+    void SyncDirectories(TreeNodes& nodes, const std::vector<Move>& moves, TreeChanges& changes);
+    void Unlink(TreeNodes& nodes, NodeId node_id, bool unwatch, TreeChanges& changes);
+
+    // Replaces nodes of new directories with their subtrees once the background scan is finished
+    void SpliceScannedDirectories(TreeNodes& nodes, TreeChanges& changes);
+
+    // Children of the directory by name. Built on the first event in the directory, then kept up to date by edits
+    [[nodiscard]] ChildIndex& GetChildIndex(const TreeNodes& nodes, NodeId directory);
+
+    // Nullopt for nodes that are no longer linked to a root
+    [[nodiscard]] std::optional<std::filesystem::path> GetNodePath(const TreeNodes& nodes, NodeId node_id) const;
+
+    std::vector<std::filesystem::path> root_paths_;
+    std::unordered_map<NodeId, size_t> root_node_id_to_path_index_;
+
+    int inotify_fd_ = -1;
+    std::unordered_map<int, NodeId> watch_to_node_;
+    std::unordered_map<NodeId, int> node_to_watch_;
+    size_t failed_watches_count_ = 0;
+
+    std::unordered_map<NodeId, DirtyDirectory> dirty_directories_;
+    std::unordered_map<NodeId, ChildIndex> child_indices_;
+
+    // One scan at a time lists a batch of new directories, those found meanwhile wait for the next one
+    std::vector<NewDirectory> queued_directories_;
+    std::unique_ptr<DirectoryScan> directory_scan_;
+};
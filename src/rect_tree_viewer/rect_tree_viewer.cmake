@@ -0,0 +1,2 @@
+# Debug builds count allocations, see allocation_counter.hpp
+target_link_libraries(rect_tree_viewer PRIVATE $<$<CONFIG:Debug>:rect_tree_viewer_allocation_counter>)
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include "synthetic_tree.hpp"
+
+// Starts the peak RSS over from the current RSS, so that it covers only what runs after this call. Linux only,
+// elsewhere the peak is not reported
+inline void ResetPeakRss()
+{
+#if defined(__linux__)
+    if (std::FILE* file = std::fopen("/proc/self/clear_refs", "w"))
+    {
+        std::fputs("5", file);
+        std::fclose(file);
+    }
+#endif
+}
+
+// Peak resident set size since the last ResetPeakRss, in bytes
+[[nodiscard]] inline std::optional<size_t> GetPeakRss()
+{
+#if defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.starts_with("VmHWM:")) return std::stoull(line.substr(6)) * 1024;
+    }
+#endif
+    return std::nullopt;
+}
+
+// Benchmarks call ResetPeakRss after their setup, so the peak includes the input but not what earlier benchmarks
+// allocated
+inline void ReportPeakRss(benchmark::State& state)
+{
+    if (const auto peak_rss = GetPeakRss())
+    {
+        state.counters["peak_rss_mb"] = static_cast<double>(*peak_rss) / (1024.0 * 1024.0);
+    }
+}
+
+// Default synthetic tree of the given size. The last one is kept, so that benchmarks of one size do not generate
+// it again for every run
+[[nodiscard]] inline const TreeNodes& GetSyntheticTree(size_t nodes_count)
+{
+    static std::unique_ptr<TreeNodes> cached_tree;
+    if (!cached_tree || cached_tree->Size() != nodes_count)
+    {
+        SyntheticTreeParams params;
+        params.nodes_count = nodes_count;
+        cached_tree.reset();
+        cached_tree = std::make_unique<TreeNodes>(MakeSyntheticTree(params));
+    }
+
+    return *cached_tree;
+}
+
+// Sizes every tree benchmark runs at
+inline void AddTreeSizes(benchmark::internal::Benchmark* benchmark)
+{
+    benchmark->Arg(10'000)->Arg(1'000'000)->Arg(50'000'000);
+}
@@ -0,0 +1,124 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "rect_draw_list.hpp"
+#include "rect_tree_draw_data.hpp"
+#include "tree.hpp"
+#include "tree_child_index.hpp"
+
+namespace
+{
+
+using namespace rect_tree_viewer;  // NOLINT
+
+// Directories of files_per_directory files under one root, ids of siblings are consecutive like after a scan
+TreeNodes MakeDirectoriesTree(size_t directories_count, size_t files_per_directory)
+{
+    TreeNodes nodes;
+    const NodeId root = nodes.Add("root", 0);
+    std::mt19937_64 random(directories_count);
+    std::uniform_int_distribution<uint64_t> distribution(1, 1'000'000);
+    std::vector<NodeId> directories;
+    for (size_t i = 0; i != directories_count; ++i)
+    {
+        directories.push_back(nodes.Add("d", 0));
+        nodes.LinkChild(root, directories.back());
+    }
+
+    for (const NodeId directory : directories)
+    {
+        for (size_t i = 0; i != files_per_directory; ++i)
+        {
+            const uint64_t value = distribution(random);
+            nodes.LinkChild(directory, nodes.Add("f", value));
+            nodes.AddValueDelta(directory, static_cast<int64_t>(value));
+        }
+    }
+
+    return nodes;
+}
+
+// Draws the whole tree and reports how many batches and draw calls it takes
+void BM_DrawListDraw(benchmark::State& state)
+{
+    const TreeNodes nodes = MakeDirectoriesTree(static_cast<size_t>(state.range(0)), 1'000);
+    TreeChildIndex child_index;
+    child_index.Build(nodes);
+    const std::vector<Rect2d> rects = RectTreeDrawData::Create(nodes, child_index);
+    const std::vector<edt::Vec4u8> colors(nodes.Size(), edt::Vec4u8{255, 255, 255, 255});
+    std::vector<NodeId> all_nodes(nodes.Ids().begin(), nodes.Ids().end());
+
+    RectDrawList draw_list;
+    draw_list.Rebuild(rects, colors);
+    CountingRectDrawBackend backend;
+    for ([[maybe_unused]] auto _ : state)
+    {
+        draw_list.Upload(backend);
+        draw_list.Draw(backend, all_nodes);
+    }
+
+    const auto iterations = static_cast<double>(state.iterations());
+    state.counters["batches"] = static_cast<double>(backend.batches_count) / iterations;
+    state.counters["instances"] = static_cast<double>(backend.drawn_instances_count) / iterations;
+    state.counters["uploaded"] = static_cast<double>(backend.uploaded_instances_count);
+}
+
+// Changes values of a few files per frame and reports how many instances get uploaded
+void BM_DrawListUpdate(benchmark::State& state)
+{
+    TreeNodes nodes = MakeDirectoriesTree(static_cast<size_t>(state.range(0)), 1'000);
+    TreeChildIndex child_index;
+    child_index.Build(nodes);
+    std::vector<Rect2d> rects = RectTreeDrawData::Create(nodes, child_index);
+    const std::vector<edt::Vec4u8> colors(nodes.Size(), edt::Vec4u8{255, 255, 255, 255});
+
+    RectDrawList draw_list;
+    draw_list.Rebuild(rects, colors);
+    CountingRectDrawBackend backend;
+    draw_list.Upload(backend);
+    backend = {};
+
+    std::mt19937_64 random(0);
+    std::uniform_int_distribution<NodeId> node_distribution(0, static_cast<NodeId>(nodes.Size() - 1));
+    std::vector<NodeId> dirty_nodes;
+    std::vector<NodeId> moved_nodes;
+    for ([[maybe_unused]] auto _ : state)
+    {
+        dirty_nodes.clear();
+        for (int i = 0; i != 4; ++i)
+        {
+            const NodeId node_id = node_distribution(random);
+            nodes.AddValueDelta(node_id, 1000);
+            for (NodeId id = node_id; id != kInvalidNodeId; id = nodes.GetParent(id)) dirty_nodes.push_back(id);
+        }
+
+        std::ranges::sort(dirty_nodes);
+        const auto [unique_end, end] = std::ranges::unique(dirty_nodes);
+        dirty_nodes.erase(unique_end, end);
+
+        moved_nodes.clear();
+        child_index.Update(nodes, dirty_nodes);
+        RectTreeDrawData::Update(
+            nodes,
+            child_index,
+            dirty_nodes,
+            rects,
+            RectTreeDrawData::kDefaultPaddingFactor,
+            nullptr,
+            &moved_nodes);
+        draw_list.Update(rects, colors, moved_nodes);
+        draw_list.Upload(backend);
+    }
+
+    const auto iterations = static_cast<double>(state.iterations());
+    state.counters["uploads"] = static_cast<double>(backend.upload_calls_count) / iterations;
+    state.counters["uploaded"] = static_cast<double>(backend.uploaded_instances_count) / iterations;
+}
+
+}  // namespace
+
+BENCHMARK(BM_DrawListDraw)->Arg(10)->Arg(1'000)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_DrawListUpdate)->Arg(10)->Arg(1'000)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,64 @@
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bench_helpers.hpp"
+#include "tree.hpp"
+#include "tree_json.hpp"
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+[[nodiscard]] fs::path GetJsonPath(size_t nodes_count)
+{
+    return fs::temp_directory_path() / ("rect_tree_viewer_bench_" + std::to_string(nodes_count) + ".json");
+}
+
+// Arguments: nodes count and whether the output is compact
+void BM_WriteTreeJson(benchmark::State& state)
+{
+    const TreeNodes& nodes = GetSyntheticTree(static_cast<size_t>(state.range(0)));
+    const std::vector<fs::path> root_paths{"/synthetic/root"};
+    const std::unordered_map<NodeId, size_t> root_node_id_to_path_index{{0, 0}};
+    const fs::path path = GetJsonPath(nodes.Size());
+    ResetPeakRss();
+    for ([[maybe_unused]] auto _ : state)
+    {
+        WriteTreeJson(path, nodes, root_paths, root_node_id_to_path_index, state.range(1) != 0);
+    }
+
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(nodes.Size()));
+    state.counters["file_mb"] = static_cast<double>(fs::file_size(path)) / (1024.0 * 1024.0);
+    fs::remove(path);
+    ReportPeakRss(state);
+}
+
+void BM_ReadTreeJson(benchmark::State& state)
+{
+    const TreeNodes& nodes = GetSyntheticTree(static_cast<size_t>(state.range(0)));
+    const std::vector<fs::path> root_paths{"/synthetic/root"};
+    const std::unordered_map<NodeId, size_t> root_node_id_to_path_index{{0, 0}};
+    const fs::path path = GetJsonPath(nodes.Size());
+    WriteTreeJson(path, nodes, root_paths, root_node_id_to_path_index, true);
+    ResetPeakRss();
+    for ([[maybe_unused]] auto _ : state)
+    {
+        benchmark::DoNotOptimize(ReadTreeJson(path));
+    }
+
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(nodes.Size()));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(fs::file_size(path)));
+    fs::remove(path);
+    ReportPeakRss(state);
+}
+
+}  // namespace
+
+// A 50M node file takes several gigabytes, JSON is measured up to 1M
+BENCHMARK(BM_WriteTreeJson)->ArgsProduct({{10'000, 1'000'000}, {0, 1}})->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ReadTreeJson)->Arg(10'000)->Arg(1'000'000)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,41 @@
+#include <benchmark/benchmark.h>
+
+#include "bench_helpers.hpp"
+#include "rect_tree_draw_data.hpp"
+#include "tree.hpp"
+#include "tree_child_index.hpp"
+
+namespace
+{
+
+// Root directory with fan_out files. Sizes follow a power law, like caches and mail spools: a few big files and a
+// long tail of small ones with many equal sizes
+TreeNodes MakeFanOutTree(size_t fan_out)
+{
+    SyntheticTreeParams params;
+    params.nodes_count = fan_out + 1;
+    params.max_depth = 0;
+    params.fan_out = fan_out;
+    params.seed = fan_out;
+    return MakeSyntheticTree(params);
+}
+
+void BM_LayoutFanOut(benchmark::State& state)
+{
+    const auto fan_out = static_cast<size_t>(state.range(0));
+    const TreeNodes nodes = MakeFanOutTree(fan_out);
+    TreeChildIndex child_index;
+    child_index.Build(nodes);
+    ResetPeakRss();
+    for ([[maybe_unused]] auto _ : state)
+    {
+        benchmark::DoNotOptimize(rect_tree_viewer::RectTreeDrawData::Create(nodes, child_index, 0.97f, 1));
+    }
+
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(fan_out));
+    ReportPeakRss(state);
+}
+
+}  // namespace
+
+BENCHMARK(BM_LayoutFanOut)->Arg(1'000)->Arg(100'000)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,52 @@
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <chrono>
+#include <string>
+#include <string_view>
+
+#include "bench_helpers.hpp"
+#include "name_search.hpp"
+#include "tree.hpp"
+
+namespace
+{
+
+// Synthetic names are d<index> and f<index>: a rare and a common substring, a glob with a literal part and one
+// without
+constexpr std::array<std::string_view, 4> kQueries{"f12345", "d1", "f*99", "*7?7"};
+
+// Arguments: nodes count, query index and search threads (zero is one per hardware thread). A whole search in one
+// update, as the viewer does over a few frames. The first search of a tree also finds runs of names in the pool, so it
+// runs before the measured ones
+void BM_NameSearch(benchmark::State& state)
+{
+    const TreeNodes& nodes = GetSyntheticTree(static_cast<size_t>(state.range(0)));
+    const std::string_view query = kQueries[static_cast<size_t>(state.range(1))];
+    const auto thread_count = static_cast<size_t>(state.range(2));
+
+    NameSearch search;
+    search.SetQuery(query);
+    search.Update(nodes, std::chrono::hours(1), thread_count);
+    ResetPeakRss();
+    for ([[maybe_unused]] auto _ : state)
+    {
+        // Not a narrowing of the previous query, so all nodes are searched again
+        search.SetQuery({});
+        search.SetQuery(query);
+        search.Update(nodes, std::chrono::hours(1), thread_count);
+    }
+
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(nodes.Size()));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(nodes.GetColumns().names.size()));
+    state.counters["matches"] = static_cast<double>(search.GetMatches().size());
+    state.SetLabel(std::string{query});
+    ReportPeakRss(state);
+}
+
+}  // namespace
+
+BENCHMARK(BM_NameSearch)
+    ->ArgsProduct({{10'000, 1'000'000, 50'000'000}, {0, 1, 2, 3}, {1, 0}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
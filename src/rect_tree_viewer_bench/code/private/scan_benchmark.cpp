@@ -0,0 +1,114 @@
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench_helpers.hpp"
+#include "read_directory_tree.hpp"
+#include "tree.hpp"
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+// Synthetic tree written to disk, removed when it is replaced or at exit
+class DirectoryFixture
+{
+public:
+    explicit DirectoryFixture(size_t nodes_count)
+        : nodes_count_(nodes_count),
+          path_(GetFixturesDirectory() / ("rect_tree_viewer_bench_" + std::to_string(nodes_count)))
+    {
+        fs::remove_all(path_);
+        BuildDirectoryFixture(GetSyntheticTree(nodes_count), path_);
+    }
+
+    DirectoryFixture(const DirectoryFixture&) = delete;
+    DirectoryFixture& operator=(const DirectoryFixture&) = delete;
+
+    ~DirectoryFixture()
+    {
+        std::error_code error;
+        fs::remove_all(path_, error);
+    }
+
+    [[nodiscard]] size_t GetNodesCount() const { return nodes_count_; }
+    [[nodiscard]] const fs::path& GetPath() const { return path_; }
+
+    // RECT_TREE_VIEWER_BENCH_DIR if set, otherwise tmpfs when there is one
+    [[nodiscard]] static fs::path GetFixturesDirectory()
+    {
+        if (const char* directory = std::getenv("RECT_TREE_VIEWER_BENCH_DIR")) return directory;  // NOLINT
+        if (std::error_code error; fs::is_directory("/dev/shm", error)) return "/dev/shm";
+        return fs::temp_directory_path();
+    }
+
+private:
+    size_t nodes_count_ = 0;
+    fs::path path_;
+};
+
+[[nodiscard]] const DirectoryFixture& GetDirectoryFixture(size_t nodes_count)
+{
+    static std::unique_ptr<DirectoryFixture> fixture;
+    if (!fixture || fixture->GetNodesCount() != nodes_count)
+    {
+        fixture.reset();
+        fixture = std::make_unique<DirectoryFixture>(nodes_count);
+    }
+
+    return *fixture;
+}
+
+// Arguments: nodes count, scan threads (zero is one per hardware thread) and ReadDirectoryTreeBackend. The first
+// scan warms the page cache
+void BM_ReadDirectoryTreeMulti(benchmark::State& state)
+{
+    const DirectoryFixture& fixture = GetDirectoryFixture(static_cast<size_t>(state.range(0)));
+    const fs::path& path = fixture.GetPath();
+    ReadDirectoryTreeParams params;
+    params.thread_count = static_cast<size_t>(state.range(1));
+    params.backend = static_cast<ReadDirectoryTreeBackend>(state.range(2));
+
+    ReadDirectoryTreeStats stats;
+    size_t nodes_count = 0;
+    ResetPeakRss();
+    for ([[maybe_unused]] auto _ : state)
+    {
+        const TreeNodes nodes = ReadDirectoryTreeMulti(std::nullopt, std::span{&path, 1}, nullptr, params, &stats);
+        nodes_count = nodes.Size();
+    }
+
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(nodes_count));
+    state.counters["threads"] = static_cast<double>(stats.thread_count);
+
+    // Opens and stats of the io_uring backend are requests, the calls are getdents64 and submissions
+    const ReadDirectoryTreeSyscalls& syscalls = stats.syscalls;
+    const size_t syscalls_count = stats.backend == ReadDirectoryTreeBackend::IoUring
+                                      ? syscalls.read_directory_calls + syscalls.io_uring_enter_calls
+                                      : syscalls.open_calls + syscalls.read_directory_calls + syscalls.stat_calls;
+    state.counters["syscalls"] = static_cast<double>(syscalls_count);
+    state.SetLabel(std::string{ToString(stats.backend)});
+    ReportPeakRss(state);
+}
+
+// The default backend, and io_uring against it where there can be one. io_uring runs are labeled linux when the
+// kernel or the sandbox does not allow it
+const std::vector<int64_t> kScanBackends{
+    static_cast<int64_t>(ReadDirectoryTreeBackend::Auto),
+#ifdef __linux__
+    static_cast<int64_t>(ReadDirectoryTreeBackend::IoUring),
+#endif
+};
+
+}  // namespace
+
+// 50M files do not fit on a typical tmpfs, scans are measured up to 1M
+BENCHMARK(BM_ReadDirectoryTreeMulti)
+    ->ArgsProduct({{10'000, 1'000'000}, {1, 0}, kScanBackends})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
@@ -0,0 +1,121 @@
+#include "synthetic_tree.hpp"
+
+#include <array>
+#include <charconv>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include "klgl/error_handling.hpp"
+#include "path_helpers.hpp"
+
+namespace
+{
+
+// Short unique names within a directory: "d12", "f7"
+[[nodiscard]] std::string_view MakeName(char prefix, size_t index, std::array<char, 24>& buffer)
+{
+    buffer[0] = prefix;
+    const auto [end, err] = std::to_chars(buffer.data() + 1, buffer.data() + buffer.size(), index);
+    return {buffer.data(), end};
+}
+
+}  // namespace
+
+TreeNodes MakeSyntheticTree(const SyntheticTreeParams& params)
+{
+    klgl::ErrorHandling::Ensure(params.nodes_count != 0, "A synthetic tree needs at least one node");
+    klgl::ErrorHandling::Ensure(params.fan_out != 0, "A synthetic tree needs a non-zero fan-out");
+
+    TreeNodes nodes;
+    nodes.Reserve(params.nodes_count, params.nodes_count * 8);
+    const NodeId root = nodes.Add("root", 0);
+
+    std::mt19937_64 random(params.seed);
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    std::array<char, 24> name_buffer{};
+
+    struct Directory
+    {
+        NodeId node_id = kInvalidNodeId;
+        size_t depth = 0;
+    };
+
+    std::deque<Directory> directories{{.node_id = root, .depth = 0}};
+    size_t root_entries_count = 0;
+    while (nodes.Size() < params.nodes_count)
+    {
+        if (directories.empty()) directories.push_back({.node_id = root, .depth = 0});
+        const Directory directory = directories.front();
+        directories.pop_front();
+
+        const size_t entries_count = std::min(params.fan_out, params.nodes_count - nodes.Size());
+        const size_t first_index = directory.node_id == root ? root_entries_count : 0;
+        if (directory.node_id == root) root_entries_count += entries_count;
+
+        // Children are linked in reverse, so that the sibling list follows ids
+        const auto first_child = static_cast<NodeId>(nodes.Size());
+        for (size_t i = 0; i != entries_count; ++i)
+        {
+            const bool is_directory =
+                directory.depth < params.max_depth && distribution(random) < params.directories_ratio;
+            if (is_directory)
+            {
+                const NodeId node_id = nodes.Add(MakeName('d', first_index + i, name_buffer), 0, directory.node_id);
+                directories.push_back({.node_id = node_id, .depth = directory.depth + 1});
+            }
+            else
+            {
+                // Inverse transform sampling, the tail is cut at a millionth of the probability
+                const double tail = std::pow(1.0 - distribution(random) * 0.999999, -1.0 / params.size_exponent);
+                const auto value = static_cast<uint64_t>(tail * static_cast<double>(params.min_file_size));
+                nodes.Add(MakeName('f', first_index + i, name_buffer), value, directory.node_id);
+            }
+        }
+
+        for (size_t i = entries_count; i != 0; --i)
+        {
+            nodes.LinkChild(directory.node_id, first_child + static_cast<NodeId>(i - 1));
+        }
+    }
+
+    nodes.PropagateValuesToParents();
+    return nodes;
+}
+
+void BuildDirectoryFixture(const TreeNodes& nodes, const std::filesystem::path& root_path)
+{
+    std::filesystem::create_directories(root_path);
+    klgl::ErrorHandling::Ensure(
+        std::filesystem::is_empty(root_path),
+        "Fixture directory {} is not empty",
+        PathHelpers::PathToUTF8(root_path));
+
+    // Parents precede children, so a parent path is always known. Only directories keep their paths
+    std::vector<std::filesystem::path> paths(nodes.Size());
+    paths[0] = root_path;
+    for (const NodeId node_id : nodes.Ids())
+    {
+        if (node_id == 0) continue;
+
+        const std::filesystem::path& parent_path = paths[nodes.GetParent(node_id)];
+        std::filesystem::path path = parent_path / PathHelpers::PathFromUTF8(nodes.GetName(node_id));
+        if (nodes.GetFirstChild(node_id) != kInvalidNodeId)
+        {
+            std::filesystem::create_directory(path);
+            paths[node_id] = std::move(path);
+        }
+        else
+        {
+            // tmpfs may run out of inodes long before it runs out of memory
+            klgl::ErrorHandling::Ensure(
+                std::ofstream{path, std::ios::binary}.is_open(),
+                "Failed to create {}",
+                PathHelpers::PathToUTF8(path));
+            std::filesystem::resize_file(path, nodes.GetValue(node_id));
+        }
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+#include "tree.hpp"
+
+struct SyntheticTreeParams
+{
+    size_t nodes_count = 10'000;
+
+    // Directories deeper than this have only files. The root is at depth 0
+    size_t max_depth = 8;
+
+    // Entries of each directory
+    size_t fan_out = 16;
+
+    // Part of the entries that are directories
+    double directories_ratio = 0.1;
+
+    // File sizes follow a Pareto distribution: P(size > x) = (min_file_size / x)^size_exponent. Smaller exponents give
+    // heavier tails: a few huge files and many small ones
+    double size_exponent = 2.0 / 3.0;
+    uint64_t min_file_size = 1000;
+
+    uint64_t seed = 0;
+};
+
+// Builds the tree breadth first like a merged scan: parents precede their children, children of a directory have
+// consecutive ids and directory values are sums of their subtrees. If directories run out before nodes_count, the root
+// gets more entries.
+[[nodiscard]] TreeNodes MakeSyntheticTree(const SyntheticTreeParams& params);
+
+// Creates the tree on disk under root_path: nodes with children become directories, the others sparse files of their
+// value. Put it on tmpfs (/dev/shm) to measure the scanner rather than the disk.
+void BuildDirectoryFixture(const TreeNodes& nodes, const std::filesystem::path& root_path);
@@ -0,0 +1,175 @@
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "allocation_counter.hpp"
+#include "bench_helpers.hpp"
+#include "path_helpers.hpp"
+#include "rect_tree_draw_data.hpp"
+#include "tree.hpp"
+#include "tree_child_index.hpp"
+
+namespace
+{
+
+using namespace rect_tree_viewer;  // NOLINT
+
+void BM_BuildChildIndex(benchmark::State& state)
+{
+    const TreeNodes& nodes = GetSyntheticTree(static_cast<size_t>(state.range(0)));
+    TreeChildIndex child_index;
+    ResetPeakRss();
+    for ([[maybe_unused]] auto _ : state)
+    {
+        child_index.Build(nodes);
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(nodes.Size()));
+    state.counters["index_mb"] = static_cast<double>(child_index.GetMemoryUsage()) / (1024.0 * 1024.0);
+    ReportPeakRss(state);
+}
+
+void BM_Create(benchmark::State& state)
+{
+    const TreeNodes& nodes = GetSyntheticTree(static_cast<size_t>(state.range(0)));
+    TreeChildIndex child_index;
+    child_index.Build(nodes);
+    ResetPeakRss();
+    for ([[maybe_unused]] auto _ : state)
+    {
+        benchmark::DoNotOptimize(RectTreeDrawData::Create(nodes, child_index));
+    }
+
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(nodes.Size()));
+    ReportPeakRss(state);
+}
+
+void BM_CreateWithSpatialIndex(benchmark::State& state)
+{
+    const TreeNodes& nodes = GetSyntheticTree(static_cast<size_t>(state.range(0)));
+    TreeChildIndex child_index;
+    child_index.Build(nodes);
+    RectTreeSpatialIndex spatial_index;
+    ResetPeakRss();
+    for ([[maybe_unused]] auto _ : state)
+    {
+        benchmark::DoNotOptimize(
+            RectTreeDrawData::Create(nodes, child_index, RectTreeDrawData::kDefaultPaddingFactor, 0, &spatial_index));
+    }
+
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(nodes.Size()));
+    state.counters["index_mb"] = static_cast<double>(spatial_index.GetMemoryUsage()) / (1024.0 * 1024.0);
+    ReportPeakRss(state);
+}
+
+// Random points over the whole tree, like a cursor moving over the zoomed out view
+void BM_FindNodeAt(benchmark::State& state)
+{
+    const TreeNodes& nodes = GetSyntheticTree(static_cast<size_t>(state.range(0)));
+    TreeChildIndex child_index;
+    child_index.Build(nodes);
+    RectTreeSpatialIndex spatial_index;
+    const std::vector<Rect2d> rects =
+        RectTreeDrawData::Create(nodes, child_index, RectTreeDrawData::kDefaultPaddingFactor, 0, &spatial_index);
+
+    std::mt19937 random(0);
+    std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+    std::vector<edt::Vec2f> positions(1024);
+    for (edt::Vec2f& position : positions) position = {distribution(random), distribution(random)};
+
+    size_t position_index = 0;
+    ResetPeakRss();
+    for ([[maybe_unused]] auto _ : state)
+    {
+        benchmark::DoNotOptimize(spatial_index.FindNodeAt(rects, positions[position_index]));
+        position_index = (position_index + 1) % positions.size();
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    ReportPeakRss(state);
+}
+
+void BM_GetNodeFullPath(benchmark::State& state)
+{
+    const TreeNodes& nodes = GetSyntheticTree(static_cast<size_t>(state.range(0)));
+    const std::vector<std::filesystem::path> root_paths{"/synthetic/root"};
+    const std::unordered_map<NodeId, size_t> root_node_id_to_path_index{{0, 0}};
+
+    std::mt19937 random(0);
+    std::uniform_int_distribution<NodeId> distribution(0, static_cast<NodeId>(nodes.Size() - 1));
+    std::vector<NodeId> node_ids(1024);
+    for (NodeId& node_id : node_ids) node_id = distribution(random);
+
+    size_t node_index = 0;
+    ResetPeakRss();
+    for ([[maybe_unused]] auto _ : state)
+    {
+        benchmark::DoNotOptimize(
+            PathHelpers::GetNodeFullPath(nodes, root_paths, root_node_id_to_path_index, node_ids[node_index]));
+        node_index = (node_index + 1) % node_ids.size();
+    }
+
+    state.SetItemsProcessed(state.iterations());
+    ReportPeakRss(state);
+}
+
+// Like the hover text of the viewer: the path of another node every time, in buffers that are reused. Reports an error
+// if anything is allocated once the buffers have grown to the deepest path
+void BM_NodeFullPathCache(benchmark::State& state)
+{
+    const TreeNodes& nodes = GetSyntheticTree(static_cast<size_t>(state.range(0)));
+    const std::vector<std::filesystem::path> root_paths{"/synthetic/root"};
+    const std::unordered_map<NodeId, size_t> root_node_id_to_path_index{{0, 0}};
+    NodeFullPathCache cache;
+    cache.SetRoots(root_paths, root_node_id_to_path_index);
+
+    std::mt19937 random(0);
+    std::uniform_int_distribution<NodeId> distribution(0, static_cast<NodeId>(nodes.Size() - 1));
+    std::vector<NodeId> node_ids(1024);
+    for (NodeId& node_id : node_ids) node_id = distribution(random);
+    for (const NodeId node_id : node_ids) benchmark::DoNotOptimize(cache.GetFullPath(nodes, node_id));
+
+    const uint64_t allocations_count = AllocationCounter::GetThreadAllocationsCount();
+    size_t node_index = 0;
+    ResetPeakRss();
+    for ([[maybe_unused]] auto _ : state)
+    {
+        benchmark::DoNotOptimize(cache.GetFullPath(nodes, node_ids[node_index]));
+        node_index = (node_index + 1) % node_ids.size();
+    }
+
+    const uint64_t allocations = AllocationCounter::GetThreadAllocationsCount() - allocations_count;
+    if (allocations != 0) state.SkipWithError("The hover path allocated");
+    state.counters["allocations"] = static_cast<double>(allocations);
+    state.SetItemsProcessed(state.iterations());
+    ReportPeakRss(state);
+}
+
+// Values keep growing from one iteration to the next, which does not change the work
+void BM_PropagateValuesToParents(benchmark::State& state)
+{
+    TreeNodes nodes = GetSyntheticTree(static_cast<size_t>(state.range(0)));
+    ResetPeakRss();
+    for ([[maybe_unused]] auto _ : state)
+    {
+        nodes.PropagateValuesToParents();
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(nodes.Size()));
+    ReportPeakRss(state);
+}
+
+}  // namespace
+
+BENCHMARK(BM_BuildChildIndex)->Apply(AddTreeSizes)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Create)->Apply(AddTreeSizes)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_CreateWithSpatialIndex)->Apply(AddTreeSizes)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_FindNodeAt)->Apply(AddTreeSizes);
+BENCHMARK(BM_GetNodeFullPath)->Apply(AddTreeSizes);
+BENCHMARK(BM_NodeFullPathCache)->Apply(AddTreeSizes);
+BENCHMARK(BM_PropagateValuesToParents)->Apply(AddTreeSizes)->Unit(benchmark::kMillisecond);
@@ -0,0 +1 @@
+target_link_libraries(rect_tree_viewer_bench PRIVATE rect_tree_viewer_allocation_counter)
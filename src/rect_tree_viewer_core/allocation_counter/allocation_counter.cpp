@@ -0,0 +1,88 @@
+#include "allocation_counter.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+
+// Constant initialized, so they are usable from operator new before anything else runs
+thread_local uint64_t thread_allocations_count = 0;
+thread_local uint64_t thread_allocated_bytes = 0;
+
+[[nodiscard]] void* Allocate(size_t size)
+{
+    ++thread_allocations_count;
+    thread_allocated_bytes += size;
+    if (void* pointer = std::malloc(size == 0 ? 1 : size)) return pointer;
+    throw std::bad_alloc{};
+}
+
+[[nodiscard]] void* AllocateAligned(size_t size, std::align_val_t alignment)
+{
+    ++thread_allocations_count;
+    thread_allocated_bytes += size;
+    const auto alignment_value = static_cast<size_t>(alignment);
+#ifdef _WIN32
+    void* pointer = _aligned_malloc(size == 0 ? 1 : size, alignment_value);
+#else
+    // aligned_alloc wants the size to be a multiple of the alignment
+    const size_t aligned_size = (std::max(size, size_t{1}) + alignment_value - 1) / alignment_value * alignment_value;
+    void* pointer = std::aligned_alloc(alignment_value, aligned_size);
+#endif
+    if (pointer) return pointer;
+    throw std::bad_alloc{};
+}
+
+void FreeAligned(void* pointer)
+{
+#ifdef _WIN32
+    _aligned_free(pointer);
+#else
+    std::free(pointer);
+#endif
+}
+
+}  // namespace
+
+uint64_t AllocationCounter::GetThreadAllocationsCount()
+{
+    return thread_allocations_count;
+}
+
+uint64_t AllocationCounter::GetThreadAllocatedBytes()
+{
+    return thread_allocated_bytes;
+}
+
+// Array and nothrow versions call these ones by default
+void* operator new(size_t size)
+{
+    return Allocate(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return AllocateAligned(size, alignment);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+    FreeAligned(pointer);
+}
+
+void operator delete(void* pointer, size_t, std::align_val_t) noexcept
+{
+    FreeAligned(pointer);
+}
@@ -0,0 +1,440 @@
+#include "disk_usage_import.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "fmt/std.h"  // IWYU pragma: keep
+#include "json_sax_parser.hpp"
+#include "klgl/error_handling.hpp"
+#include "mapped_file.hpp"
+#include "path_helpers.hpp"
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+enum class DiskUsageDumpFormat : uint8_t
+{
+    Ncdu,
+    Du
+};
+
+// An ncdu export is a JSON array, a du line starts with a size followed by a tab
+[[nodiscard]] std::optional<DiskUsageDumpFormat> DetectDumpFormat(std::string_view text)
+{
+    const size_t begin = text.find_first_not_of(" \t\r\n");
+    if (begin == std::string_view::npos) return std::nullopt;
+    if (text[begin] == '[') return DiskUsageDumpFormat::Ncdu;
+
+    const size_t digits_end = text.find_first_not_of("0123456789", begin);
+    if (digits_end != begin && digits_end != std::string_view::npos && text[digits_end] == '\t')
+    {
+        return DiskUsageDumpFormat::Du;
+    }
+
+    return std::nullopt;
+}
+
+// Name of the root node for a path recorded in a dump, like a scanned root gets
+[[nodiscard]] std::string GetRootNodeName(std::string_view root_path)
+{
+    while (root_path.size() > 1 && root_path.ends_with('/')) root_path.remove_suffix(1);
+    return PathHelpers::PathToUTF8(PathHelpers::PathFromUTF8(root_path).filename());
+}
+
+// ncdu export: [1, 2, {metadata}, [{root}, {file}, [{directory}, ...], ...]]. A directory is an array that starts with
+// its own object, followed by files (objects) and subdirectories (arrays). Nodes are added when their object ends, so
+// parents precede their children.
+class NcduExportHandler
+{
+public:
+    NcduExportHandler(TreeNodes& nodes, NodeId parent) : nodes_(nodes), parent_(parent) {}
+
+    void OnObjectBegin()
+    {
+        ++depth_;
+        if (!IsEntry()) return;
+
+        entry_name_.clear();
+        entry_size_ = 0;
+        entry_key_ = EntryKey::Other;
+    }
+
+    void OnObjectEnd()
+    {
+        if (IsEntry())
+        {
+            Directory& directory = directories_.back();
+            if (directory.node_id == kInvalidNodeId)
+            {
+                const NodeId parent = directories_.size() > 1 ? directories_[directories_.size() - 2].node_id : parent_;
+                if (directories_.size() == 1)
+                {
+                    root_path_ = entry_name_;
+                    directory.node_id = nodes_.Add(GetRootNodeName(root_path_), 0, parent);
+                    root_ = directory.node_id;
+                }
+                else
+                {
+                    directory.node_id = nodes_.Add(entry_name_, 0, parent);
+                }
+
+                if (parent != kInvalidNodeId) nodes_.LinkChild(parent, directory.node_id);
+            }
+            else
+            {
+                nodes_.LinkChild(directory.node_id, nodes_.Add(entry_name_, entry_size_, directory.node_id));
+            }
+        }
+
+        --depth_;
+    }
+
+    void OnArrayBegin()
+    {
+        ++depth_;
+
+        // The root directory is the only array in the top level one
+        const bool is_root = depth_ == 2;
+        const bool is_subdirectory = !directories_.empty() && depth_ == directories_.back().depth + 1;
+        if (is_root || is_subdirectory)
+        {
+            klgl::ErrorHandling::Ensure(
+                is_subdirectory || root_ == kInvalidNodeId,
+                "ncdu export has more than one root");
+            klgl::ErrorHandling::Ensure(
+                is_root || directories_.back().node_id != kInvalidNodeId,
+                "ncdu export has a directory without its own entry");
+            directories_.push_back({.depth = depth_, .node_id = kInvalidNodeId});
+        }
+    }
+
+    void OnArrayEnd()
+    {
+        if (!directories_.empty() && directories_.back().depth == depth_) directories_.pop_back();
+        --depth_;
+    }
+
+    void OnKey(std::string_view key)
+    {
+        if (!IsEntry()) return;
+
+        if (key == "name")
+        {
+            entry_key_ = EntryKey::Name;
+        }
+        else if (key == "asize")
+        {
+            entry_key_ = EntryKey::ApparentSize;
+        }
+        else
+        {
+            entry_key_ = EntryKey::Other;
+        }
+    }
+
+    void OnString(std::string_view value)
+    {
+        if (IsEntry() && entry_key_ == EntryKey::Name) entry_name_.assign(value);
+    }
+
+    void OnNumber(std::string_view text)
+    {
+        if (depth_ == 1 && !checked_version_)
+        {
+            klgl::ErrorHandling::Ensure(text == "1", "Unsupported ncdu export version {}", text);
+            checked_version_ = true;
+        }
+        else if (IsEntry() && entry_key_ == EntryKey::ApparentSize)
+        {
+            const char* text_end = text.data() + text.size();  // NOLINT
+            const auto [end, err] = std::from_chars(text.data(), text_end, entry_size_);
+            klgl::ErrorHandling::Ensure(err == std::errc{} && end == text_end, "Invalid size {} in ncdu export", text);
+        }
+    }
+
+    void OnBool(bool) {}
+    void OnNull() {}
+
+    [[nodiscard]] NodeId GetRoot() const { return root_; }
+    [[nodiscard]] const std::string& GetRootPath() const { return root_path_; }
+
+private:
+    enum class EntryKey : uint8_t
+    {
+        Other,
+        Name,
+        ApparentSize
+    };
+
+    // Directory array. Its node is added when its first object ends
+    struct Directory
+    {
+        size_t depth = 0;
+        NodeId node_id = kInvalidNodeId;
+    };
+
+    // Objects right in a directory array are entries, the deeper ones are skipped
+    [[nodiscard]] bool IsEntry() const { return !directories_.empty() && depth_ == directories_.back().depth + 1; }
+
+    TreeNodes& nodes_;
+    NodeId parent_ = kInvalidNodeId;
+    NodeId root_ = kInvalidNodeId;
+    std::string root_path_;
+    std::vector<Directory> directories_;
+    size_t depth_ = 0;
+    bool checked_version_ = false;
+
+    // The name keeps its capacity from one entry to the next
+    std::string entry_name_;
+    uint64_t entry_size_ = 0;
+    EntryKey entry_key_ = EntryKey::Other;
+};
+
+// Children by parent and name. Slots hold node ids and keys are compared against the tree, so lookups and insertions
+// do not allocate until the table grows. Slots keep a part of the hash too: most mismatches do not touch the tree.
+class PathComponentTrie
+{
+public:
+    PathComponentTrie(TreeNodes& nodes, size_t expected_nodes_count) : nodes_(nodes)
+    {
+        slots_.resize(std::bit_ceil(std::max(expected_nodes_count * 2, size_t{16})));
+    }
+
+    NodeId FindOrAddChild(NodeId parent, std::string_view name)
+    {
+        if ((nodes_count_ + 1) * 2 > slots_.size()) Grow();
+
+        const size_t hash = Hash(parent, name);
+        const auto tag = static_cast<uint32_t>(hash >> 32);
+        const size_t mask = slots_.size() - 1;
+        for (size_t slot_index = hash & mask;; slot_index = (slot_index + 1) & mask)
+        {
+            Slot& slot = slots_[slot_index];
+            if (slot.node_id == kInvalidNodeId)
+            {
+                const NodeId child = nodes_.Add(name, 0, parent);
+                nodes_.LinkChild(parent, child);
+                slot = {.node_id = child, .tag = tag};
+                ++nodes_count_;
+                return child;
+            }
+
+            if (slot.tag == tag && nodes_.GetParent(slot.node_id) == parent && nodes_.GetName(slot.node_id) == name)
+            {
+                return slot.node_id;
+            }
+        }
+    }
+
+private:
+    struct Slot
+    {
+        NodeId node_id = kInvalidNodeId;
+        uint32_t tag = 0;
+    };
+
+    [[nodiscard]] static size_t Hash(NodeId parent, std::string_view name)
+    {
+        return std::hash<std::string_view>{}(name) ^ (static_cast<size_t>(parent) * 0x9E3779B97F4A7C15ull);
+    }
+
+    void Grow()
+    {
+        std::vector<Slot> old_slots(slots_.size() * 2);
+        old_slots.swap(slots_);
+
+        const size_t mask = slots_.size() - 1;
+        for (const Slot& old_slot : old_slots)
+        {
+            if (old_slot.node_id == kInvalidNodeId) continue;
+
+            size_t slot_index = Hash(nodes_.GetParent(old_slot.node_id), nodes_.GetName(old_slot.node_id)) & mask;
+            while (slots_[slot_index].node_id != kInvalidNodeId) slot_index = (slot_index + 1) & mask;
+            slots_[slot_index] = old_slot;
+        }
+    }
+
+    TreeNodes& nodes_;
+    std::vector<Slot> slots_;
+    size_t nodes_count_ = 0;
+};
+
+struct DuRecord
+{
+    uint64_t size = 0;
+    std::string_view path;
+};
+
+[[nodiscard]] DuRecord ParseDuRecord(std::string_view record)
+{
+    DuRecord result;
+    const char* record_end = record.data() + record.size();  // NOLINT
+    const auto [size_end, err] = std::from_chars(record.data(), record_end, result.size);
+    klgl::ErrorHandling::Ensure(
+        err == std::errc{} && size_end != record_end && *size_end == '\t',
+        "Expected a size and a tab in du line \"{}\"",
+        record);
+
+    result.path = record.substr(static_cast<size_t>(size_end - record.data()) + 1);
+    if (result.path.ends_with('\r')) result.path.remove_suffix(1);
+    return result;
+}
+
+// Component of the previous du path: where it ends in the path and its node
+struct DuPathComponent
+{
+    size_t end = 0;
+    NodeId node_id = kInvalidNodeId;
+};
+
+// du lists the root last, so it is read first, and every other path is looked up relative to it. Consecutive lines
+// share most of their components, only the ones after the common prefix with the previous line go through the trie.
+NodeId ImportDuOutput(std::string_view text, TreeNodes& nodes, NodeId parent, std::string& out_root_path)
+{
+    const char separator = text.ends_with('\0') ? '\0' : '\n';
+    while (text.ends_with(separator)) text.remove_suffix(1);
+    klgl::ErrorHandling::Ensure(!text.empty(), "du output is empty");
+
+    const std::string_view root_path = ParseDuRecord(text.substr(text.rfind(separator) + 1)).path;
+    out_root_path = root_path;
+
+    // Names are much shorter than the lines they come from
+    const auto records_count = static_cast<size_t>(std::count(text.begin(), text.end(), separator)) + 1;
+    constexpr size_t kNameSizeEstimate = 16;
+    nodes.Reserve(nodes.Size() + records_count, (nodes.Size() + records_count) * kNameSizeEstimate);
+
+    const NodeId root = nodes.Add(GetRootNodeName(root_path), 0, parent);
+    if (parent != kInvalidNodeId) nodes.LinkChild(parent, root);
+
+    PathComponentTrie trie(nodes, records_count);
+    std::vector<DuPathComponent> components;
+    std::string_view previous_relative_path;
+    for (size_t record_begin = 0; record_begin < text.size();)
+    {
+        const size_t record_end = std::min(text.find(separator, record_begin), text.size());
+        const std::string_view record = text.substr(record_begin, record_end - record_begin);
+        record_begin = record_end + 1;
+        if (record.empty()) continue;
+
+        const DuRecord du_record = ParseDuRecord(record);
+        if (du_record.path == root_path)
+        {
+            nodes.SetValue(root, du_record.size);
+            continue;
+        }
+
+        const bool is_under_root =
+            du_record.path.starts_with(root_path) &&
+            (root_path.ends_with('/') || du_record.path[root_path.size()] == '/');
+        klgl::ErrorHandling::Ensure(
+            is_under_root,
+            "du path \"{}\" is not under \"{}\", the last line. Dumps with several roots are not supported",
+            du_record.path,
+            root_path);
+        const std::string_view relative_path = du_record.path.substr(root_path.size());
+
+        // Components that end within the common prefix are the same as in the previous path
+        const size_t common_prefix_size = static_cast<size_t>(
+            std::mismatch(
+                relative_path.begin(),
+                relative_path.end(),
+                previous_relative_path.begin(),
+                previous_relative_path.end())
+                .first -
+            relative_path.begin());
+        while (!components.empty())
+        {
+            const size_t end = components.back().end;
+            if (end <= common_prefix_size && (end == relative_path.size() || relative_path[end] == '/')) break;
+            components.pop_back();
+        }
+
+        NodeId node_id = components.empty() ? root : components.back().node_id;
+        size_t component_begin = components.empty() ? 0 : components.back().end;
+        while (component_begin < relative_path.size())
+        {
+            if (relative_path[component_begin] == '/')
+            {
+                ++component_begin;
+                continue;
+            }
+
+            const size_t component_end = std::min(relative_path.find('/', component_begin), relative_path.size());
+            node_id = trie.FindOrAddChild(
+                node_id,
+                relative_path.substr(component_begin, component_end - component_begin));
+            components.push_back({.end = component_end, .node_id = node_id});
+            component_begin = component_end;
+        }
+
+        nodes.SetValue(node_id, du_record.size);
+        previous_relative_path = relative_path;
+    }
+
+    // Directory lines include the size of the directory entry, their values are summed from files instead
+    for (NodeId node_id = root; node_id != nodes.Size(); ++node_id)
+    {
+        if (nodes.GetFirstChild(node_id) != kInvalidNodeId) nodes.SetValue(node_id, 0);
+    }
+
+    return root;
+}
+
+NodeId ImportNcduExport(std::string_view text, TreeNodes& nodes, NodeId parent, std::string& out_root_path)
+{
+    NcduExportHandler handler(nodes, parent);
+    JsonSaxParser(text).Parse(handler);
+    klgl::ErrorHandling::Ensure(handler.GetRoot() != kInvalidNodeId, "ncdu export has no root directory");
+    out_root_path = handler.GetRootPath();
+    return handler.GetRoot();
+}
+
+}  // namespace
+
+bool IsDiskUsageDump(const std::filesystem::path& path)
+{
+    std::array<char, 64> head{};
+    std::ifstream file(path, std::ios::binary);
+    file.read(head.data(), head.size());
+    return DetectDumpFormat({head.data(), static_cast<size_t>(file.gcount())}).has_value();
+}
+
+TreeSnapshot ImportDiskUsageDumps(std::span<const std::filesystem::path> paths)
+{
+    klgl::ErrorHandling::Ensure(!paths.empty(), "Expected at least one disk usage dump");
+
+    TreeSnapshot snapshot;
+    TreeNodes& nodes = snapshot.nodes;
+    const NodeId common_root = paths.size() == 1 ? kInvalidNodeId : nodes.Add("SELECTION", 0);
+
+    std::string root_path;
+    for (size_t path_index = 0; path_index != paths.size(); ++path_index)
+    {
+        const fs::path& path = paths[path_index];
+        const MappedFile file(path, MappedFileAccess::Sequential);
+        const std::span<const std::byte> bytes = file.GetBytes();
+        const std::string_view text(reinterpret_cast<const char*>(bytes.data()), bytes.size());  // NOLINT
+
+        const std::optional<DiskUsageDumpFormat> format = DetectDumpFormat(text);
+        klgl::ErrorHandling::Ensure(format.has_value(), "{} is neither an ncdu export nor du -ab output", path);
+
+        const NodeId root = *format == DiskUsageDumpFormat::Ncdu
+                                ? ImportNcduExport(text, nodes, common_root, root_path)
+                                : ImportDuOutput(text, nodes, common_root, root_path);
+        snapshot.root_paths.push_back(PathHelpers::PathFromUTF8(root_path));
+        snapshot.root_node_id_to_path_index[root] = path_index;
+    }
+
+    nodes.PropagateValuesToParents();
+    return snapshot;
+}
@@ -0,0 +1,171 @@
+#include "io_uring.hpp"
+
+#ifdef __linux__
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+
+namespace
+{
+
+// Values of the kernel ABI. The viewer builds against older uapi headers, which lack them: COOP_TASKRUN came with 5.19
+// and SINGLE_ISSUER with 6.0, and newer headers turned the register opcodes into an enum
+constexpr uint32_t kSetupCoopTaskRun = 1U << 8;
+constexpr uint32_t kSetupSingleIssuer = 1U << 12;
+constexpr unsigned kRegisterProbe = 8;
+constexpr uint16_t kOpSupported = 1U << 0;
+
+[[nodiscard]] int SetupRing(uint32_t entries_count, io_uring_params& params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries_count, &params));
+}
+
+[[nodiscard]] void* MapRing(int fd, size_t size, off_t offset)
+{
+    void* ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return ring != MAP_FAILED ? ring : nullptr;  // NOLINT
+}
+
+template <typename T>
+[[nodiscard]] T* RingField(void* ring, uint32_t offset)
+{
+    return reinterpret_cast<T*>(static_cast<std::byte*>(ring) + offset);  // NOLINT
+}
+
+// Kernels before 5.6 have io_uring but neither openat nor statx requests
+[[nodiscard]] bool SupportsListingOps(int fd)
+{
+    constexpr size_t kOpsCount = 256;
+    alignas(io_uring_probe) std::array<std::byte, sizeof(io_uring_probe) + kOpsCount * sizeof(io_uring_probe_op)>
+        buffer{};
+    auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());  // NOLINT
+    if (syscall(__NR_io_uring_register, fd, kRegisterProbe, probe, kOpsCount) < 0) return false;
+
+    auto is_supported = [&](uint8_t op)
+    {
+        return op <= probe->last_op && (probe->ops[op].flags & kOpSupported) != 0;  // NOLINT
+    };
+
+    return is_supported(IORING_OP_OPENAT) && is_supported(IORING_OP_STATX);
+}
+
+}  // namespace
+
+std::unique_ptr<IoUring> IoUring::Create(uint32_t entries_count)
+{
+    // Only the creating thread submits, which lets the kernel skip some locking and interrupts. Kernels before 6.0
+    // reject these flags
+    io_uring_params params{};
+    params.flags = kSetupSingleIssuer | kSetupCoopTaskRun;
+    int fd = SetupRing(entries_count, params);
+    if (fd < 0 && errno == EINVAL)
+    {
+        params = {};
+        fd = SetupRing(entries_count, params);
+    }
+
+    if (fd < 0) return nullptr;
+
+    std::unique_ptr<IoUring> ring(new IoUring());
+    ring->fd_ = fd;
+    if (!SupportsListingOps(fd)) return nullptr;
+
+    ring->sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    ring->cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap)
+    {
+        ring->sq_ring_size_ = std::max(ring->sq_ring_size_, ring->cq_ring_size_);
+        ring->cq_ring_size_ = 0;
+    }
+
+    ring->sq_ring_ = MapRing(fd, ring->sq_ring_size_, IORING_OFF_SQ_RING);
+    if (!ring->sq_ring_) return nullptr;
+
+    ring->cq_ring_ = single_mmap ? ring->sq_ring_ : MapRing(fd, ring->cq_ring_size_, IORING_OFF_CQ_RING);
+    if (!ring->cq_ring_) return nullptr;
+
+    ring->sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqes_ = static_cast<io_uring_sqe*>(MapRing(fd, ring->sqes_size_, IORING_OFF_SQES));
+    if (!ring->sqes_) return nullptr;
+
+    ring->sq_head_ = RingField<uint32_t>(ring->sq_ring_, params.sq_off.head);
+    ring->sq_tail_ = RingField<uint32_t>(ring->sq_ring_, params.sq_off.tail);
+    ring->sq_array_ = RingField<uint32_t>(ring->sq_ring_, params.sq_off.array);
+    ring->sq_mask_ = *RingField<uint32_t>(ring->sq_ring_, params.sq_off.ring_mask);
+    ring->sq_entries_count_ = params.sq_entries;
+    ring->queued_tail_ = *ring->sq_tail_;
+    ring->submitted_tail_ = ring->queued_tail_;
+
+    ring->cq_head_ = RingField<uint32_t>(ring->cq_ring_, params.cq_off.head);
+    ring->cq_tail_ = RingField<uint32_t>(ring->cq_ring_, params.cq_off.tail);
+    ring->cqes_ = RingField<io_uring_cqe>(ring->cq_ring_, params.cq_off.cqes);
+    ring->cq_mask_ = *RingField<uint32_t>(ring->cq_ring_, params.cq_off.ring_mask);
+
+    return ring;
+}
+
+IoUring::~IoUring()
+{
+    if (sqes_) munmap(sqes_, sqes_size_);
+    if (cq_ring_ && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_) munmap(sq_ring_, sq_ring_size_);
+    if (fd_ >= 0) close(fd_);
+}
+
+io_uring_sqe* IoUring::GetSubmissionEntry()
+{
+    const uint32_t head = std::atomic_ref(*sq_head_).load(std::memory_order_acquire);
+    if (queued_tail_ - head == sq_entries_count_) return nullptr;
+
+    const uint32_t index = queued_tail_ & sq_mask_;
+    sq_array_[index] = index;  // NOLINT
+    ++queued_tail_;
+
+    io_uring_sqe* entry = &sqes_[index];  // NOLINT
+    std::memset(entry, 0, sizeof(io_uring_sqe));
+    return entry;
+}
+
+uint32_t IoUring::GetReadyCompletionsCount() const
+{
+    return std::atomic_ref(*cq_tail_).load(std::memory_order_acquire) - *cq_head_;
+}
+
+bool IoUring::SubmitAndWait(uint32_t wait_count, size_t& enter_calls)
+{
+    std::atomic_ref(*sq_tail_).store(queued_tail_, std::memory_order_release);
+    while (submitted_tail_ != queued_tail_ || GetReadyCompletionsCount() < wait_count)
+    {
+        const uint32_t submit_count = queued_tail_ - submitted_tail_;
+        ++enter_calls;
+        const long submitted_count = syscall(  // NOLINT
+            __NR_io_uring_enter,
+            fd_,
+            submit_count,
+            wait_count,
+            wait_count != 0 ? IORING_ENTER_GETEVENTS : 0,
+            nullptr,
+            0);
+        if (submitted_count < 0)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        // Would spin forever otherwise
+        if (submit_count != 0 && submitted_count == 0) return false;
+
+        submitted_tail_ += static_cast<uint32_t>(submitted_count);
+    }
+
+    return true;
+}
+
+#endif
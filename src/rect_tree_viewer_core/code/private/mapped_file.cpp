@@ -0,0 +1,92 @@
+#include "mapped_file.hpp"
+
+#include "fmt/std.h"  // IWYU pragma: keep
+#include "klgl/error_handling.hpp"
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+MappedFile::MappedFile(const std::filesystem::path& path, MappedFileAccess access)
+{
+    const DWORD access_flag =
+        access == MappedFileAccess::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS;
+    file_ = CreateFileW(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | access_flag,
+        nullptr);
+    klgl::ErrorHandling::Ensure(file_ != INVALID_HANDLE_VALUE, "Failed to open {}", path);
+
+    LARGE_INTEGER file_size{};
+    if (!GetFileSizeEx(file_, &file_size) || file_size.QuadPart == 0)
+    {
+        CloseHandle(file_);
+        throw klgl::ErrorHandling::RuntimeErrorWithMessage("Failed to get size of {} or it is empty", path);
+    }
+
+    mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping_)
+    {
+        CloseHandle(file_);
+        throw klgl::ErrorHandling::RuntimeErrorWithMessage("Failed to create file mapping for {}", path);
+    }
+
+    const void* view = MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+    if (!view)
+    {
+        CloseHandle(mapping_);
+        CloseHandle(file_);
+        throw klgl::ErrorHandling::RuntimeErrorWithMessage("Failed to map {}", path);
+    }
+
+    data_ = static_cast<const std::byte*>(view);
+    size_ = static_cast<size_t>(file_size.QuadPart);
+}
+
+MappedFile::~MappedFile()
+{
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_);
+    CloseHandle(file_);
+}
+
+#else
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::filesystem::path& path, MappedFileAccess access)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);  // NOLINT
+    klgl::ErrorHandling::Ensure(fd >= 0, "Failed to open {}", path);
+
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+    {
+        close(fd);
+        throw klgl::ErrorHandling::RuntimeErrorWithMessage("Failed to get size of {} or it is empty", path);
+    }
+
+    size_ = static_cast<size_t>(file_stat.st_size);
+    void* view = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    klgl::ErrorHandling::Ensure(view != MAP_FAILED, "Failed to map {}", path);  // NOLINT
+
+    // Only a hint, the mapping works the same without it
+    if (access == MappedFileAccess::Sequential) madvise(view, size_, MADV_SEQUENTIAL);
+
+    data_ = static_cast<const std::byte*>(view);
+}
+
+MappedFile::~MappedFile()
+{
+    munmap(const_cast<std::byte*>(data_), size_);  // NOLINT
+}
+
+#endif
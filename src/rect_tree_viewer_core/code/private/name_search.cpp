@@ -0,0 +1,485 @@
+#include "name_search.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <optional>
+#include <ranges>
+
+#include "parallel_chunks.hpp"
+#include "tracing.hpp"
+
+namespace
+{
+
+// Nodes per slice: an update checks the time budget between slices
+constexpr size_t kSliceNodes = size_t{1} << 22;
+
+// Threads take nodes of a slice in chunks of this size
+constexpr size_t kChunkNodes = size_t{1} << 14;
+
+constexpr size_t kNoPosition = std::numeric_limits<size_t>::max();
+
+[[nodiscard]] constexpr char ToLower(char c)
+{
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+[[nodiscard]] constexpr char ToUpper(char c)
+{
+    return c >= 'a' && c <= 'z' ? static_cast<char>(c - 'a' + 'A') : c;
+}
+
+[[nodiscard]] std::string ToLower(std::string_view text)
+{
+    std::string lower(text);
+    std::ranges::transform(lower, lower.begin(), [](char c) { return ToLower(c); });
+    return lower;
+}
+
+// lower_text must be lowercase already
+[[nodiscard]] bool EqualsIgnoreCase(const char* text, std::string_view lower_text)
+{
+    for (const size_t i : std::views::iota(size_t{0}, lower_text.size()))
+    {
+        if (ToLower(text[i]) != lower_text[i]) return false;  // NOLINT
+    }
+
+    return true;
+}
+
+[[nodiscard]] bool ContainsIgnoreCase(std::string_view text, std::string_view lower_text)
+{
+    if (lower_text.size() > text.size()) return false;
+    for (const size_t position : std::views::iota(size_t{0}, text.size() - lower_text.size() + 1))
+    {
+        if (EqualsIgnoreCase(text.data() + position, lower_text)) return true;  // NOLINT
+    }
+
+    return false;
+}
+
+// Set expression of a glob starting at pattern[begin] == '['. None if it is not closed, then '[' is a literal
+class GlobSet
+{
+public:
+    [[nodiscard]] static std::optional<GlobSet> Parse(std::string_view pattern, size_t begin)
+    {
+        GlobSet set;
+        size_t index = begin + 1;
+        if (index < pattern.size() && (pattern[index] == '!' || pattern[index] == '^'))
+        {
+            set.negated_ = true;
+            ++index;
+        }
+
+        set.items_begin_ = index;
+
+        // A ] right after the opening bracket is a member
+        if (index < pattern.size() && pattern[index] == ']') ++index;
+        while (index < pattern.size() && pattern[index] != ']') ++index;
+        if (index == pattern.size()) return std::nullopt;
+
+        set.items_end_ = index;
+        set.end_ = index + 1;
+        return set;
+    }
+
+    [[nodiscard]] bool Contains(std::string_view pattern, char c) const
+    {
+        const char lower = ToLower(c);
+        const char upper = ToUpper(c);
+        bool found = false;
+        for (size_t index = items_begin_; index < items_end_ && !found; ++index)
+        {
+            const char first = pattern[index];
+            if (index + 2 < items_end_ && pattern[index + 1] == '-')
+            {
+                const char last = pattern[index + 2];
+                found = (lower >= first && lower <= last) || (upper >= first && upper <= last);
+                index += 2;
+            }
+            else
+            {
+                found = ToLower(first) == lower;
+            }
+        }
+
+        return found != negated_;
+    }
+
+    // Pattern index after the closing bracket
+    [[nodiscard]] size_t GetEnd() const { return end_; }
+
+private:
+    size_t items_begin_ = 0;
+    size_t items_end_ = 0;
+    size_t end_ = 0;
+    bool negated_ = false;
+};
+
+// Longest run of the glob without wildcards and sets, lowercase. Every matching name contains it
+[[nodiscard]] std::string GetGlobLiteral(std::string_view pattern)
+{
+    std::string_view longest;
+    size_t run_begin = 0;
+    auto end_run = [&](size_t run_end)
+    {
+        if (run_end - run_begin > longest.size()) longest = pattern.substr(run_begin, run_end - run_begin);
+    };
+
+    for (size_t index = 0; index < pattern.size();)
+    {
+        const char c = pattern[index];
+        std::optional<GlobSet> set;
+        if (c == '[') set = GlobSet::Parse(pattern, index);
+        if (c == '*' || c == '?' || set)
+        {
+            end_run(index);
+            index = set ? set->GetEnd() : index + 1;
+            run_begin = index;
+        }
+        else
+        {
+            ++index;
+        }
+    }
+
+    end_run(pattern.size());
+    return ToLower(longest);
+}
+
+// Query of a search as seen by the threads
+struct NamePattern
+{
+    std::string_view query;
+    NameSearchMode mode = NameSearchMode::Substring;
+    std::string_view literal;
+
+    [[nodiscard]] bool Matches(std::string_view name) const
+    {
+        return mode == NameSearchMode::Glob ? MatchesGlob(query, name) : ContainsIgnoreCase(name, literal);
+    }
+};
+
+// Calls on_candidate(position) for positions in [position, end) of the pool where the first and the last bytes of the
+// literal match in either case and the whole literal fits before end. It returns the position to continue from, which
+// skips candidates before it. Other bytes of the literal are not checked
+template <typename OnCandidate>
+void ForEachCandidate(
+    std::span<const char> pool,
+    size_t position,
+    size_t end,
+    std::string_view literal,
+    const OnCandidate& on_candidate)
+{
+    const size_t last_offset = literal.size() - 1;
+    const char first_lower = literal.front();
+    const char first_upper = ToUpper(first_lower);
+    const char last_lower = literal.back();
+    const char last_upper = ToUpper(last_lower);
+    const char* data = pool.data();
+
+#if defined(__SSE2__)
+    // All candidates of a register are visited before the next load, as short names make them dense
+    constexpr size_t kRegisterSize = sizeof(__m128i);
+    const __m128i first_lower_bytes = _mm_set1_epi8(first_lower);
+    const __m128i first_upper_bytes = _mm_set1_epi8(first_upper);
+    const __m128i last_lower_bytes = _mm_set1_epi8(last_lower);
+    const __m128i last_upper_bytes = _mm_set1_epi8(last_upper);
+    size_t resume_position = position;
+    for (; position + last_offset + kRegisterSize <= end; position += kRegisterSize)
+    {
+        if (resume_position >= position + kRegisterSize)
+        {
+            // Skipped names may span many registers
+            position = resume_position - kRegisterSize;
+            continue;
+        }
+
+        const __m128i firsts = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position));  // NOLINT
+        const __m128i lasts =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position + last_offset));  // NOLINT
+        const __m128i first_matches =
+            _mm_or_si128(_mm_cmpeq_epi8(firsts, first_lower_bytes), _mm_cmpeq_epi8(firsts, first_upper_bytes));
+        const __m128i last_matches =
+            _mm_or_si128(_mm_cmpeq_epi8(lasts, last_lower_bytes), _mm_cmpeq_epi8(lasts, last_upper_bytes));
+        for (auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(first_matches, last_matches)));
+             mask != 0;
+             mask &= mask - 1)
+        {
+            const size_t candidate = position + static_cast<size_t>(std::countr_zero(mask));
+            if (candidate >= resume_position) resume_position = on_candidate(candidate);
+        }
+    }
+
+    position = std::max(position, resume_position);
+#endif
+
+    while (position + last_offset < end)
+    {
+        const char first = data[position];               // NOLINT
+        const char last = data[position + last_offset];  // NOLINT
+        if ((first == first_lower || first == first_upper) && (last == last_lower || last == last_upper))
+        {
+            position = on_candidate(position);
+        }
+        else
+        {
+            ++position;
+        }
+    }
+}
+
+// Nodes [begin, end) whose names lie one after another in the pool
+void SearchNamesRun(
+    const TreeNodes::Columns& columns,
+    const NamePattern& pattern,
+    size_t begin,
+    size_t end,
+    std::vector<NodeId>& matches)
+{
+    const std::span<const uint64_t> offsets = columns.name_offsets;
+    const std::span<const uint16_t> lengths = columns.name_lengths;
+    const std::string_view literal = pattern.literal;
+    const size_t pool_end = offsets[end - 1] + lengths[end - 1];
+
+    size_t node_id = begin;
+    auto on_candidate = [&](size_t position)
+    {
+        // The candidate may span two names
+        while (offsets[node_id] + lengths[node_id] < position + literal.size()) ++node_id;
+        if (offsets[node_id] > position || !EqualsIgnoreCase(columns.names.data() + position, literal))  // NOLINT
+        {
+            return position + 1;
+        }
+
+        // Globs check the whole name, so any further candidates in it are skipped either way
+        const std::string_view name{columns.names.data() + offsets[node_id], lengths[node_id]};  // NOLINT
+        if (pattern.mode == NameSearchMode::Substring || MatchesGlob(pattern.query, name))
+        {
+            matches.push_back(static_cast<NodeId>(node_id));
+        }
+
+        return offsets[node_id] + lengths[node_id];
+    };
+
+    ForEachCandidate(columns.names, offsets[begin], pool_end, literal, on_candidate);
+}
+
+// Run starts are the nodes in (begin, end) whose names do not follow the name of the previous node, sorted
+void SearchNames(
+    const TreeNodes::Columns& columns,
+    const NamePattern& pattern,
+    size_t begin,
+    size_t end,
+    std::span<const NodeId> run_starts,
+    std::vector<NodeId>& matches)
+{
+    const std::span<const uint64_t> offsets = columns.name_offsets;
+    const std::span<const uint16_t> lengths = columns.name_lengths;
+
+    // Globs made only of wildcards have nothing to filter by
+    if (pattern.literal.empty())
+    {
+        for (const size_t node_id : std::views::iota(begin, end))
+        {
+            const std::string_view name{columns.names.data() + offsets[node_id], lengths[node_id]};  // NOLINT
+            if (MatchesGlob(pattern.query, name)) matches.push_back(static_cast<NodeId>(node_id));
+        }
+
+        return;
+    }
+
+    size_t run_begin = begin;
+    for (const NodeId run_end : run_starts)
+    {
+        SearchNamesRun(columns, pattern, run_begin, run_end, matches);
+        run_begin = run_end;
+    }
+
+    SearchNamesRun(columns, pattern, run_begin, end, matches);
+}
+
+// Names of consecutive nodes follow each other in the pool, except those renamed later, which are at its end
+void FindNameRunStarts(const TreeNodes::Columns& columns, size_t begin, size_t end, std::vector<NodeId>& run_starts)
+{
+    const std::span<const uint64_t> offsets = columns.name_offsets;
+    const std::span<const uint16_t> lengths = columns.name_lengths;
+    for (const size_t node_id : std::views::iota(std::max(begin, size_t{1}), end))
+    {
+        if (offsets[node_id] != offsets[node_id - 1] + lengths[node_id - 1])
+        {
+            run_starts.push_back(static_cast<NodeId>(node_id));
+        }
+    }
+}
+
+}  // namespace
+
+bool MatchesGlob(std::string_view pattern, std::string_view name)
+{
+    // The last * and where it started matching, so that a failed match lets it take one more character
+    size_t pattern_index = 0;
+    size_t name_index = 0;
+    size_t star_index = kNoPosition;
+    size_t star_name_index = 0;
+    while (name_index < name.size())
+    {
+        if (pattern_index < pattern.size())
+        {
+            const char c = pattern[pattern_index];
+            if (c == '*')
+            {
+                star_index = pattern_index++;
+                star_name_index = name_index;
+                continue;
+            }
+
+            bool matched = false;
+            size_t next_pattern_index = pattern_index + 1;
+            if (c == '?')
+            {
+                matched = true;
+            }
+            else if (const std::optional<GlobSet> set = c == '[' ? GlobSet::Parse(pattern, pattern_index)
+                                                                 : std::nullopt)
+            {
+                matched = set->Contains(pattern, name[name_index]);
+                next_pattern_index = set->GetEnd();
+            }
+            else
+            {
+                matched = ToLower(c) == ToLower(name[name_index]);
+            }
+
+            if (matched)
+            {
+                pattern_index = next_pattern_index;
+                ++name_index;
+                continue;
+            }
+        }
+
+        if (star_index == kNoPosition) return false;
+        pattern_index = star_index + 1;
+        name_index = ++star_name_index;
+    }
+
+    while (pattern_index < pattern.size() && pattern[pattern_index] == '*') ++pattern_index;
+    return pattern_index == pattern.size();
+}
+
+NameSearchMode NameSearch::GetQueryMode(std::string_view query)
+{
+    return query.find_first_of("*?[") != std::string_view::npos ? NameSearchMode::Glob : NameSearchMode::Substring;
+}
+
+void NameSearch::SetQuery(std::string_view query)
+{
+    if (query == query_) return;
+
+    const NameSearchMode mode = GetQueryMode(query);
+    std::string literal = mode == NameSearchMode::Glob ? GetGlobLiteral(query) : ToLower(query);
+    const bool narrows = !query_.empty() && mode_ == NameSearchMode::Substring && mode == NameSearchMode::Substring &&
+                         literal.find(literal_) != std::string::npos;
+
+    query_ = query;
+    mode_ = mode;
+    literal_ = std::move(literal);
+    if (narrows)
+    {
+        filter_matches_ = true;
+    }
+    else
+    {
+        ResetMatches();
+    }
+}
+
+void NameSearch::Restart()
+{
+    ResetMatches();
+    name_run_starts_.clear();
+    checked_name_runs_count_ = 0;
+}
+
+void NameSearch::ResetMatches()
+{
+    matches_.clear();
+    next_node_ = 0;
+    filter_matches_ = false;
+}
+
+void NameSearch::Update(const TreeNodes& nodes, std::chrono::nanoseconds time_budget, size_t thread_count)
+{
+    if (query_.empty()) return;
+
+    TRACE_SCOPE("NameSearch::Update");
+    const auto start_time = std::chrono::steady_clock::now();
+    const NamePattern pattern{.query = query_, .mode = mode_, .literal = literal_};
+    if (filter_matches_)
+    {
+        std::erase_if(matches_, [&](NodeId node_id) { return !pattern.Matches(nodes.GetName(node_id)); });
+        filter_matches_ = false;
+    }
+
+    const TreeNodes::Columns columns = nodes.GetColumns();
+    while (next_node_ < nodes.Size())
+    {
+        const size_t slice_end = std::min(next_node_ + kSliceNodes, nodes.Size());
+        const size_t slice_size = slice_end - next_node_;
+        const size_t chunks_count = (slice_size + kChunkNodes - 1) / kChunkNodes;
+        if (chunk_results_.size() < chunks_count) chunk_results_.resize(chunks_count);
+
+        // Run starts are found by the first search over the nodes and kept for the next queries
+        ForEachChunk(
+            slice_size,
+            kChunkNodes,
+            GetPassThreadCount(slice_size, thread_count, kMinParallelNodes),
+            [&](size_t begin, size_t end)
+            {
+                ChunkResults& results = chunk_results_[begin / kChunkNodes];
+                results.matches.clear();
+                results.run_starts.clear();
+                begin += next_node_;
+                end += next_node_;
+
+                std::span<const NodeId> run_starts;
+                if (end <= checked_name_runs_count_)
+                {
+                    run_starts = std::span{
+                        std::ranges::upper_bound(name_run_starts_, begin),
+                        std::ranges::lower_bound(name_run_starts_, end)};
+                }
+                else
+                {
+                    FindNameRunStarts(columns, begin, end, results.run_starts);
+                    run_starts = results.run_starts;
+                    if (!run_starts.empty() && run_starts.front() == begin) run_starts = run_starts.subspan(1);
+                }
+
+                SearchNames(columns, pattern, begin, end, run_starts, results.matches);
+            });
+
+        for (const ChunkResults& results : std::span{chunk_results_}.first(chunks_count))
+        {
+            matches_.insert(matches_.end(), results.matches.begin(), results.matches.end());
+            for (const NodeId node_id : results.run_starts)
+            {
+                if (node_id >= checked_name_runs_count_) name_run_starts_.push_back(node_id);
+            }
+        }
+
+        checked_name_runs_count_ = std::max(checked_name_runs_count_, slice_end);
+
+        next_node_ = slice_end;
+        if (std::chrono::steady_clock::now() - start_time >= time_budget) break;
+    }
+
+    TRACE_COUNTER("Name search matches", matches_.size());
+}
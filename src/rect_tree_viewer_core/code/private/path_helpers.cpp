@@ -0,0 +1,146 @@
+#include "path_helpers.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <ranges>
+
+#include "klgl/error_handling.hpp"
+
+#ifdef WIN32
+
+#include "Windows.h"
+
+std::string PathHelpers::StringToUTF8(const std::wstring_view& wstr)
+{
+    // Determine the required buffer size for the UTF-8 string
+    int utf8Length = WideCharToMultiByte(
+        CP_UTF8,      // Code page: UTF-8
+        0,            // Flags
+        wstr.data(),  // Source wide string
+        -1,           // Null-terminated input
+        nullptr,      // No output buffer yet
+        0,            // Get buffer size
+        nullptr,
+        nullptr  // Default character handling
+    );
+
+    klgl::ErrorHandling::Ensure(utf8Length != 0, "WideCharToMultiByte failed!");
+
+    // Allocate the output string
+    std::string utf8String(utf8Length - 1, '\0');  // Exclude the null terminator
+
+    // Perform the conversion
+    WideCharToMultiByte(
+        CP_UTF8,
+        0,
+        wstr.data(),
+        -1,
+        utf8String.data(),  // Output buffer
+        utf8Length,
+        nullptr,
+        nullptr);
+
+    return utf8String;
+}
+
+[[nodiscard]] std::string PathHelpers::PathToUTF8(const std::filesystem::path& path)
+{
+    return StringToUTF8(path.wstring());
+}
+
+std::FILE* PathHelpers::OpenFileForWriting(const std::filesystem::path& path)
+{
+    return _wfopen(path.c_str(), L"wb");
+}
+
+#else
+
+std::string PathHelpers::StringToUTF8([[maybe_unused]] const std::wstring_view& wstr)
+{
+    throw klgl::ErrorHandling::RuntimeErrorWithMessage("Not implemented");
+}
+
+[[nodiscard]] std::string PathHelpers::PathToUTF8(const std::filesystem::path& path)
+{
+    return path.string();
+}
+
+std::FILE* PathHelpers::OpenFileForWriting(const std::filesystem::path& path)
+{
+    return std::fopen(path.c_str(), "wb");
+}
+
+#endif
+
+std::filesystem::path PathHelpers::PathFromUTF8(std::string_view str)
+{
+    return std::u8string_view{reinterpret_cast<const char8_t*>(str.data()), str.size()};  // NOLINT
+}
+
+std::string PathHelpers::GetNodeFullPath(
+    const TreeNodes& nodes,
+    std::span<const std::filesystem::path> root_paths,
+    const std::unordered_map<NodeId, size_t>& root_node_id_to_path_index,
+    NodeId in_node_id)
+{
+    NodeFullPathCache cache;
+    cache.SetRoots(root_paths, root_node_id_to_path_index);
+    return std::string{cache.GetFullPath(nodes, in_node_id)};
+}
+
+void NodeFullPathCache::SetRoots(
+    std::span<const std::filesystem::path> root_paths,
+    const std::unordered_map<NodeId, size_t>& root_node_id_to_path_index)
+{
+    root_paths_.clear();
+    for (const std::filesystem::path& root_path : root_paths)
+    {
+        std::string& path = root_paths_.emplace_back(PathHelpers::PathToUTF8(root_path));
+        std::ranges::replace(path, '\\', '/');
+    }
+
+    roots_.clear();
+    for (const auto& [node_id, path_index] : root_node_id_to_path_index)
+    {
+        roots_.push_back({.node_id = node_id, .path_index = static_cast<uint32_t>(path_index)});
+    }
+
+    std::ranges::sort(roots_, std::less{}, &Root::node_id);
+    max_root_node_id_ = roots_.empty() ? 0 : roots_.back().node_id;
+    Invalidate();
+}
+
+const NodeFullPathCache::Root* NodeFullPathCache::FindRoot(NodeId node_id) const
+{
+    // Roots come first in scanned trees, most ancestors are rejected without a search
+    if (roots_.empty() || node_id > max_root_node_id_) return nullptr;
+
+    const auto it = std::ranges::lower_bound(roots_, node_id, std::less{}, &Root::node_id);
+    return it != roots_.end() && it->node_id == node_id ? &*it : nullptr;
+}
+
+std::string_view NodeFullPathCache::GetFullPath(const TreeNodes& nodes, NodeId node_id)
+{
+    if (node_id == cached_node_id_) return path_;
+
+    // Ancestors up to the root, the node first
+    ancestors_.clear();
+    const Root* root = nullptr;
+    for (NodeId ancestor = node_id; ancestor != kInvalidNodeId; ancestor = nodes.GetParent(ancestor))
+    {
+        root = FindRoot(ancestor);
+        if (root) break;
+        ancestors_.push_back(ancestor);
+    }
+
+    path_.clear();
+    if (root) path_ += root_paths_[root->path_index];
+    for (const NodeId ancestor : ancestors_ | std::views::reverse)
+    {
+        if (!path_.empty()) path_ += '/';
+        path_ += nodes.GetName(ancestor);
+    }
+
+    cached_node_id_ = node_id;
+    return path_;
+}
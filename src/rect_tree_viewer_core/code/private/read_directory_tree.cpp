@@ -0,0 +1,1516 @@
+#include "read_directory_tree.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <stop_token>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+
+#include "fmt/chrono.h"
+#include "fmt/format.h"
+#include "io_uring_directory_lister.hpp"
+#include "klgl/error_handling.hpp"
+#include "linux_directory_lister.hpp"
+#include "path_helpers.hpp"
+#include "storage_device.hpp"
+#include "tracing.hpp"
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+// Address of a node before merge: index of the batch (worker) that created it and index inside that batch
+struct ScanNodeRef
+{
+    uint32_t batch = 0;
+    uint32_t index = 0;
+
+    [[nodiscard]] bool IsValid() const { return batch != kInvalidNodeId; }
+    [[nodiscard]] bool operator==(const ScanNodeRef&) const = default;
+
+    // Key of the node in ReadDirectoryTreeListing
+    [[nodiscard]] uint64_t ToKey() const
+    {
+        return IsValid() ? (uint64_t{batch} << 32) | index : ReadDirectoryTreeListing::kNoParent;
+    }
+};
+
+inline constexpr ScanNodeRef kInvalidScanNodeRef{.batch = kInvalidNodeId, .index = kInvalidNodeId};
+
+// Nodes created by one worker. Names are packed the same way as in TreeNodes
+class ScanBatch
+{
+public:
+    [[nodiscard]] size_t Size() const { return values.size(); }
+
+    [[nodiscard]] std::string_view GetName(uint32_t index) const
+    {
+        const size_t name_begin = index == 0 ? 0 : name_ends[index - 1];
+        return std::string_view{names}.substr(name_begin, name_ends[index] - name_begin);
+    }
+
+    uint32_t Add(std::string_view name, uint64_t value, ScanNodeRef parent)
+    {
+        klgl::ErrorHandling::Ensure(Size() < kInvalidNodeId, "Too many nodes in one scan batch");
+        names.append(name);
+        name_ends.push_back(names.size());
+        values.push_back(value);
+        parents.push_back(parent);
+        return static_cast<uint32_t>(Size() - 1);
+    }
+
+    // Adds a node that stands for folded files
+    uint32_t AddAggregate(std::string_view name, uint64_t value, ScanNodeRef parent, uint64_t files_count)
+    {
+        const uint32_t index = Add(name, value, parent);
+        aggregates.emplace_back(index, files_count);
+        return index;
+    }
+
+    // Zero for nodes that are not aggregates
+    [[nodiscard]] uint64_t GetAggregatedFilesCount(uint32_t index) const
+    {
+        const auto it = std::ranges::lower_bound(aggregates, index, std::less{}, &std::pair<uint32_t, uint64_t>::first);
+        return it != aggregates.end() && it->first == index ? it->second : 0;
+    }
+
+    void Clear()
+    {
+        names.clear();
+        name_ends.clear();
+        values.clear();
+        parents.clear();
+        aggregates.clear();
+        directory_stamps.clear();
+        unexpanded_directories.clear();
+    }
+
+    std::string names;
+    std::vector<uint64_t> name_ends;
+    std::vector<uint64_t> values;
+    std::vector<ScanNodeRef> parents;
+
+    // Aggregate nodes and the number of files behind each one, sorted by index
+    std::vector<std::pair<uint32_t, uint64_t>> aggregates;
+
+    // Directories listed by the worker that owns this batch. They may have been created by other workers
+    std::vector<std::pair<ScanNodeRef, DirectoryStamp>> directory_stamps;
+
+    // Directories left unlisted by the depth or time budget, they have zero stamps too
+    std::vector<ScanNodeRef> unexpanded_directories;
+};
+
+// Portable lister on top of std::filesystem. Entry types come from the directory iterator cache where the platform
+// provides one, so usually only regular files cost an extra stat. Symbolic links are not followed. Directory stamps
+// have only the modification time because std::filesystem does not expose inodes and change times.
+class FilesystemDirectoryLister
+{
+public:
+    struct Task
+    {
+        fs::path path;
+    };
+
+    struct Directory
+    {
+        fs::path path;
+        DirectoryStamp stamp;
+    };
+
+    [[nodiscard]] static Task MakeRootTask(const fs::path& path) { return {.path = path}; }
+
+    [[nodiscard]] static Task MakeChildTask(const Directory& directory, std::string_view name)
+    {
+        return {.path = directory.path / PathHelpers::PathFromUTF8(name)};
+    }
+
+    [[nodiscard]] static std::optional<Directory> Open(const Task& task, ReadDirectoryTreeSyscalls& syscalls)
+    {
+        std::error_code err;
+        ++syscalls.stat_calls;
+        const fs::file_time_type modification_time = fs::last_write_time(task.path, err);
+        if (err) return std::nullopt;
+
+        const auto since_epoch = modification_time.time_since_epoch();
+        return Directory{
+            .path = task.path,
+            .stamp = {.modification_time = std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count()},
+        };
+    }
+
+    template <typename AddFile, typename AddDirectory>
+    static void List(
+        const Directory& directory,
+        ReadDirectoryTreeSyscalls& syscalls,
+        AddFile&& add_file,
+        AddDirectory&& add_directory)
+    {
+        std::error_code err;
+        ++syscalls.open_calls;
+        fs::directory_iterator it(directory.path, err);
+        if (err) return;
+
+        for (; !err && it != fs::directory_iterator{}; it.increment(err))
+        {
+            ++syscalls.read_directory_calls;
+
+            std::error_code entry_err;
+            const fs::file_status status = it->symlink_status(entry_err);
+            if (entry_err) continue;
+
+            if (fs::is_regular_file(status))
+            {
+                ++syscalls.stat_calls;
+                const uint64_t file_size = it->file_size(entry_err);
+                add_file(PathHelpers::PathToUTF8(it->path().filename()), entry_err ? 0 : file_size);
+            }
+            else if (fs::is_directory(status))
+            {
+                add_directory(PathHelpers::PathToUTF8(it->path().filename()), Task{.path = it->path()});
+            }
+        }
+    }
+};
+
+template <typename Task>
+struct ScanTask
+{
+    Task task;
+    ScanNodeRef node;
+
+    // Same directory in the previous tree
+    NodeId previous_node = kInvalidNodeId;
+
+    // Root paths are at depth 1
+    size_t depth = 1;
+
+    // Queues of the device the directory is on, see DeviceScanQueues
+    uint32_t device_slot = 0;
+};
+
+template <typename Task>
+struct ScanTaskQueue
+{
+    std::mutex mutex;
+    std::deque<ScanTask<Task>> tasks;
+};
+
+// Directories of one device waiting to be listed. Every worker pushes to its own queue, takes its newest task and
+// steals the oldest ones of the others. At most concurrency_limit directories of the device are listed at once.
+template <typename Task>
+class DeviceScanQueues
+{
+public:
+    DeviceScanQueues(uint64_t in_device, StorageDeviceKind in_kind, size_t in_concurrency_limit, size_t workers_count)
+        : device(in_device),
+          kind(in_kind),
+          concurrency_limit(in_concurrency_limit),
+          worker_queues(workers_count)
+    {
+    }
+
+    // Takes one of the concurrency_limit slots
+    [[nodiscard]] bool TryAcquire()
+    {
+        size_t current = active_count.load(std::memory_order_relaxed);
+        while (current < concurrency_limit)
+        {
+            if (active_count.compare_exchange_weak(current, current + 1, std::memory_order_acquire))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void Release() { active_count.fetch_sub(1, std::memory_order_release); }
+
+    uint64_t device = 0;
+    StorageDeviceKind kind = StorageDeviceKind::Unknown;
+    size_t concurrency_limit = 0;
+    std::atomic<size_t> active_count = 0;
+    std::atomic<size_t> queued_count = 0;
+    std::vector<ScanTaskQueue<Task>> worker_queues;
+
+    // Times are in nanoseconds since the start of the walk
+    std::atomic<size_t> directories_count = 0;
+    std::atomic<size_t> entries_count = 0;
+    std::atomic<int64_t> busy_time = 0;
+    std::atomic<int64_t> first_start_time = std::numeric_limits<int64_t>::max();
+    std::atomic<int64_t> last_end_time = 0;
+};
+
+template <typename Value>
+void UpdateMinimum(std::atomic<Value>& minimum, Value value)
+{
+    Value current = minimum.load(std::memory_order_relaxed);
+    while (value < current && !minimum.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+template <typename Value>
+void UpdateMaximum(std::atomic<Value>& maximum, Value value)
+{
+    Value current = maximum.load(std::memory_order_relaxed);
+    while (value > current && !maximum.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+template <typename Task>
+struct ScanWorker
+{
+    // Only the owning thread appends here
+    ScanBatch nodes;
+
+    ReadDirectoryTreeSyscalls syscalls;
+    size_t directories_count = 0;
+    size_t reused_directories_count = 0;
+    size_t stolen_tasks_count = 0;
+
+    // Used only with a listener: subdirectories are queued after their parent is reported
+    ReadDirectoryTreeListing listing;
+    std::vector<ScanTask<Task>> deferred_tasks;
+
+    // Used only with a node budget: files of the directory being listed, they are kept or folded once it is done
+    ScanBatch pending_files;
+};
+
+// Files are folded by size classes during the scan: the class of a size is its bit width
+inline constexpr size_t kSizeClassesCount = 65;
+
+[[nodiscard]] uint32_t GetSizeClass(uint64_t size)
+{
+    return static_cast<uint32_t>(std::bit_width(size));
+}
+
+template <typename Lister>
+class ParallelDirectoryScanner
+{
+public:
+    using Task = typename Lister::Task;
+    using Directory = typename Lister::Directory;
+
+    ParallelDirectoryScanner(size_t thread_count, const ReadDirectoryTreeParams& params)
+        : workers_(thread_count),
+          previous_nodes_(params.previous_tree.nodes),
+          listener_(params.listener),
+          stop_token_(params.stop_token),
+          node_budget_(params.node_budget),
+          min_file_fraction_(params.min_file_fraction),
+          max_depth_(params.max_depth),
+          rotational_device_concurrency_(params.rotational_device_concurrency),
+          other_device_concurrency_(params.other_device_concurrency)
+    {
+        if (params.time_budget != std::chrono::milliseconds{})
+        {
+            deadline_ = std::chrono::steady_clock::now() + params.time_budget;
+        }
+
+        // Listers with state get their own per thread
+        listers_.reserve(thread_count);
+        for ([[maybe_unused]] const size_t worker_index : std::views::iota(size_t{0}, thread_count))
+        {
+            if constexpr (std::is_constructible_v<Lister, const ReadDirectoryTreeParams&>)
+            {
+                listers_.emplace_back(params);
+            }
+            else
+            {
+                listers_.emplace_back();
+            }
+        }
+    }
+
+    // Must be called before Run
+    ScanNodeRef AddNode(std::string_view name, uint64_t value, ScanNodeRef parent)
+    {
+        return {.batch = 0, .index = workers_.front().nodes.Add(name, value, parent)};
+    }
+
+    // Must be called before Run
+    void AddRootTask(const fs::path& path, ScanNodeRef node, NodeId previous_node)
+    {
+        PushTask(
+            0,
+            {
+                .task = Lister::MakeRootTask(path),
+                .node = node,
+                .previous_node = previous_node,
+                .depth = 1,
+                .device_slot = GetDeviceSlot(GetPathDevice(path).value_or(0)),
+            });
+    }
+
+    // Must be called before Run. Reports nodes added with AddNode to the listener, grouped by parent. Nodes with
+    // root tasks and parents of other added nodes are reported as directories.
+    void ReportAddedNodes()
+    {
+        if (!listener_) return;
+
+        ScanWorker<Task>& worker = workers_.front();
+        const auto nodes_count = static_cast<uint32_t>(worker.nodes.Size());
+        std::vector<bool> is_directory(nodes_count);
+        ForEachQueuedTask([&](size_t, const ScanTask<Task>& task) { is_directory[task.node.index] = true; });
+        for (const ScanNodeRef parent : worker.nodes.parents)
+        {
+            if (parent.IsValid()) is_directory[parent.index] = true;
+        }
+
+        for (uint32_t begin = 0, end = 0; begin != nodes_count; begin = end)
+        {
+            const ScanNodeRef parent = worker.nodes.parents[begin];
+            while (end != nodes_count && worker.nodes.parents[end] == parent) ++end;
+
+            FillListing(worker.listing, 0, parent, begin, end);
+            for (const uint32_t index : std::views::iota(begin, end))
+            {
+                if (is_directory[index]) worker.listing.directories.push_back(index - begin);
+            }
+
+            listener_->OnDirectoryListed(worker.listing);
+        }
+    }
+
+    void Run()
+    {
+        walk_start_ = std::chrono::steady_clock::now();
+        {
+            // Idle workers wait for new tasks, a cancelled scan has to wake them
+            const std::stop_callback wake_on_stop(stop_token_, [this] { WakeIdleWorkers(); });
+
+            // The calling thread is worker 0. Other threads are joined on scope exit
+            std::vector<std::jthread> threads;
+            threads.reserve(workers_.size() - 1);
+            for (const size_t worker_index : std::views::iota(size_t{1}, workers_.size()))
+            {
+                threads.emplace_back([this, worker_index] { RunWorker(worker_index); });
+            }
+
+            RunWorker(0);
+        }
+
+        // Directories left in queues by a cancelled scan
+        ForEachQueuedTask(
+            [&](size_t worker_index, const ScanTask<Task>& task)
+            {
+                workers_[worker_index].nodes.directory_stamps.emplace_back(task.node, DirectoryStamp{});
+            });
+
+        for (const uint32_t device_slot : std::views::iota(uint32_t{0}, devices_count_.load()))
+        {
+            for (ScanTaskQueue<Task>& queue : devices_[device_slot]->worker_queues) queue.tasks.clear();
+        }
+    }
+
+    // Concatenates worker batches and renumbers nodes in breadth-first order
+    TreeNodes Merge()
+    {
+        std::vector<size_t> batch_offsets;
+        batch_offsets.reserve(workers_.size());
+        size_t nodes_count = 0;
+        size_t names_size = 0;
+        for (const ScanWorker<Task>& worker : workers_)
+        {
+            batch_offsets.push_back(nodes_count);
+            nodes_count += worker.nodes.Size();
+            names_size += worker.nodes.names.size();
+        }
+
+        auto flat_id = [&](const ScanNodeRef& ref)
+        {
+            return batch_offsets[ref.batch] + ref.index;
+        };
+
+        auto get_parent = [&](const ScanNodeRef& ref)
+        {
+            return workers_[ref.batch].nodes.parents[ref.index];
+        };
+
+        // Children of every node in compressed form: children of flat node i are
+        // flat_children[child_offsets[i]..child_offsets[i + 1]) in creation order
+        std::vector<size_t> child_offsets(nodes_count + 1, 0);
+        ForEachNode(
+            [&](const ScanNodeRef& ref)
+            {
+                if (const ScanNodeRef parent = get_parent(ref); parent.IsValid()) ++child_offsets[flat_id(parent) + 1];
+            });
+
+        for (const size_t i : std::views::iota(size_t{0}, nodes_count))
+        {
+            child_offsets[i + 1] += child_offsets[i];
+        }
+
+        std::vector<ScanNodeRef> flat_children(child_offsets.back());
+        {
+            std::vector<size_t> cursors(child_offsets.begin(), std::prev(child_offsets.end()));
+            ForEachNode(
+                [&](const ScanNodeRef& ref)
+                {
+                    if (const ScanNodeRef parent = get_parent(ref); parent.IsValid())
+                    {
+                        flat_children[cursors[flat_id(parent)]++] = ref;
+                    }
+                });
+        }
+
+        // Every listed directory has a stamp, the common root does not, so root paths are never folded
+        std::vector<bool> is_directory(nodes_count);
+        for (const ScanWorker<Task>& worker : workers_)
+        {
+            for (const auto& [ref, stamp] : worker.nodes.directory_stamps) is_directory[flat_id(ref)] = true;
+        }
+
+        auto get_value = [&](const ScanNodeRef& ref)
+        {
+            return workers_[ref.batch].nodes.values[ref.index];
+        };
+
+        auto get_name = [&](const ScanNodeRef& ref)
+        {
+            return workers_[ref.batch].nodes.GetName(ref.index);
+        };
+
+        auto get_aggregated_files_count = [&](const ScanNodeRef& ref)
+        {
+            return workers_[ref.batch].nodes.GetAggregatedFilesCount(ref.index);
+        };
+
+        // Files below the threshold are folded, as well as aggregate nodes folded during the scan. A directory with
+        // only one such file keeps it as is
+        const uint64_t fold_threshold = GetFoldThreshold(
+            is_directory,
+            [&](auto&& callback)
+            {
+                ForEachNode(
+                    [&](const ScanNodeRef& ref)
+                    {
+                        const ScanNodeRef parent = get_parent(ref);
+                        if (parent.IsValid() && is_directory[flat_id(parent)] && !is_directory[flat_id(ref)])
+                        {
+                            callback(flat_id(parent), get_value(ref), get_aggregated_files_count(ref) != 0);
+                        }
+                    });
+            });
+        const bool fold_files = fold_threshold != 0 || node_budget_ != 0;
+        auto is_foldable = [&](const ScanNodeRef& ref)
+        {
+            if (is_directory[flat_id(ref)]) return false;
+            return get_value(ref) < fold_threshold || get_aggregated_files_count(ref) != 0;
+        };
+
+        // Breadth-first renumbering. order[node_id] is the scan address of the node, aggregate nodes have none
+        TreeNodes nodes;
+        nodes.Reserve(nodes_count, names_size);
+        std::vector<ScanNodeRef> order;
+        order.reserve(nodes_count);
+        std::vector<NodeId> flat_to_node_id(nodes_count, kInvalidNodeId);
+
+        auto add_node = [&](const ScanNodeRef& ref, NodeId parent)
+        {
+            flat_to_node_id[flat_id(ref)] = static_cast<NodeId>(order.size());
+            order.push_back(ref);
+            const NodeId node_id = nodes.Add(get_name(ref), get_value(ref), parent);
+            if (const uint64_t aggregated_files_count = get_aggregated_files_count(ref); aggregated_files_count != 0)
+            {
+                nodes.AddAggregate(node_id, aggregated_files_count);
+                ++aggregate_nodes_count_;
+                folded_files_count_ += aggregated_files_count;
+            }
+
+            return node_id;
+        };
+
+        aggregate_nodes_count_ = 0;
+        folded_files_count_ = 0;
+        ForEachNode(
+            [&](const ScanNodeRef& ref)
+            {
+                if (!get_parent(ref).IsValid()) add_node(ref, kInvalidNodeId);
+            });
+
+        for (NodeId node_id = 0; node_id != order.size(); ++node_id)
+        {
+            if (!order[node_id].IsValid()) continue;
+
+            const size_t children_begin = child_offsets[flat_id(order[node_id])];
+            const size_t children_end = child_offsets[flat_id(order[node_id]) + 1];
+            if (children_begin == children_end) continue;
+
+            const std::span<const ScanNodeRef> children{
+                flat_children.begin() + static_cast<std::ptrdiff_t>(children_begin),
+                flat_children.begin() + static_cast<std::ptrdiff_t>(children_end)};
+            const bool fold_children =
+                fold_files && is_directory[flat_id(order[node_id])] && std::ranges::count_if(children, is_foldable) > 1;
+
+            const auto first_child = static_cast<NodeId>(order.size());
+            uint64_t folded_value = 0;
+            uint64_t folded_files_count = 0;
+            for (const ScanNodeRef& child : children)
+            {
+                if (fold_children && is_foldable(child))
+                {
+                    folded_value += get_value(child);
+                    folded_files_count += std::max(get_aggregated_files_count(child), uint64_t{1});
+                    continue;
+                }
+
+                add_node(child, node_id);
+            }
+
+            if (folded_files_count != 0)
+            {
+                order.push_back(kInvalidScanNodeRef);
+                const NodeId aggregate_id = nodes.Add(MakeAggregateNodeName(folded_files_count), folded_value, node_id);
+                nodes.AddAggregate(aggregate_id, folded_files_count);
+                ++aggregate_nodes_count_;
+                folded_files_count_ += folded_files_count;
+            }
+
+            nodes.SetFirstChild(node_id, first_child);
+            for (const NodeId child_id : std::views::iota(first_child, static_cast<NodeId>(order.size() - 1)))
+            {
+                nodes.SetNextSibling(child_id, child_id + 1);
+            }
+        }
+
+        std::vector<std::pair<NodeId, DirectoryStamp>> directory_stamps;
+        for (const ScanWorker<Task>& worker : workers_)
+        {
+            for (const auto& [ref, stamp] : worker.nodes.directory_stamps)
+            {
+                directory_stamps.emplace_back(flat_to_node_id[flat_id(ref)], stamp);
+            }
+        }
+
+        std::ranges::sort(directory_stamps, std::less{}, &std::pair<NodeId, DirectoryStamp>::first);
+        for (const auto& [node_id, stamp] : directory_stamps)
+        {
+            nodes.AddDirectoryStamp(node_id, stamp);
+        }
+
+        unexpanded_nodes_.clear();
+        for (const ScanWorker<Task>& worker : workers_)
+        {
+            for (const ScanNodeRef& ref : worker.nodes.unexpanded_directories)
+            {
+                unexpanded_nodes_.push_back(flat_to_node_id[flat_id(ref)]);
+            }
+        }
+
+        std::ranges::sort(unexpanded_nodes_);
+        return nodes;
+    }
+
+    // Sorted, valid after Merge
+    [[nodiscard]] std::span<const NodeId> GetUnexpandedNodes() const { return unexpanded_nodes_; }
+
+    void FillStats(ReadDirectoryTreeStats& stats) const
+    {
+        stats.thread_count = workers_.size();
+        for (const ScanWorker<Task>& worker : workers_)
+        {
+            stats.syscalls += worker.syscalls;
+            stats.nodes_count += worker.nodes.Size();
+            stats.directories_count += worker.directories_count;
+            stats.reused_directories_count += worker.reused_directories_count;
+            stats.stolen_tasks_count += worker.stolen_tasks_count;
+        }
+
+        stats.unexpanded_directories_count = unexpanded_nodes_.size();
+        stats.devices.clear();
+        for (const uint32_t device_slot : std::views::iota(uint32_t{0}, devices_count_.load()))
+        {
+            const DeviceScanQueues<Task>& device = *devices_[device_slot];
+            const size_t directories_count = device.directories_count.load();
+            const int64_t first_start_time = device.first_start_time.load();
+            const int64_t last_end_time = device.last_end_time.load();
+            stats.devices.push_back({
+                .device = device.device,
+                .kind = device.kind,
+                .concurrency_limit = device.concurrency_limit,
+                .directories_count = directories_count,
+                .entries_count = device.entries_count.load(),
+                .busy_duration = std::chrono::nanoseconds{device.busy_time.load()},
+                .active_duration =
+                    std::chrono::nanoseconds{directories_count != 0 ? last_end_time - first_start_time : 0},
+            });
+        }
+
+        stats.aggregate_nodes_count = aggregate_nodes_count_;
+        stats.folded_files_count = folded_files_count_;
+        stats.cancelled = stop_token_.stop_requested();
+    }
+
+private:
+    // Files smaller than the returned value are folded by Merge. for_each_file calls its callback with the flat id of
+    // the parent, the value and whether it is an aggregate node for every file in a listed directory
+    template <typename ForEachFile>
+    [[nodiscard]] uint64_t GetFoldThreshold(const std::vector<bool>& is_directory, ForEachFile&& for_each_file) const
+    {
+        uint64_t threshold = 0;
+        if (min_file_fraction_ > 0)
+        {
+            // Directories have no values of their own before propagation
+            uint64_t total_value = 0;
+            ForEachNode([&](const ScanNodeRef& ref) { total_value += workers_[ref.batch].nodes.values[ref.index]; });
+            threshold = static_cast<uint64_t>(std::ceil(min_file_fraction_ * static_cast<double>(total_value)));
+        }
+
+        if (node_budget_ != 0)
+        {
+            std::vector<uint64_t> file_values;
+            std::vector<bool> has_files(is_directory.size());
+            for_each_file(
+                [&](size_t parent, uint64_t value, bool is_aggregate)
+                {
+                    // Aggregate nodes are folded anyway, into the node reserved for their directory. Competing with
+                    // files for the rest would fold more on every incremental scan that reuses them
+                    if (!is_aggregate) file_values.push_back(value);
+                    has_files[parent] = true;
+                });
+
+            // Directories stay and each one with files may get an aggregate node, the largest files take the rest
+            const auto reserved_count = static_cast<size_t>(
+                std::count(is_directory.begin(), is_directory.end(), true) +
+                std::count(has_files.begin(), has_files.end(), true));
+            const size_t kept_files_count = node_budget_ > reserved_count ? node_budget_ - reserved_count : 0;
+            if (file_values.size() > kept_files_count)
+            {
+                const auto nth = file_values.begin() + static_cast<std::ptrdiff_t>(kept_files_count);
+                std::ranges::nth_element(file_values, nth, std::greater{});
+                threshold = std::max(threshold, *nth + 1);
+            }
+        }
+
+        return threshold;
+    }
+
+    // Visits nodes of all batches in creation order
+    template <typename Callback>
+    void ForEachNode(Callback&& callback) const
+    {
+        for (const uint32_t batch : std::views::iota(uint32_t{0}, static_cast<uint32_t>(workers_.size())))
+        {
+            const auto batch_size = static_cast<uint32_t>(workers_[batch].nodes.Size());
+            for (const uint32_t index : std::views::iota(uint32_t{0}, batch_size))
+            {
+                callback(ScanNodeRef{.batch = batch, .index = index});
+            }
+        }
+    }
+
+    // Slot of the device in devices_, added on first use. Devices past kMaxDevices share the last slot
+    uint32_t GetDeviceSlot(uint64_t device)
+    {
+        auto find_slot = [&](uint32_t devices_count) -> std::optional<uint32_t>
+        {
+            for (const uint32_t device_slot : std::views::iota(uint32_t{0}, devices_count))
+            {
+                if (devices_[device_slot]->device == device) return device_slot;
+            }
+
+            return std::nullopt;
+        };
+
+        if (const auto device_slot = find_slot(devices_count_.load(std::memory_order_acquire))) return *device_slot;
+
+        const std::lock_guard lock(devices_mutex_);
+        const uint32_t devices_count = devices_count_.load(std::memory_order_relaxed);
+        if (const auto device_slot = find_slot(devices_count)) return *device_slot;
+        if (devices_count == kMaxDevices) return kMaxDevices - 1;
+
+        const StorageDeviceKind kind = device != 0 ? GetStorageDeviceKind(device) : StorageDeviceKind::Unknown;
+        size_t concurrency_limit =
+            kind == StorageDeviceKind::Rotational ? rotational_device_concurrency_ : other_device_concurrency_;
+        if (concurrency_limit == 0) concurrency_limit = workers_.size();
+
+        devices_[devices_count] =
+            std::make_unique<DeviceScanQueues<Task>>(device, kind, concurrency_limit, workers_.size());
+        devices_count_.store(devices_count + 1, std::memory_order_release);
+        return devices_count;
+    }
+
+    // Only while no workers run
+    template <typename Callback>
+    void ForEachQueuedTask(Callback&& callback)
+    {
+        for (const uint32_t device_slot : std::views::iota(uint32_t{0}, devices_count_.load()))
+        {
+            const std::vector<ScanTaskQueue<Task>>& worker_queues = devices_[device_slot]->worker_queues;
+            for (const size_t worker_index : std::views::iota(size_t{0}, worker_queues.size()))
+            {
+                for (const ScanTask<Task>& task : worker_queues[worker_index].tasks) callback(worker_index, task);
+            }
+        }
+    }
+
+    void PushTask(size_t worker_index, ScanTask<Task> task)
+    {
+        pending_tasks_.fetch_add(1, std::memory_order_relaxed);
+        DeviceScanQueues<Task>& device = *devices_[task.device_slot];
+        device.queued_count.fetch_add(1, std::memory_order_relaxed);
+        ScanTaskQueue<Task>& queue = device.worker_queues[worker_index];
+        {
+            std::lock_guard lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+
+        WakeIdleWorkers();
+    }
+
+    // Called whenever a worker may find a task it could not take before: one was queued, a device slot was released,
+    // the last task finished or the scan was cancelled. The epoch changes before idle workers are counted, so a worker
+    // that starts waiting concurrently sees the new epoch and does not wait
+    void WakeIdleWorkers()
+    {
+        work_epoch_.fetch_add(1);
+        if (idle_workers_count_.load() != 0) work_epoch_.notify_all();
+    }
+
+    std::optional<ScanTask<Task>> PopTask(DeviceScanQueues<Task>& device, size_t worker_index)
+    {
+        ScanTaskQueue<Task>& queue = device.worker_queues[worker_index];
+        std::lock_guard lock(queue.mutex);
+        if (queue.tasks.empty()) return std::nullopt;
+        ScanTask<Task> task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        device.queued_count.fetch_sub(1, std::memory_order_relaxed);
+        return task;
+    }
+
+    std::optional<ScanTask<Task>> StealTask(DeviceScanQueues<Task>& device, size_t thief_index)
+    {
+        for (const size_t offset : std::views::iota(size_t{1}, workers_.size()))
+        {
+            ScanTaskQueue<Task>& victim = device.worker_queues[(thief_index + offset) % workers_.size()];
+            std::lock_guard lock(victim.mutex);
+            if (victim.tasks.empty()) continue;
+            ScanTask<Task> task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            device.queued_count.fetch_sub(1, std::memory_order_relaxed);
+            ++workers_[thief_index].stolen_tasks_count;
+            return task;
+        }
+
+        return std::nullopt;
+    }
+
+    // Takes a task of a device with queued tasks and a free slot, trying the device of the previous task first. The
+    // task holds the slot until it is released
+    std::optional<ScanTask<Task>> TakeTask(size_t worker_index, uint32_t& device_slot)
+    {
+        const uint32_t devices_count = devices_count_.load(std::memory_order_acquire);
+        for (const uint32_t offset : std::views::iota(uint32_t{0}, devices_count))
+        {
+            const uint32_t slot = (device_slot + offset) % devices_count;
+            DeviceScanQueues<Task>& device = *devices_[slot];
+            if (device.queued_count.load(std::memory_order_relaxed) == 0 || !device.TryAcquire()) continue;
+
+            auto task = PopTask(device, worker_index);
+            if (!task) task = StealTask(device, worker_index);
+            if (task)
+            {
+                device_slot = slot;
+                return task;
+            }
+
+            device.Release();
+            WakeIdleWorkers();
+        }
+
+        return std::nullopt;
+    }
+
+    void RunWorker(size_t worker_index)
+    {
+        if (worker_index != 0) TRACE_THREAD_NAME("Scan worker");
+        TRACE_SCOPE("Scan worker");
+        uint32_t device_slot = 0;
+        while (!stop_token_.stop_requested())
+        {
+            // Read before looking for a task, so that a task queued after the search ends the wait
+            const uint32_t epoch = work_epoch_.load();
+            if (auto task = TakeTask(worker_index, device_slot))
+            {
+                ListDirectory(worker_index, *task);
+                devices_[task->device_slot]->Release();
+                pending_tasks_.fetch_sub(1, std::memory_order_acq_rel);
+                WakeIdleWorkers();
+            }
+            else if (pending_tasks_.load(std::memory_order_acquire) == 0)
+            {
+                break;
+            }
+            else
+            {
+                // All queued tasks belong to devices at their concurrency limit, or are being listed
+                idle_workers_count_.fetch_add(1);
+                work_epoch_.wait(epoch);
+                idle_workers_count_.fetch_sub(1);
+            }
+        }
+    }
+
+    void ListDirectory(size_t worker_index, const ScanTask<Task>& scan_task)
+    {
+        ScanWorker<Task>& worker = workers_[worker_index];
+
+        // Out of time: the rest of the queue drains without listing
+        if (deadline_ && std::chrono::steady_clock::now() >= *deadline_)
+        {
+            AddUnexpandedDirectory(worker, scan_task.node);
+            return;
+        }
+
+        const auto first_index = static_cast<uint32_t>(worker.nodes.Size());
+        const auto listing_start = std::chrono::steady_clock::now();
+        const std::optional<size_t> entries_count = ListEntries(worker_index, scan_task);
+        if (entries_count)
+        {
+            const auto to_nanoseconds = [&](std::chrono::steady_clock::time_point time)
+            {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(time - walk_start_).count();
+            };
+
+            const int64_t start_time = to_nanoseconds(listing_start);
+            const int64_t end_time = to_nanoseconds(std::chrono::steady_clock::now());
+            DeviceScanQueues<Task>& device = *devices_[scan_task.device_slot];
+            device.directories_count.fetch_add(1, std::memory_order_relaxed);
+            device.entries_count.fetch_add(*entries_count, std::memory_order_relaxed);
+            device.busy_time.fetch_add(end_time - start_time, std::memory_order_relaxed);
+            UpdateMinimum(device.first_start_time, start_time);
+            UpdateMaximum(device.last_end_time, end_time);
+        }
+
+        if (node_budget_ != 0)
+        {
+            AddPendingFiles(worker_index, scan_task.node);
+            const size_t nodes_count = nodes_count_.fetch_add(worker.nodes.Size() - first_index) +
+                                       (worker.nodes.Size() - first_index);
+            if (nodes_count > node_budget_) UpdateMinSizeClass();
+        }
+
+        if (!listener_) return;
+
+        const auto end_index = static_cast<uint32_t>(worker.nodes.Size());
+        FillListing(worker.listing, static_cast<uint32_t>(worker_index), scan_task.node, first_index, end_index);
+        for (const ScanTask<Task>& task : worker.deferred_tasks)
+        {
+            worker.listing.directories.push_back(task.node.index - first_index);
+        }
+
+        listener_->OnDirectoryListed(worker.listing);
+
+        for (ScanTask<Task>& task : worker.deferred_tasks)
+        {
+            PushTask(worker_index, std::move(task));
+        }
+
+        worker.deferred_tasks.clear();
+    }
+
+    void FillListing(
+        ReadDirectoryTreeListing& listing,
+        uint32_t batch_index,
+        ScanNodeRef parent,
+        uint32_t begin,
+        uint32_t end) const
+    {
+        const ScanBatch& batch = workers_[batch_index].nodes;
+        listing.parent_key = parent.ToKey();
+        listing.first_key = ScanNodeRef{.batch = batch_index, .index = begin}.ToKey();
+        listing.names.clear();
+        listing.values.clear();
+        listing.directories.clear();
+        for (const uint32_t index : std::views::iota(begin, end))
+        {
+            listing.names.push_back(batch.GetName(index));
+            listing.values.push_back(batch.values[index]);
+        }
+    }
+
+    // Files of the listed directory, in the size classes kept so far, are added as they are. The rest are folded
+    // into one aggregate node unless there is only one of them
+    void AddPendingFiles(size_t worker_index, ScanNodeRef parent)
+    {
+        ScanWorker<Task>& worker = workers_[worker_index];
+        ScanBatch& files = worker.pending_files;
+        const uint32_t min_size_class = min_size_class_.load(std::memory_order_relaxed);
+        auto is_foldable = [&](uint32_t index)
+        {
+            return GetSizeClass(files.values[index]) < min_size_class || files.GetAggregatedFilesCount(index) != 0;
+        };
+
+        const auto files_count = static_cast<uint32_t>(files.Size());
+        const auto indices = std::views::iota(uint32_t{0}, files_count);
+        const bool fold = std::ranges::count_if(indices, is_foldable) > 1;
+
+        uint64_t folded_value = 0;
+        uint64_t folded_files_count = 0;
+        for (const uint32_t index : indices)
+        {
+            const uint64_t value = files.values[index];
+            if (fold && is_foldable(index))
+            {
+                folded_value += value;
+                folded_files_count += std::max(files.GetAggregatedFilesCount(index), uint64_t{1});
+                continue;
+            }
+
+            if (const uint64_t files_in_node = files.GetAggregatedFilesCount(index); files_in_node != 0)
+            {
+                worker.nodes.AddAggregate(files.GetName(index), value, parent, files_in_node);
+            }
+            else
+            {
+                worker.nodes.Add(files.GetName(index), value, parent);
+            }
+
+            kept_files_by_size_class_[GetSizeClass(value)].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (folded_files_count != 0)
+        {
+            worker.nodes.AddAggregate(
+                MakeAggregateNodeName(folded_files_count),
+                folded_value,
+                parent,
+                folded_files_count);
+        }
+
+        files.Clear();
+    }
+
+    // Called when the scan has more nodes than the budget. From now on files are kept only in the largest size
+    // classes that have at most half of the budget kept so far. Files kept earlier stay until Merge folds them, so
+    // the scan holds about one and a half budgets of nodes plus directories
+    void UpdateMinSizeClass()
+    {
+        size_t kept_files_count = 0;
+        auto size_class = static_cast<uint32_t>(kSizeClassesCount);
+        for (; size_class != 0; --size_class)
+        {
+            const size_t class_files_count = kept_files_by_size_class_[size_class - 1].load(std::memory_order_relaxed);
+            if (kept_files_count + class_files_count > node_budget_ / 2) break;
+            kept_files_count += class_files_count;
+        }
+
+        uint32_t current = min_size_class_.load(std::memory_order_relaxed);
+        while (current < size_class &&
+               !min_size_class_.compare_exchange_weak(current, size_class, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    // Returns the number of entries, none if the directory could not be opened
+    std::optional<size_t> ListEntries(size_t worker_index, const ScanTask<Task>& scan_task)
+    {
+        ScanWorker<Task>& worker = workers_[worker_index];
+        size_t entries_count = 0;
+        uint32_t child_device_slot = scan_task.device_slot;
+
+        auto add_node = [&](std::string_view name, uint64_t value)
+        {
+            return ScanNodeRef{
+                .batch = static_cast<uint32_t>(worker_index),
+                .index = worker.nodes.Add(name, value, scan_task.node),
+            };
+        };
+
+        // With a node budget files wait in pending_files until the directory is listed. Aggregates come only from
+        // the previous tree and keep their files count
+        auto add_file = [&](std::string_view name, uint64_t value, uint64_t aggregated_files_count)
+        {
+            ++entries_count;
+            ScanBatch& batch = node_budget_ != 0 ? worker.pending_files : worker.nodes;
+            if (aggregated_files_count != 0)
+            {
+                batch.AddAggregate(name, value, scan_task.node, aggregated_files_count);
+            }
+            else
+            {
+                batch.Add(name, value, scan_task.node);
+            }
+        };
+
+        auto add_directory = [&](std::string_view name, Task child_task, NodeId previous_child)
+        {
+            ++entries_count;
+            const size_t depth = scan_task.depth + 1;
+            if (max_depth_ != 0 && depth > max_depth_)
+            {
+                AddUnexpandedDirectory(worker, add_node(name, 0));
+                return;
+            }
+
+            ScanTask<Task> task{
+                .task = std::move(child_task),
+                .node = add_node(name, 0),
+                .previous_node = previous_child,
+                .depth = depth,
+                .device_slot = child_device_slot,
+            };
+            if (listener_)
+            {
+                worker.deferred_tasks.push_back(std::move(task));
+            }
+            else
+            {
+                PushTask(worker_index, std::move(task));
+            }
+        };
+
+        const std::optional<Directory> directory = listers_[worker_index].Open(scan_task.task, worker.syscalls);
+
+        // Directories that failed to open get a zero stamp so that the next incremental scan retries them
+        worker.nodes.directory_stamps.emplace_back(scan_task.node, directory ? directory->stamp : DirectoryStamp{});
+        if (!directory) return std::nullopt;
+
+        ++worker.directories_count;
+
+        // Below a mount point subdirectories go to the queues of its device. Backends without device numbers keep
+        // the device of the root path
+        const uint64_t device = directory->stamp.device;
+        if (device != 0 && device != devices_[child_device_slot]->device) child_device_slot = GetDeviceSlot(device);
+
+        const NodeId previous_node = scan_task.previous_node;
+        const DirectoryStamp* previous_stamp =
+            previous_node != kInvalidNodeId ? previous_nodes_->FindDirectoryStamp(previous_node) : nullptr;
+        if (previous_stamp && previous_stamp->IsValid() && *previous_stamp == directory->stamp)
+        {
+            // Same entries as before: copy files and go down into subdirectories to compare their stamps
+            ++worker.reused_directories_count;
+            ForEachPreviousChild(
+                previous_node,
+                [&](NodeId child)
+                {
+                    const std::string_view name = previous_nodes_->GetName(child);
+                    if (previous_nodes_->FindDirectoryStamp(child))
+                    {
+                        add_directory(name, Lister::MakeChildTask(*directory, name), child);
+                    }
+                    else
+                    {
+                        add_file(
+                            name,
+                            previous_nodes_->GetValue(child),
+                            previous_nodes_->GetAggregatedFilesCount(child));
+                    }
+                });
+            return entries_count;
+        }
+
+        // New or changed directory: list it, but keep matching subdirectories with the previous tree by name
+        std::unordered_map<std::string_view, NodeId> previous_children;
+        if (previous_node != kInvalidNodeId)
+        {
+            ForEachPreviousChild(
+                previous_node,
+                [&](NodeId child)
+                {
+                    if (!previous_nodes_->FindDirectoryStamp(child)) return;
+                    previous_children.emplace(previous_nodes_->GetName(child), child);
+                });
+        }
+
+        listers_[worker_index].List(
+            *directory,
+            worker.syscalls,
+            [&](std::string_view name, uint64_t value) { add_file(name, value, 0); },
+            [&](std::string_view name, Task child_task)
+            {
+                const auto it = previous_children.find(name);
+                const NodeId previous_child = it != previous_children.end() ? it->second : kInvalidNodeId;
+                add_directory(name, std::move(child_task), previous_child);
+            });
+        return entries_count;
+    }
+
+    static void AddUnexpandedDirectory(ScanWorker<Task>& worker, ScanNodeRef node)
+    {
+        worker.nodes.directory_stamps.emplace_back(node, DirectoryStamp{});
+        worker.nodes.unexpanded_directories.push_back(node);
+    }
+
+    template <typename Callback>
+    void ForEachPreviousChild(NodeId node, Callback&& callback) const
+    {
+        for (NodeId child = previous_nodes_->GetFirstChild(node); child != kInvalidNodeId;
+             child = previous_nodes_->GetNextSibling(child))
+        {
+            callback(child);
+        }
+    }
+
+    std::vector<ScanWorker<Task>> workers_;
+    std::vector<Lister> listers_;
+    const TreeNodes* previous_nodes_ = nullptr;
+    IReadDirectoryTreeListener* listener_ = nullptr;
+    std::stop_token stop_token_;
+    std::atomic<size_t> pending_tasks_ = 0;
+
+    // Changes with every WakeIdleWorkers call, idle workers wait on it
+    std::atomic<uint32_t> work_epoch_ = 0;
+    std::atomic<size_t> idle_workers_count_ = 0;
+
+    size_t node_budget_ = 0;
+    double min_file_fraction_ = 0;
+
+    // Maintained only with a node budget: nodes in all batches, kept files by size class and the smallest size class
+    // that is not folded
+    std::atomic<size_t> nodes_count_ = 0;
+    std::array<std::atomic<size_t>, kSizeClassesCount> kept_files_by_size_class_{};
+    std::atomic<uint32_t> min_size_class_ = 0;
+
+    size_t aggregate_nodes_count_ = 0;
+    size_t folded_files_count_ = 0;
+
+    size_t max_depth_ = 0;
+    std::optional<std::chrono::steady_clock::time_point> deadline_;
+    std::vector<NodeId> unexpanded_nodes_;
+
+    // Slots are filled under devices_mutex_ and published by devices_count_, filled ones never change
+    static constexpr uint32_t kMaxDevices = 64;
+    std::array<std::unique_ptr<DeviceScanQueues<Task>>, kMaxDevices> devices_;
+    std::atomic<uint32_t> devices_count_ = 0;
+    std::mutex devices_mutex_;
+    size_t rotational_device_concurrency_ = 0;
+    size_t other_device_concurrency_ = 0;
+    std::chrono::steady_clock::time_point walk_start_;
+};
+
+// Unlisted directories get a guess instead of zero, so that they take some area and can be expanded on demand: the
+// mean size of listed sibling directories, else of sibling files, else of all files in the tree. Values of ancestors
+// include the guesses.
+void EstimateUnexpandedDirectories(TreeNodes& nodes, std::span<const NodeId> unexpanded_nodes)
+{
+    if (unexpanded_nodes.empty()) return;
+
+    auto is_unexpanded = [&](NodeId node_id)
+    {
+        return std::ranges::binary_search(unexpanded_nodes, node_id);
+    };
+
+    uint64_t files_value = 0;
+    uint64_t files_count = 0;
+    for (const NodeId node_id : nodes.Ids())
+    {
+        if (nodes.GetFirstChild(node_id) != kInvalidNodeId || nodes.FindDirectoryStamp(node_id)) continue;
+        files_value += nodes.GetValue(node_id);
+        ++files_count;
+    }
+
+    const uint64_t mean_file_value = files_count != 0 ? files_value / files_count : 0;
+    std::vector<std::pair<NodeId, uint64_t>> estimates;
+    estimates.reserve(unexpanded_nodes.size());
+    for (const NodeId node_id : unexpanded_nodes)
+    {
+        // Siblings are next to each other in the breadth-first order
+        const NodeId parent = nodes.GetParent(node_id);
+        if (!estimates.empty() && nodes.GetParent(estimates.back().first) == parent)
+        {
+            estimates.emplace_back(node_id, estimates.back().second);
+            continue;
+        }
+
+        uint64_t directories_value = 0;
+        uint64_t directories_count = 0;
+        uint64_t siblings_files_value = 0;
+        uint64_t siblings_files_count = 0;
+        for (NodeId sibling = parent != kInvalidNodeId ? nodes.GetFirstChild(parent) : kInvalidNodeId;
+             sibling != kInvalidNodeId;
+             sibling = nodes.GetNextSibling(sibling))
+        {
+            if (!nodes.FindDirectoryStamp(sibling))
+            {
+                siblings_files_value += nodes.GetValue(sibling);
+                ++siblings_files_count;
+            }
+            else if (!is_unexpanded(sibling))
+            {
+                directories_value += nodes.GetValue(sibling);
+                ++directories_count;
+            }
+        }
+
+        uint64_t estimate = mean_file_value;
+        if (directories_count != 0)
+        {
+            estimate = directories_value / directories_count;
+        }
+        else if (siblings_files_count != 0)
+        {
+            estimate = siblings_files_value / siblings_files_count;
+        }
+
+        estimates.emplace_back(node_id, estimate);
+    }
+
+    for (const auto& [node_id, estimate] : estimates)
+    {
+        nodes.AddValueDelta(node_id, static_cast<int64_t>(estimate));
+    }
+}
+
+template <typename Lister>
+TreeNodes ReadDirectoryTreeWith(
+    std::optional<std::string_view> root_node_name,
+    std::span<const std::filesystem::path> paths,
+    std::unordered_map<NodeId, size_t>* out_root_node_id_to_path_index,
+    size_t thread_count,
+    const ReadDirectoryTreeParams& params,
+    ReadDirectoryTreeStats* out_stats)
+{
+    const PreviousDirectoryTree& previous_tree = params.previous_tree;
+    ParallelDirectoryScanner<Lister> scanner(thread_count, params);
+
+    // Root node of the path in the previous tree
+    auto find_previous_root = [&](const fs::path& path)
+    {
+        if (previous_tree.nodes && previous_tree.root_node_id_to_path_index)
+        {
+            for (const auto& [node_id, path_index] : *previous_tree.root_node_id_to_path_index)
+            {
+                if (previous_tree.root_paths[path_index] == path) return node_id;
+            }
+        }
+
+        return kInvalidNodeId;
+    };
+
+    ScanNodeRef common_root = kInvalidScanNodeRef;
+    if (root_node_name)
+    {
+        // Add the root node
+        common_root = scanner.AddNode(*root_node_name, 0, kInvalidScanNodeRef);
+    }
+
+    // Add root paths. Merge keeps them right after the common root in this order
+    for (const size_t i : std::views::iota(size_t{0}, paths.size()))
+    {
+        const auto& path = paths[i];
+        const std::string name = PathHelpers::PathToUTF8(path.filename());
+        std::error_code err;
+        if (fs::is_regular_file(path, err))
+        {
+            const uint64_t file_size = fs::file_size(path, err);
+            scanner.AddNode(name, err ? 0 : file_size, common_root);
+        }
+        else
+        {
+            scanner.AddRootTask(path, scanner.AddNode(name, 0, common_root), find_previous_root(path));
+        }
+
+        if (out_root_node_id_to_path_index)
+        {
+            (*out_root_node_id_to_path_index)[static_cast<NodeId>((common_root.IsValid() ? 1 : 0) + i)] = i;
+        }
+    }
+
+    scanner.ReportAddedNodes();
+
+    const auto walk_start = std::chrono::steady_clock::now();
+    scanner.Run();
+    const auto merge_start = std::chrono::steady_clock::now();
+    TreeNodes nodes = scanner.Merge();
+    [[maybe_unused]] const auto propagate_start = std::chrono::steady_clock::now();
+    nodes.PropagateValuesToParents();
+    EstimateUnexpandedDirectories(nodes, scanner.GetUnexpandedNodes());
+    const auto end = std::chrono::steady_clock::now();
+
+    TRACE_SPAN("Scan walk", walk_start, merge_start);
+    TRACE_SPAN("Scan merge", merge_start, propagate_start);
+    TRACE_SPAN("Propagate sizes", propagate_start, end);
+#ifdef RECT_TREE_VIEWER_TRACING
+    if (Tracing::IsEnabled())
+    {
+        ReadDirectoryTreeStats stats;
+        scanner.FillStats(stats);
+        const std::chrono::duration<double> walk_duration = merge_start - walk_start;
+        TRACE_COUNTER("Scanned nodes per second", static_cast<double>(stats.nodes_count) / walk_duration.count());
+        TRACE_COUNTER("Scan open calls", stats.syscalls.open_calls);
+        TRACE_COUNTER("Scan read directory calls", stats.syscalls.read_directory_calls);
+        TRACE_COUNTER("Scan stat calls", stats.syscalls.stat_calls);
+    }
+#endif
+
+    if (out_stats)
+    {
+        scanner.FillStats(*out_stats);
+        out_stats->walk_duration = merge_start - walk_start;
+        out_stats->merge_duration = end - merge_start;
+    }
+
+    return nodes;
+}
+
+}  // namespace
+
+std::string_view ToString(ReadDirectoryTreeBackend backend)
+{
+    switch (backend)
+    {
+    case ReadDirectoryTreeBackend::Auto:
+        return "auto";
+    case ReadDirectoryTreeBackend::Filesystem:
+        return "filesystem";
+    case ReadDirectoryTreeBackend::Linux:
+        return "linux";
+    case ReadDirectoryTreeBackend::IoUring:
+        return "io_uring";
+    }
+
+    return "unknown";
+}
+
+std::string MakeAggregateNodeName(uint64_t files_count)
+{
+    return fmt::format("<{} small files>", files_count);
+}
+
+bool IsUnexpandedDirectory(const TreeNodes& nodes, NodeId node_id)
+{
+    const DirectoryStamp* stamp = nodes.FindDirectoryStamp(node_id);
+    return stamp && !stamp->IsValid() && nodes.GetFirstChild(node_id) == kInvalidNodeId;
+}
+
+TreeNodes ReadDirectoryTreeMulti(
+    std::optional<std::string_view> root_node_name,
+    std::span<const std::filesystem::path> paths,
+    std::unordered_map<NodeId, size_t>* out_root_node_id_to_path_index,
+    const ReadDirectoryTreeParams& params,
+    ReadDirectoryTreeStats* out_stats)
+{
+    TRACE_SCOPE("ReadDirectoryTreeMulti");
+    const size_t hardware_threads = std::max(size_t{std::thread::hardware_concurrency()}, size_t{1});
+    const size_t thread_count = params.thread_count != 0 ? params.thread_count : hardware_threads;
+
+    ReadDirectoryTreeBackend backend = params.backend;
+    if (backend == ReadDirectoryTreeBackend::Auto)
+    {
+#ifdef __linux__
+        backend = ReadDirectoryTreeBackend::Linux;
+#else
+        backend = ReadDirectoryTreeBackend::Filesystem;
+#endif
+    }
+
+#ifdef __linux__
+    // Kernels without io_uring, with it disabled or behind a seccomp filter that blocks it
+    if (backend == ReadDirectoryTreeBackend::IoUring && !IoUringDirectoryLister::IsAvailable())
+    {
+        backend = ReadDirectoryTreeBackend::Linux;
+    }
+#endif
+
+    if (out_stats)
+    {
+        *out_stats = {};
+        out_stats->backend = backend;
+    }
+
+#ifdef __linux__
+    if (backend == ReadDirectoryTreeBackend::IoUring)
+    {
+        return ReadDirectoryTreeWith<IoUringDirectoryLister>(
+            root_node_name,
+            paths,
+            out_root_node_id_to_path_index,
+            thread_count,
+            params,
+            out_stats);
+    }
+
+    if (backend == ReadDirectoryTreeBackend::Linux)
+    {
+        return ReadDirectoryTreeWith<LinuxDirectoryLister>(
+            root_node_name,
+            paths,
+            out_root_node_id_to_path_index,
+            thread_count,
+            params,
+            out_stats);
+    }
+#endif
+
+    klgl::ErrorHandling::Ensure(
+        backend == ReadDirectoryTreeBackend::Filesystem,
+        "Directory tree backend {} is not available on this platform",
+        static_cast<int>(backend));
+
+    return ReadDirectoryTreeWith<FilesystemDirectoryLister>(
+        root_node_name,
+        paths,
+        out_root_node_id_to_path_index,
+        thread_count,
+        params,
+        out_stats);
+}
+
+void PrintScanStats(std::FILE* file, const ReadDirectoryTreeStats& stats)
+{
+    fmt::println(
+        file,
+        "Scanned {} nodes ({} directories, {} unchanged) in {} on {} threads ({} stolen tasks), merge took {}",
+        stats.nodes_count,
+        stats.directories_count,
+        stats.reused_directories_count,
+        std::chrono::duration_cast<std::chrono::milliseconds>(stats.walk_duration),
+        stats.thread_count,
+        stats.stolen_tasks_count,
+        std::chrono::duration_cast<std::chrono::milliseconds>(stats.merge_duration));
+    fmt::println(
+        file,
+        "Scan backend {}: {} open, {} read directory and {} stat calls",
+        ToString(stats.backend),
+        stats.syscalls.open_calls,
+        stats.syscalls.read_directory_calls,
+        stats.syscalls.stat_calls);
+    if (stats.syscalls.io_uring_enter_calls != 0)
+    {
+        fmt::println(file, "Opens and stats went in {} io_uring submissions", stats.syscalls.io_uring_enter_calls);
+    }
+    if (stats.aggregate_nodes_count != 0)
+    {
+        fmt::println(
+            file,
+            "Folded {} small files into {} aggregate nodes",
+            stats.folded_files_count,
+            stats.aggregate_nodes_count);
+    }
+    if (stats.unexpanded_directories_count != 0)
+    {
+        fmt::println(
+            file,
+            "{} directories were not listed because of the depth or time limit, their sizes are estimated",
+            stats.unexpanded_directories_count);
+    }
+    for (const ReadDirectoryTreeDeviceStats& device : stats.devices)
+    {
+        fmt::println(
+            file,
+            "Device {} ({}, {} at a time): {} directories, {} entries in {}, busy for {}",
+            FormatDevice(device.device),
+            ToString(device.kind),
+            device.concurrency_limit,
+            device.directories_count,
+            device.entries_count,
+            std::chrono::duration_cast<std::chrono::milliseconds>(device.active_duration),
+            std::chrono::duration_cast<std::chrono::milliseconds>(device.busy_duration));
+    }
+    if (stats.cancelled) fmt::println(file, "Scan was cancelled, directories that were not listed are empty");
+}
@@ -0,0 +1,123 @@
+#include "rect_draw_list.hpp"
+
+#include <algorithm>
+#include <ranges>
+
+namespace rect_tree_viewer
+{
+
+void PainterRectDrawBackend::Draw(std::span<const RectInstance> instances, std::span<const RectDrawBatch> batches)
+{
+    for (const RectDrawBatch& batch : batches)
+    {
+        for (const RectInstance& instance : instances.subspan(batch.first, batch.count))
+        {
+            painter_.FillRect(instance.ToPainterRect());
+        }
+    }
+}
+
+void CountingRectDrawBackend::Upload(size_t instances_count, size_t, std::span<const RectInstance> instances)
+{
+    allocated_instances_count = instances_count;
+    ++upload_calls_count;
+    uploaded_instances_count += instances.size();
+}
+
+void CountingRectDrawBackend::Draw(std::span<const RectInstance>, std::span<const RectDrawBatch> batches)
+{
+    ++draw_calls_count;
+    batches_count += batches.size();
+    for (const RectDrawBatch& batch : batches) drawn_instances_count += batch.count;
+}
+
+void RectDrawList::Rebuild(std::span<const Rect2d> rects, std::span<const edt::Vec4u8> colors)
+{
+    instances_.resize(rects.size());
+    for (const size_t index : std::views::iota(size_t{0}, rects.size())) Pack(rects, colors, index);
+
+    dirty_ranges_.clear();
+    dirty_ranges_.push_back({.begin = 0, .end = instances_.size()});
+}
+
+void RectDrawList::Update(
+    std::span<const Rect2d> rects,
+    std::span<const edt::Vec4u8> colors,
+    std::span<const NodeId> nodes)
+{
+    for (const NodeId node_id : nodes)
+    {
+        if (node_id >= instances_.size()) continue;
+        Pack(rects, colors, node_id);
+        dirty_ranges_.push_back({.begin = node_id, .end = node_id + size_t{1}});
+    }
+
+    if (const size_t old_size = instances_.size(); old_size < rects.size())
+    {
+        instances_.resize(rects.size());
+        for (const size_t index : std::views::iota(old_size, rects.size())) Pack(rects, colors, index);
+        dirty_ranges_.push_back({.begin = old_size, .end = instances_.size()});
+    }
+}
+
+void RectDrawList::Upload(IRectDrawBackend& backend)
+{
+    if (dirty_ranges_.empty() && uploaded_instances_count_ == instances_.size()) return;
+
+    // The backend has to learn about a new size even if nothing else changed
+    if (dirty_ranges_.empty()) dirty_ranges_.push_back({.begin = 0, .end = 0});
+
+    std::ranges::sort(dirty_ranges_, std::less{}, &Range::begin);
+    Range merged = dirty_ranges_.front();
+    auto upload = [&](const Range& range)
+    {
+        const std::span<const RectInstance> instances{instances_};
+        backend.Upload(instances_.size(), range.begin, instances.subspan(range.begin, range.end - range.begin));
+    };
+
+    for (const Range& range : dirty_ranges_ | std::views::drop(1))
+    {
+        if (range.begin <= merged.end + kMergeGap)
+        {
+            merged.end = std::max(merged.end, range.end);
+            continue;
+        }
+
+        upload(merged);
+        merged = range;
+    }
+
+    upload(merged);
+    dirty_ranges_.clear();
+    uploaded_instances_count_ = instances_.size();
+}
+
+void RectDrawList::Draw(IRectDrawBackend& backend, std::span<const NodeId> nodes)
+{
+    batches_.clear();
+    for (const NodeId node_id : nodes)
+    {
+        if (!batches_.empty() && batches_.back().first + batches_.back().count == node_id)
+        {
+            ++batches_.back().count;
+        }
+        else
+        {
+            batches_.push_back({.first = node_id, .count = 1});
+        }
+    }
+
+    backend.Draw(instances_, batches_);
+}
+
+void RectDrawList::Pack(std::span<const Rect2d> rects, std::span<const edt::Vec4u8> colors, size_t index)
+{
+    const Rect2d& rect = rects[index];
+    instances_[index] = {
+        .center = rect.bottom_left + rect.size / 2,
+        .size = rect.size,
+        .color = colors[index],
+    };
+}
+
+}  // namespace rect_tree_viewer
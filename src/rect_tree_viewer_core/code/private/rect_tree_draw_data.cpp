@@ -0,0 +1,749 @@
+#include "rect_tree_draw_data.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <ranges>
+#include <thread>
+
+#include "klgl/error_handling.hpp"
+#include "tracing.hpp"
+
+namespace rect_tree_viewer
+{
+
+namespace
+{
+
+[[nodiscard]] bool IsSameRect(const Rect2d& a, const Rect2d& b)
+{
+    return a.bottom_left.x() == b.bottom_left.x() && a.bottom_left.y() == b.bottom_left.y() &&
+           a.size.x() == b.size.x() && a.size.y() == b.size.y();
+}
+
+// Splits the rectangle of a node between its children. Keeps scratch buffers between calls. Children come sorted by
+// value from TreeChildIndex and prefix sums of their values make every split a search, so a node with k children
+// takes O(k log k) at worst. Splits are recorded on the way for RectTreeSpatialIndex, the first one is the root.
+class ChildrenLayout
+{
+public:
+    ChildrenLayout(const TreeNodes& nodes, const TreeChildIndex& child_index, const float padding_factor)
+        : nodes_(nodes),
+          child_index_(child_index),
+          padding_factor_(padding_factor)
+    {
+    }
+
+    // Returns false if the node has no children
+    bool Layout(NodeId node_id, const Rect2d& node_rect)
+    {
+        splits_.clear();
+        root_ref_ = RectTreeSpatialIndex::kNoRef;
+        children_ = child_index_.GetChildren(node_id);
+        if (children_.empty())
+        {
+            return false;
+        }
+
+        children_rects_.resize(children_.size());
+        values_prefix_sums_.resize(children_.size() + 1);
+        values_prefix_sums_[0] = 0;
+        for (const size_t i : std::views::iota(size_t{0}, children_.size()))
+        {
+            values_prefix_sums_[i + 1] = values_prefix_sums_[i] + nodes_.GetValue(children_[i]);
+        }
+
+        // Make an inner rectangle for children
+        regions_.push_back({
+            .rect = MakeInnerRect(node_rect),
+            .begin = 0,
+            .end = children_.size(),
+            .value = GetNodeValue(node_id),
+            .owner = kNoOwner,
+        });
+
+        // On each iteration: collect children to get 50+% of value and split the rect along the biggest extent
+        while (!regions_.empty())
+        {
+            auto region_to_split = regions_.back();
+            regions_.pop_back();
+
+            const size_t region_size = region_to_split.end - region_to_split.begin;
+            if (region_size == 1)
+            {
+                children_rects_[region_to_split.begin] = region_to_split.rect;
+                SetRegionRef(region_to_split, RectTreeSpatialIndex::kLeafBit | children_[region_to_split.begin]);
+                continue;
+            }
+
+            // Value of the first count children of the region. Sums of integers are exact, so this is the same as
+            // adding the values one by one
+            auto get_first_region_value = [&](size_t count)
+            {
+                const uint64_t sum =
+                    values_prefix_sums_[region_to_split.begin + count] - values_prefix_sums_[region_to_split.begin];
+                return static_cast<long double>(sum);
+            };
+
+            // The fewest children (at least one) that get 50+% of value, both regions keep at least one child.
+            // Sorted values make the first region small, so the range is found by doubling from the front
+            size_t first_region_size = 1;
+            size_t last_first_region_size = 1;
+            while (last_first_region_size < region_size - 1 &&
+                   get_first_region_value(last_first_region_size) * 2.02L < region_to_split.value)
+            {
+                first_region_size = last_first_region_size + 1;
+                last_first_region_size = std::min(last_first_region_size * 2, region_size - 1);
+            }
+
+            while (first_region_size < last_first_region_size)
+            {
+                const size_t middle = (first_region_size + last_first_region_size) / 2;
+                if (get_first_region_value(middle) * 2.02L < region_to_split.value)
+                {
+                    first_region_size = middle + 1;
+                }
+                else
+                {
+                    last_first_region_size = middle;
+                }
+            }
+
+            const long double first_region_value = get_first_region_value(first_region_size);
+            const long double split_ratio = first_region_value / region_to_split.value;
+            const bool along_y = !(region_to_split.rect.size.x() > region_to_split.rect.size.y());
+            auto [first_rect, second_rect] = SplitRect(region_to_split.rect, split_ratio);
+
+            const auto split_index = static_cast<RectTreeSpatialIndex::Ref>(splits_.size());
+            splits_.push_back({.position = along_y ? second_rect.bottom_left.y() : second_rect.bottom_left.x()});
+            SetRegionRef(region_to_split, split_index | (along_y ? RectTreeSpatialIndex::kAlongYBit : 0));
+
+            const size_t split = region_to_split.begin + first_region_size;
+            regions_.push_back({
+                .rect = first_rect,
+                .begin = region_to_split.begin,
+                .end = split,
+                .value = first_region_value,
+                .owner = split_index,
+                .is_second = false,
+            });
+
+            regions_.push_back({
+                .rect = second_rect,
+                .begin = split,
+                .end = region_to_split.end,
+                .value = region_to_split.value - first_region_value,
+                .owner = split_index,
+                .is_second = true,
+            });
+        }
+
+        return true;
+    }
+
+    // Children of the node passed to the last Layout call, sorted by value in descending order
+    [[nodiscard]] std::span<const NodeId> GetChildren() const { return children_; }
+
+    // Rectangles of GetChildren(), in the same order
+    [[nodiscard]] std::span<const Rect2d> GetChildrenRects() const { return children_rects_; }
+
+    // Splits made by the last Layout call. Refs to splits are indices in GetSplits()
+    [[nodiscard]] RectTreeSpatialIndex::Ref GetRootRef() const { return root_ref_; }
+    [[nodiscard]] std::span<const RectTreeSpatialIndex::Split> GetSplits() const { return splits_; }
+
+private:
+    // Region is a range of sorted children displayed in one rectangle
+    struct Region
+    {
+        Rect2d rect;
+        size_t begin = 0;
+        size_t end = 0;
+        long double value = 0;
+
+        // Split that made this region
+        RectTreeSpatialIndex::Ref owner = 0;
+        bool is_second = false;
+    };
+
+    static constexpr RectTreeSpatialIndex::Ref kNoOwner = RectTreeSpatialIndex::kNoRef;
+
+    void SetRegionRef(const Region& region, RectTreeSpatialIndex::Ref ref)
+    {
+        if (region.owner == kNoOwner)
+        {
+            root_ref_ = ref;
+        }
+        else
+        {
+            RectTreeSpatialIndex::Split& owner = splits_[region.owner];
+            (region.is_second ? owner.second : owner.first) = ref;
+        }
+    }
+
+    static std::tuple<Rect2d, Rect2d> SplitRect(const Rect2d& rect, const long double split_ratio)
+    {
+        if (rect.size.x() > rect.size.y())
+        {
+            // split along X
+            // left rect
+            float left_width = static_cast<float>(static_cast<long double>(rect.size.x()) * split_ratio);
+            return std::make_tuple(
+                Rect2d{
+                    .bottom_left = rect.bottom_left,
+                    .size = {left_width, rect.size.y()},
+                },
+                // right rect
+                Rect2d{
+                    .bottom_left = {rect.bottom_left.x() + left_width, rect.bottom_left.y()},
+                    .size = {rect.size.x() - left_width, rect.size.y()},
+                });
+        }
+        else
+        {
+            // split along Y
+            // bottom rect
+            float bottom_height = static_cast<float>(static_cast<long double>(rect.size.y()) * split_ratio);
+            return std::make_tuple(
+                Rect2d{
+                    .bottom_left = rect.bottom_left,
+                    .size = {rect.size.x(), bottom_height},
+                },
+                // top rect
+                Rect2d{
+                    .bottom_left = {rect.bottom_left.x(), rect.bottom_left.y() + bottom_height},
+                    .size = {rect.size.x(), rect.size.y() - bottom_height},
+                });
+        }
+    }
+
+    [[nodiscard]] Rect2d MakeInnerRect(const Rect2d& rect) const
+    {
+        const edt::Vec2f rect_size = rect.size * padding_factor_;
+        return {.bottom_left = rect.bottom_left + (rect.size - rect_size) / 2, .size = rect_size};
+    }
+
+    [[nodiscard]] long double GetNodeValue(NodeId id) const { return static_cast<long double>(nodes_.GetValue(id)); }
+
+    const TreeNodes& nodes_;
+    const TreeChildIndex& child_index_;
+    float padding_factor_ = 1.f;
+    std::span<const NodeId> children_;
+    std::vector<Rect2d> children_rects_;
+    std::vector<uint64_t> values_prefix_sums_;
+    std::vector<Region> regions_;
+    std::vector<RectTreeSpatialIndex::Split> splits_;
+    RectTreeSpatialIndex::Ref root_ref_ = RectTreeSpatialIndex::kNoRef;
+};
+
+// Smaller trees are laid out on the calling thread
+constexpr size_t kMinParallelLayoutNodes = 1 << 16;
+
+// Smaller subtrees are not handed to other threads: the lock and wakeup of a task would cost more than laying them out
+constexpr uint32_t kMinLayoutTaskNodes = 1 << 10;
+
+// Lays out subtrees on a pool of threads, each with its own scratch buffers. A worker walks its subtree depth first
+// and hands the oldest node of its stack (usually the biggest remaining subtree) to the shared queue only when the
+// queue is empty, so tasks are split off as idle threads need them rather than per node. Subtrees below
+// kMinLayoutTaskNodes stay with their worker. Every node is laid out exactly as on one thread, so the result is the
+// same.
+class ParallelLayout
+{
+public:
+    ParallelLayout(
+        const TreeNodes& nodes,
+        const TreeChildIndex& child_index,
+        const float padding_factor,
+        size_t thread_count,
+        std::vector<Rect2d>& rects,
+        RectTreeSpatialIndex* spatial_index)
+        : child_index_(child_index),
+          rects_(rects),
+          spatial_index_(spatial_index)
+    {
+        workers_.reserve(thread_count);
+        for (size_t i = 0; i != thread_count; ++i) workers_.emplace_back(nodes, child_index, padding_factor);
+    }
+
+    void Run(NodeId root)
+    {
+        child_index_.ComputeSubtreeSizes(root, subtree_sizes_);
+        PushTask(root);
+
+        // The calling thread is worker 0. Other threads are joined on scope exit
+        std::vector<std::jthread> threads;
+        threads.reserve(workers_.size() - 1);
+        for (const size_t worker_index : std::views::iota(size_t{1}, workers_.size()))
+        {
+            threads.emplace_back([this, worker_index] { RunWorker(worker_index); });
+        }
+
+        RunWorker(0);
+    }
+
+private:
+    struct Worker
+    {
+        Worker(const TreeNodes& nodes, const TreeChildIndex& child_index, const float padding_factor)
+            : layout(nodes, child_index, padding_factor)
+        {
+        }
+
+        ChildrenLayout layout;
+        std::deque<NodeId> stack;
+    };
+
+    void PushTask(NodeId node_id)
+    {
+        pending_tasks_.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard lock(tasks_mutex_);
+            tasks_.push_back(node_id);
+            tasks_count_.store(tasks_.size(), std::memory_order_relaxed);
+        }
+
+        tasks_changed_.notify_one();
+    }
+
+    // Blocks until there is a task. Nullopt when all tasks are done and no more can come
+    std::optional<NodeId> WaitForTask()
+    {
+        std::unique_lock lock(tasks_mutex_);
+        tasks_changed_.wait(
+            lock,
+            [this] { return !tasks_.empty() || pending_tasks_.load(std::memory_order_acquire) == 0; });
+        if (tasks_.empty()) return std::nullopt;
+
+        const NodeId node_id = tasks_.back();
+        tasks_.pop_back();
+        tasks_count_.store(tasks_.size(), std::memory_order_relaxed);
+        return node_id;
+    }
+
+    void RunWorker(size_t worker_index)
+    {
+        while (const auto task = WaitForTask())
+        {
+            LayoutSubtree(workers_[worker_index], *task);
+
+            // The last task wakes everyone up to exit. Notified under the lock so that a worker cannot miss it between
+            // checking the count and starting to wait
+            if (pending_tasks_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                std::lock_guard lock(tasks_mutex_);
+                tasks_changed_.notify_all();
+            }
+        }
+    }
+
+    void LayoutSubtree(Worker& worker, NodeId subtree_root)
+    {
+        worker.stack.push_back(subtree_root);
+        while (!worker.stack.empty())
+        {
+            if (worker.stack.size() > 1 && tasks_count_.load(std::memory_order_relaxed) == 0 &&
+                subtree_sizes_[worker.stack.front()] >= kMinLayoutTaskNodes)
+            {
+                PushTask(worker.stack.front());
+                worker.stack.pop_front();
+            }
+
+            const NodeId node_id = worker.stack.back();
+            worker.stack.pop_back();
+            if (!worker.layout.Layout(node_id, rects_[node_id])) continue;
+
+            // Splits of every node have their own reserved range in the index
+            if (spatial_index_)
+            {
+                spatial_index_->Store(node_id, worker.layout.GetRootRef(), worker.layout.GetSplits(), true);
+            }
+
+            const std::span<const NodeId> children = worker.layout.GetChildren();
+            for (const size_t i : std::views::iota(size_t{0}, children.size()))
+            {
+                rects_[children[i]] = worker.layout.GetChildrenRects()[i];
+                if (child_index_.HasChildren(children[i])) worker.stack.push_back(children[i]);
+            }
+        }
+    }
+
+    const TreeChildIndex& child_index_;
+    std::vector<Rect2d>& rects_;
+    RectTreeSpatialIndex* spatial_index_ = nullptr;
+    std::vector<uint32_t> subtree_sizes_;
+    std::vector<Worker> workers_;
+    std::mutex tasks_mutex_;
+    std::condition_variable tasks_changed_;
+    std::vector<NodeId> tasks_;
+    std::atomic<size_t> tasks_count_ = 0;
+    std::atomic<size_t> pending_tasks_ = 0;
+};
+
+const Rect2d kRootRect{.bottom_left = {-1, -1}, .size = {2, 2}};
+
+}  // namespace
+
+std::vector<Rect2d> RectTreeDrawData::Create(
+    const TreeNodes& nodes,
+    const TreeChildIndex& child_index,
+    const float padding_factor,
+    size_t thread_count,
+    RectTreeSpatialIndex* out_spatial_index)
+{
+    TRACE_SCOPE("RectTreeDrawData::Create");
+    klgl::ErrorHandling::Ensure(child_index.Size() == nodes.Size(), "The child index does not match the tree");
+    if (out_spatial_index) out_spatial_index->Reserve(nodes);
+
+    // Make one rectangle for each node. Create root area covering the whole screen (maybe has to be a parameter)
+    std::vector<Rect2d> rects(nodes.Size());
+    if (rects.empty()) return rects;
+    rects[0] = kRootRect;
+
+    if (thread_count == 0) thread_count = std::max(size_t{std::thread::hardware_concurrency()}, size_t{1});
+    if (thread_count > 1 && nodes.Size() >= kMinParallelLayoutNodes)
+    {
+        ParallelLayout(nodes, child_index, padding_factor, thread_count, rects, out_spatial_index).Run(0);
+        return rects;
+    }
+
+    // Walk from the root by links: after edits parents may follow their children in the arrays
+    ChildrenLayout layout(nodes, child_index, padding_factor);
+    std::vector<NodeId> stack{0};
+    while (!stack.empty())
+    {
+        const NodeId node_id = stack.back();
+        stack.pop_back();
+        if (layout.Layout(node_id, rects[node_id]))
+        {
+            if (out_spatial_index) out_spatial_index->Store(node_id, layout.GetRootRef(), layout.GetSplits(), true);
+
+            const std::span<const NodeId> children = layout.GetChildren();
+            for (const size_t i : std::views::iota(size_t{0}, children.size()))
+            {
+                rects[children[i]] = layout.GetChildrenRects()[i];
+            }
+
+            stack.insert(stack.end(), children.begin(), children.end());
+        }
+    }
+
+    return rects;
+}
+
+void RectTreeDrawData::Update(
+    const TreeNodes& nodes,
+    const TreeChildIndex& child_index,
+    std::span<const NodeId> dirty_nodes,
+    std::vector<Rect2d>& rects,
+    const float padding_factor,
+    RectTreeSpatialIndex* spatial_index,
+    std::vector<NodeId>* out_moved_nodes)
+{
+    TRACE_SCOPE("RectTreeDrawData::Update");
+    klgl::ErrorHandling::Ensure(child_index.Size() == nodes.Size(), "The child index does not match the tree");
+    // The tree may be built by updates alone, starting from an empty one
+    rects.resize(nodes.Size());
+    if (spatial_index) spatial_index->Resize(nodes.Size());
+    if (rects.empty()) return;
+    rects[0] = kRootRect;
+
+    ChildrenLayout layout(nodes, child_index, padding_factor);
+    std::vector<NodeId> stack{0};
+    while (!stack.empty())
+    {
+        const NodeId node_id = stack.back();
+        stack.pop_back();
+        const bool has_children = layout.Layout(node_id, rects[node_id]);
+
+        // New splits go to the end of the index, the old ones of this node are dropped by Compact
+        if (spatial_index) spatial_index->Store(node_id, layout.GetRootRef(), layout.GetSplits(), false);
+        if (!has_children) continue;
+
+        // A child has to be visited if its own children changed or its rectangle moved
+        const std::span<const NodeId> children = layout.GetChildren();
+        for (const size_t i : std::views::iota(size_t{0}, children.size()))
+        {
+            const NodeId child = children[i];
+            const Rect2d& child_rect = layout.GetChildrenRects()[i];
+            const bool is_dirty = std::ranges::binary_search(dirty_nodes, child);
+            const bool is_moved = !IsSameRect(rects[child], child_rect);
+            const bool visit = child_index.HasChildren(child) && (is_dirty || is_moved);
+            if (is_moved && out_moved_nodes) out_moved_nodes->push_back(child);
+            rects[child] = child_rect;
+            if (visit) stack.push_back(child);
+        }
+    }
+
+    // Every node has fewer splits than children, so at least half of the splits are garbage at this point
+    if (spatial_index && spatial_index->GetSplitsCount() > 2 * nodes.Size()) spatial_index->Compact();
+}
+
+void RectTreeSpatialIndex::Reserve(const TreeNodes& nodes)
+{
+    klgl::ErrorHandling::Ensure(nodes.Size() <= kIndexMask, "Too many nodes for the spatial index: {}", nodes.Size());
+
+    // Count children by parent links, then give a node with k children the range of k - 1 splits
+    root_refs_.assign(nodes.Size(), 0);
+    for (const NodeId node_id : nodes.Ids())
+    {
+        if (const NodeId parent = nodes.GetParent(node_id); parent != kInvalidNodeId) ++root_refs_[parent];
+    }
+
+    Ref splits_count = 0;
+    for (Ref& ref : root_refs_)
+    {
+        const Ref children_count = ref;
+        ref = kNoRef;
+        if (children_count > 1)
+        {
+            ref = splits_count;
+            splits_count += children_count - 1;
+        }
+    }
+
+    splits_.clear();
+    splits_.resize(splits_count);
+}
+
+void RectTreeSpatialIndex::Resize(size_t nodes_count)
+{
+    klgl::ErrorHandling::Ensure(nodes_count <= kIndexMask, "Too many nodes for the spatial index: {}", nodes_count);
+    root_refs_.resize(nodes_count, kNoRef);
+}
+
+void RectTreeSpatialIndex::Store(NodeId node_id, Ref root, std::span<const Split> splits, bool reserved_in_place)
+{
+    if (splits.empty())
+    {
+        root_refs_[node_id] = root;
+        return;
+    }
+
+    Ref base = 0;
+    if (reserved_in_place)
+    {
+        base = root_refs_[node_id];
+        klgl::ErrorHandling::Ensure(base != kNoRef, "No splits reserved for node {}", node_id);
+    }
+    else
+    {
+        klgl::ErrorHandling::Ensure(
+            splits_.size() + splits.size() <= kIndexMask,
+            "Too many splits in the spatial index: {}",
+            splits_.size());
+        base = static_cast<Ref>(splits_.size());
+        splits_.resize(splits_.size() + splits.size());
+    }
+
+    // Refs to splits are indices in splits, the axis bit is above any index
+    auto rebase = [&](Ref ref)
+    {
+        return (ref & kLeafBit) ? ref : ref + base;
+    };
+
+    for (const size_t i : std::views::iota(size_t{0}, splits.size()))
+    {
+        splits_[base + i] = {
+            .position = splits[i].position,
+            .first = rebase(splits[i].first),
+            .second = rebase(splits[i].second),
+        };
+    }
+
+    root_refs_[node_id] = rebase(root);
+}
+
+void RectTreeSpatialIndex::Compact()
+{
+    // Splits of a node are stored together, starting with the root one, and refer only to each other
+    std::vector<Split> splits;
+    for (Ref& root : root_refs_)
+    {
+        if (root == kNoRef || (root & kLeafBit)) continue;
+
+        size_t count = 0;
+        stack_.clear();
+        stack_.push_back({.ref = root, .bounds = {}});
+        while (!stack_.empty())
+        {
+            const Ref ref = stack_.back().ref;
+            stack_.pop_back();
+            if (ref & kLeafBit) continue;
+
+            ++count;
+            const Split& split = splits_[ref & kIndexMask];
+            stack_.push_back({.ref = split.first, .bounds = {}});
+            stack_.push_back({.ref = split.second, .bounds = {}});
+        }
+
+        const Ref old_base = root & kIndexMask;
+        const auto new_base = static_cast<Ref>(splits.size());
+        auto rebase = [&](Ref ref)
+        {
+            return (ref & kLeafBit) ? ref : ref - old_base + new_base;
+        };
+
+        for (const Split& split : std::span{splits_}.subspan(old_base, count))
+        {
+            splits.push_back({
+                .position = split.position,
+                .first = rebase(split.first),
+                .second = rebase(split.second),
+            });
+        }
+
+        root = rebase(root);
+    }
+
+    splits_ = std::move(splits);
+}
+
+void RectTreeSpatialIndex::Clear()
+{
+    root_refs_.clear();
+    splits_.clear();
+}
+
+size_t RectTreeSpatialIndex::GetMemoryUsage() const
+{
+    return root_refs_.capacity() * sizeof(Ref) + splits_.capacity() * sizeof(Split);
+}
+
+std::optional<NodeId> RectTreeSpatialIndex::FindNodeAt(std::span<const Rect2d> rects, const edt::Vec2f& position) const
+{
+    if (rects.empty() || root_refs_.empty() || !rects[0].Contains(position)) return std::nullopt;
+
+    // Regions of a split only touch at the boundary, so one of them is enough
+    NodeId node_id = 0;
+    while (root_refs_[node_id] != kNoRef)
+    {
+        Ref ref = root_refs_[node_id];
+        while (!(ref & kLeafBit))
+        {
+            const Split& split = splits_[ref & kIndexMask];
+            const float coordinate = (ref & kAlongYBit) ? position.y() : position.x();
+            ref = coordinate < split.position ? split.first : split.second;
+        }
+
+        // Outside of the child means inside of the padding of the node
+        const NodeId child = ref & ~kLeafBit;
+        if (!rects[child].Contains(position)) break;
+        node_id = child;
+    }
+
+    return node_id;
+}
+
+void LazyRectTreeDrawData::Update(
+    const TreeNodes& nodes,
+    const TreeChildIndex& child_index,
+    const Rect2d& view,
+    float min_size)
+{
+    TRACE_SCOPE("LazyRectTreeDrawData::Update");
+    ++frame_;
+    visible_nodes_.clear();
+    if (nodes.IsEmpty()) return;
+
+    ChildrenLayout layout(nodes, child_index, padding_factor_);
+    stack_.push_back({.node_id = 0, .rect = kRootRect});
+    while (!stack_.empty())
+    {
+        const VisibleNode node = stack_.back();
+        stack_.pop_back();
+        if (!node.rect.Intersects(view)) continue;
+
+        visible_nodes_.push_back(node);
+        if (std::min(node.rect.size.x(), node.rect.size.y()) < min_size) continue;
+        const std::span<const NodeId> children = child_index.GetChildren(node.node_id);
+        if (children.empty()) continue;
+
+        auto [it, inserted] = levels_.try_emplace(node.node_id);
+        Level& level = it->second;
+        if (inserted || !IsSameRect(level.rect, node.rect) || level.children_rects.size() != children.size())
+        {
+            cached_rects_count_ -= level.children_rects.size();
+            layout.Layout(node.node_id, node.rect);
+            level.rect = node.rect;
+            level.children_rects.assign(layout.GetChildrenRects().begin(), layout.GetChildrenRects().end());
+            cached_rects_count_ += level.children_rects.size();
+        }
+
+        level.last_used_frame = frame_;
+        for (const size_t i : std::views::iota(size_t{0}, children.size()))
+        {
+            stack_.push_back({.node_id = children[i], .rect = level.children_rects[i]});
+        }
+    }
+
+    EvictLeastRecentlyUsed();
+}
+
+void LazyRectTreeDrawData::EvictLeastRecentlyUsed()
+{
+    if (cached_rects_count_ <= max_cached_rects_) return;
+
+    // Levels used by the current frame are kept even if they alone exceed the budget
+    eviction_order_.clear();
+    for (const auto& [node_id, level] : levels_)
+    {
+        if (level.last_used_frame != frame_) eviction_order_.emplace_back(level.last_used_frame, node_id);
+    }
+
+    std::ranges::sort(eviction_order_);
+    for (const NodeId node_id : eviction_order_ | std::views::values)
+    {
+        if (cached_rects_count_ <= max_cached_rects_) break;
+        const auto it = levels_.find(node_id);
+        cached_rects_count_ -= it->second.children_rects.size();
+        levels_.erase(it);
+    }
+}
+
+std::optional<NodeId> LazyRectTreeDrawData::FindNodeAt(
+    const TreeChildIndex& child_index,
+    const edt::Vec2f& position) const
+{
+    if (child_index.Size() == 0 || !kRootRect.Contains(position)) return std::nullopt;
+
+    NodeId node_id = 0;
+    Rect2d rect = kRootRect;
+    while (true)
+    {
+        const auto it = levels_.find(node_id);
+        if (it == levels_.end() || !IsSameRect(it->second.rect, rect)) break;
+
+        const Level& level = it->second;
+        const auto child_it = std::ranges::find_if(
+            level.children_rects,
+            [&](const Rect2d& child_rect) { return child_rect.Contains(position); });
+        if (child_it == level.children_rects.end()) break;
+
+        const auto child_position = static_cast<size_t>(child_it - level.children_rects.begin());
+        node_id = child_index.GetChildren(node_id)[child_position];
+        rect = *child_it;
+    }
+
+    return node_id;
+}
+
+void LazyRectTreeDrawData::Invalidate(std::span<const NodeId> dirty_nodes)
+{
+    for (const NodeId node_id : dirty_nodes)
+    {
+        if (const auto it = levels_.find(node_id); it != levels_.end())
+        {
+            cached_rects_count_ -= it->second.children_rects.size();
+            levels_.erase(it);
+        }
+    }
+}
+
+void LazyRectTreeDrawData::Clear()
+{
+    levels_.clear();
+    cached_rects_count_ = 0;
+}
+
+}  // namespace rect_tree_viewer
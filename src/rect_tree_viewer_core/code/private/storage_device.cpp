@@ -0,0 +1,79 @@
+#include "storage_device.hpp"
+
+#ifdef __linux__
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#endif
+
+#include <fstream>
+
+#include "fmt/format.h"
+
+namespace
+{
+
+[[nodiscard]] uint32_t GetMajor(uint64_t device)
+{
+    return static_cast<uint32_t>(device >> 32);
+}
+
+[[nodiscard]] uint32_t GetMinor(uint64_t device)
+{
+    return static_cast<uint32_t>(device);
+}
+
+// Contents of a sysfs flag file, if it exists
+[[nodiscard]] std::optional<bool> ReadFlag(const std::filesystem::path& path)
+{
+    std::ifstream file(path);
+    char flag = 0;
+    if (!(file >> flag)) return std::nullopt;
+    return flag != '0';
+}
+
+}  // namespace
+
+std::optional<uint64_t> GetPathDevice([[maybe_unused]] const std::filesystem::path& path)
+{
+#ifdef __linux__
+    struct stat path_stat{};
+    if (stat(path.c_str(), &path_stat) != 0) return std::nullopt;
+    return (uint64_t{major(path_stat.st_dev)} << 32) | minor(path_stat.st_dev);
+#else
+    return std::nullopt;
+#endif
+}
+
+StorageDeviceKind GetStorageDeviceKind([[maybe_unused]] uint64_t device)
+{
+#ifdef __linux__
+    // Major 0 is for devices without a block device behind them: NFS, tmpfs, overlays
+    if (GetMajor(device) == 0) return StorageDeviceKind::Unknown;
+
+    const std::filesystem::path block_path = fmt::format("/sys/dev/block/{}", FormatDevice(device));
+    std::optional<bool> rotational = ReadFlag(block_path / "queue" / "rotational");
+    if (!rotational) rotational = ReadFlag(block_path / ".." / "queue" / "rotational");
+    if (rotational) return *rotational ? StorageDeviceKind::Rotational : StorageDeviceKind::SolidState;
+#endif
+    return StorageDeviceKind::Unknown;
+}
+
+std::string FormatDevice(uint64_t device)
+{
+    return fmt::format("{}:{}", GetMajor(device), GetMinor(device));
+}
+
+std::string_view ToString(StorageDeviceKind kind)
+{
+    switch (kind)
+    {
+    case StorageDeviceKind::Rotational:
+        return "rotational";
+    case StorageDeviceKind::SolidState:
+        return "solid state";
+    case StorageDeviceKind::Unknown:
+        break;
+    }
+
+    return "unknown";
+}
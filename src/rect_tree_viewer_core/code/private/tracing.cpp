@@ -0,0 +1,257 @@
+#include "tracing.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "json_file_writer.hpp"
+
+namespace
+{
+
+enum class TraceEventType : uint8_t
+{
+    Scope,
+    Counter
+};
+
+struct TraceEvent
+{
+    const char* name = nullptr;
+    Tracing::Clock::time_point begin{};
+    Tracing::Clock::duration duration{};
+    double value = 0;
+    TraceEventType type = TraceEventType::Scope;
+};
+
+// Written by its thread, read by the export. The lock is almost never contended
+class ThreadTraceBuffer
+{
+public:
+    explicit ThreadTraceBuffer(uint32_t thread_id) : thread_id_(thread_id) {}
+
+    void Push(const TraceEvent& event)
+    {
+        const std::lock_guard lock(mutex_);
+        if (events_.size() < Tracing::kRingBufferSize)
+        {
+            events_.push_back(event);
+        }
+        else
+        {
+            events_[pushed_events_count_ % events_.size()] = event;
+        }
+
+        ++pushed_events_count_;
+    }
+
+    void SetName(std::string_view name)
+    {
+        const std::lock_guard lock(mutex_);
+        name_ = name;
+    }
+
+    // Oldest events first
+    template <typename Callback>
+    void Visit(Callback&& callback) const
+    {
+        const std::lock_guard lock(mutex_);
+        const size_t first = pushed_events_count_ > events_.size() ? pushed_events_count_ % events_.size() : 0;
+        for (size_t i = 0; i != events_.size(); ++i) callback(events_[(first + i) % events_.size()]);
+    }
+
+    [[nodiscard]] uint32_t GetThreadId() const { return thread_id_; }
+
+    [[nodiscard]] bool IsEmpty() const
+    {
+        const std::lock_guard lock(mutex_);
+        return events_.empty();
+    }
+
+    [[nodiscard]] std::string GetName() const
+    {
+        const std::lock_guard lock(mutex_);
+        return name_;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<TraceEvent> events_;
+    size_t pushed_events_count_ = 0;
+    std::string name_;
+    uint32_t thread_id_ = 0;
+};
+
+// Buffers outlive their threads, so that scan workers can be exported after they finish. Every scan starts new
+// threads, only the last kMaxExitedThreadsCount exited ones are kept
+class TraceRegistry
+{
+public:
+    [[nodiscard]] std::shared_ptr<ThreadTraceBuffer> AddThread()
+    {
+        const std::lock_guard lock(mutex_);
+        return buffers_.emplace_back(std::make_shared<ThreadTraceBuffer>(++threads_count_));
+    }
+
+    void OnThreadExit(const std::shared_ptr<ThreadTraceBuffer>& buffer)
+    {
+        const std::lock_guard lock(mutex_);
+        if (buffer->IsEmpty())
+        {
+            std::erase(buffers_, buffer);
+            return;
+        }
+
+        exited_buffers_.push_back(buffer);
+        if (exited_buffers_.size() > Tracing::kMaxExitedThreadsCount)
+        {
+            std::erase(buffers_, exited_buffers_.front());
+            exited_buffers_.pop_front();
+        }
+    }
+
+    [[nodiscard]] std::vector<std::shared_ptr<ThreadTraceBuffer>> GetThreads() const
+    {
+        const std::lock_guard lock(mutex_);
+        return buffers_;
+    }
+
+    [[nodiscard]] Tracing::Clock::time_point GetStartTime() const { return start_time_; }
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<std::shared_ptr<ThreadTraceBuffer>> buffers_;
+    std::deque<std::shared_ptr<ThreadTraceBuffer>> exited_buffers_;
+    uint32_t threads_count_ = 0;
+    Tracing::Clock::time_point start_time_ = Tracing::Clock::now();
+};
+
+[[nodiscard]] TraceRegistry& GetTraceRegistry()
+{
+    static TraceRegistry registry;
+    return registry;
+}
+
+// Registers the buffer on the first event of the thread and hands it back to the registry when the thread exits
+class ThreadTraceBufferOwner
+{
+public:
+    ThreadTraceBufferOwner() : buffer_(GetTraceRegistry().AddThread()) {}
+    ThreadTraceBufferOwner(const ThreadTraceBufferOwner&) = delete;
+    ThreadTraceBufferOwner& operator=(const ThreadTraceBufferOwner&) = delete;
+    ~ThreadTraceBufferOwner() { GetTraceRegistry().OnThreadExit(buffer_); }
+
+    [[nodiscard]] ThreadTraceBuffer& GetBuffer() const { return *buffer_; }
+
+private:
+    std::shared_ptr<ThreadTraceBuffer> buffer_;
+};
+
+[[nodiscard]] ThreadTraceBuffer& GetThreadTraceBuffer()
+{
+    thread_local const ThreadTraceBufferOwner owner;
+    return owner.GetBuffer();
+}
+
+[[nodiscard]] double ToMicroseconds(Tracing::Clock::duration duration)
+{
+    return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+}  // namespace
+
+void Tracing::Enable()
+{
+    // Timestamps count from here
+    [[maybe_unused]] const TraceRegistry& registry = GetTraceRegistry();
+    enabled_.store(true, std::memory_order_relaxed);
+}
+
+void Tracing::SetThreadName(std::string_view name)
+{
+    GetThreadTraceBuffer().SetName(name);
+}
+
+void Tracing::RecordScope(const char* name, Clock::time_point begin, Clock::time_point end)
+{
+    GetThreadTraceBuffer().Push(
+        {.name = name, .begin = begin, .duration = end - begin, .value = 0, .type = TraceEventType::Scope});
+}
+
+void Tracing::RecordCounter(const char* name, double value)
+{
+    GetThreadTraceBuffer().Push(
+        {.name = name, .begin = Clock::now(), .duration = {}, .value = value, .type = TraceEventType::Counter});
+}
+
+void Tracing::WriteChromeTrace(const std::filesystem::path& path)
+{
+    const TraceRegistry& registry = GetTraceRegistry();
+    const Clock::time_point start_time = registry.GetStartTime();
+
+    JsonFileWriter writer(path, true);
+    writer.BeginObject();
+    writer.Key("displayTimeUnit");
+    writer.String("ms");
+    writer.Key("traceEvents");
+    writer.BeginArray();
+    for (const std::shared_ptr<ThreadTraceBuffer>& buffer : registry.GetThreads())
+    {
+        const uint32_t thread_id = buffer->GetThreadId();
+        if (const std::string name = buffer->GetName(); !name.empty())
+        {
+            writer.BeginObject();
+            writer.Key("name");
+            writer.String("thread_name");
+            writer.Key("ph");
+            writer.String("M");
+            writer.Key("pid");
+            writer.Number(uint64_t{1});
+            writer.Key("tid");
+            writer.Number(uint64_t{thread_id});
+            writer.Key("args");
+            writer.BeginObject();
+            writer.Key("name");
+            writer.String(name);
+            writer.EndObject();
+            writer.EndObject();
+        }
+
+        buffer->Visit(
+            [&](const TraceEvent& event)
+            {
+                const bool is_scope = event.type == TraceEventType::Scope;
+                writer.BeginObject();
+                writer.Key("name");
+                writer.String(event.name);
+                writer.Key("ph");
+                writer.String(is_scope ? "X" : "C");
+                writer.Key("ts");
+                writer.Number(ToMicroseconds(event.begin - start_time));
+                if (is_scope)
+                {
+                    writer.Key("dur");
+                    writer.Number(ToMicroseconds(event.duration));
+                }
+                writer.Key("pid");
+                writer.Number(uint64_t{1});
+                writer.Key("tid");
+                writer.Number(uint64_t{thread_id});
+                if (!is_scope)
+                {
+                    writer.Key("args");
+                    writer.BeginObject();
+                    writer.Key("value");
+                    writer.Number(event.value);
+                    writer.EndObject();
+                }
+                writer.EndObject();
+            });
+    }
+    writer.EndArray();
+    writer.EndObject();
+    writer.Finish();
+}
@@ -0,0 +1,177 @@
+#include "tree_child_index.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <ranges>
+
+#include "klgl/error_handling.hpp"
+#include "parallel_chunks.hpp"
+#include "tracing.hpp"
+
+namespace
+{
+
+// Smaller trees are indexed on the calling thread
+constexpr size_t kMinParallelIndexNodes = size_t{1} << 16;
+
+// Threads take nodes in chunks of this size
+constexpr size_t kIndexChunkSize = size_t{1} << 12;
+
+void SortChildren(const TreeNodes& nodes, std::span<NodeId> children)
+{
+    std::ranges::sort(
+        children,
+        [&](NodeId a, NodeId b)
+        {
+            const uint64_t a_value = nodes.GetValue(a);
+            const uint64_t b_value = nodes.GetValue(b);
+            return a_value != b_value ? a_value > b_value : a < b;
+        });
+}
+
+}  // namespace
+
+void TreeChildIndex::Build(const TreeNodes& nodes, size_t thread_count)
+{
+    TRACE_SCOPE("TreeChildIndex::Build");
+    thread_count = GetPassThreadCount(nodes.Size(), thread_count, kMinParallelIndexNodes);
+
+    // Children are counted by sibling links rather than by parent links, so every node is written by one thread
+    ranges_.assign(nodes.Size(), {});
+    ForEachChunk(
+        nodes.Size(),
+        kIndexChunkSize,
+        thread_count,
+        [&](size_t begin, size_t end)
+        {
+            for (auto node_id = static_cast<NodeId>(begin); node_id != end; ++node_id)
+            {
+                uint32_t children_count = 0;
+                for (NodeId child = nodes.GetFirstChild(node_id); child != kInvalidNodeId;
+                     child = nodes.GetNextSibling(child))
+                {
+                    ++children_count;
+                }
+
+                ranges_[node_id].end = children_count;
+            }
+        });
+
+    uint32_t offset = 0;
+    for (Range& range : ranges_)
+    {
+        range.begin = offset;
+        offset += range.end;
+        range.end = offset;
+    }
+
+    children_.resize(offset);
+    ForEachChunk(
+        nodes.Size(),
+        kIndexChunkSize,
+        thread_count,
+        [&](size_t begin, size_t end)
+        {
+            for (auto node_id = static_cast<NodeId>(begin); node_id != end; ++node_id)
+            {
+                const Range range = ranges_[node_id];
+                uint32_t index = range.begin;
+                for (NodeId child = nodes.GetFirstChild(node_id); child != kInvalidNodeId;
+                     child = nodes.GetNextSibling(child))
+                {
+                    children_[index++] = child;
+                }
+
+                SortChildren(nodes, std::span{children_}.subspan(range.begin, range.end - range.begin));
+            }
+        });
+
+    unused_count_ = 0;
+}
+
+void TreeChildIndex::Update(const TreeNodes& nodes, std::span<const NodeId> dirty_nodes)
+{
+    TRACE_SCOPE("TreeChildIndex::Update");
+    const auto indexed_count = static_cast<NodeId>(ranges_.size());
+    ranges_.resize(nodes.Size());
+    for (const NodeId node_id : dirty_nodes)
+    {
+        if (node_id < indexed_count) Reindex(nodes, node_id);
+    }
+
+    for (const NodeId node_id : std::views::iota(indexed_count, static_cast<NodeId>(nodes.Size())))
+    {
+        Reindex(nodes, node_id);
+    }
+
+    // A rebuild costs about as much as copying the entries that are still used
+    if (unused_count_ > nodes.Size()) Build(nodes);
+}
+
+void TreeChildIndex::Reindex(const TreeNodes& nodes, NodeId node_id)
+{
+    scratch_.clear();
+    for (NodeId child = nodes.GetFirstChild(node_id); child != kInvalidNodeId; child = nodes.GetNextSibling(child))
+    {
+        scratch_.push_back(child);
+    }
+
+    SortChildren(nodes, scratch_);
+
+    // Ranges that grew move to the end, the old entries stay unused until the next rebuild
+    Range& range = ranges_[node_id];
+    const size_t capacity = range.end - range.begin;
+    if (scratch_.size() > capacity)
+    {
+        klgl::ErrorHandling::Ensure(
+            children_.size() + scratch_.size() <= std::numeric_limits<uint32_t>::max(),
+            "Too many entries in the child index: {}",
+            children_.size());
+        unused_count_ += capacity;
+        range.begin = static_cast<uint32_t>(children_.size());
+        children_.insert(children_.end(), scratch_.begin(), scratch_.end());
+    }
+    else
+    {
+        unused_count_ += capacity - scratch_.size();
+        std::ranges::copy(scratch_, children_.begin() + range.begin);
+    }
+
+    range.end = range.begin + static_cast<uint32_t>(scratch_.size());
+}
+
+void TreeChildIndex::ComputeSubtreeSizes(NodeId root, std::vector<uint32_t>& out_sizes) const
+{
+    TRACE_SCOPE("TreeChildIndex::ComputeSubtreeSizes");
+    out_sizes.assign(Size(), 0);
+
+    // Children follow their parent in the preorder, so the reverse pass sizes them first
+    std::vector<NodeId> preorder;
+    std::vector<NodeId> stack{root};
+    while (!stack.empty())
+    {
+        const NodeId node_id = stack.back();
+        stack.pop_back();
+        preorder.push_back(node_id);
+        stack.insert(stack.end(), GetChildren(node_id).begin(), GetChildren(node_id).end());
+    }
+
+    for (const NodeId node_id : preorder | std::views::reverse)
+    {
+        uint32_t subtree_size = 1;
+        for (const NodeId child : GetChildren(node_id)) subtree_size += out_sizes[child];
+        out_sizes[node_id] = subtree_size;
+    }
+}
+
+size_t TreeChildIndex::GetMemoryUsage() const
+{
+    return ranges_.capacity() * sizeof(Range) + children_.capacity() * sizeof(NodeId);
+}
+
+void TreeChildIndex::Clear()
+{
+    ranges_.clear();
+    children_.clear();
+    unused_count_ = 0;
+}
@@ -0,0 +1,333 @@
+#include "tree_json.hpp"
+
+#include <charconv>
+#include <cmath>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "fmt/std.h"  // IWYU pragma: keep
+#include "json_file_writer.hpp"
+#include "json_sax_parser.hpp"
+#include "klgl/error_handling.hpp"
+#include "mapped_file.hpp"
+#include "path_helpers.hpp"
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+// Adds nodes to the tree as their objects end. Depth 1 is the document object, 2 the arrays in it and 3 the nodes
+class TreeJsonHandler
+{
+public:
+    void OnObjectBegin()
+    {
+        ++depth_;
+        if (!IsNode()) return;
+
+        // The name keeps its capacity for the next nodes
+        node_.name.clear();
+        node_.value = 0;
+        node_.parent = kInvalidNodeId;
+        node_.first_child = kInvalidNodeId;
+        node_.next_sibling = kInvalidNodeId;
+        node_.aggregated_files_count = 0;
+    }
+
+    void OnObjectEnd()
+    {
+        if (IsNode())
+        {
+            const NodeId node_id = snapshot_.nodes.Add(node_.name, node_.value, node_.parent);
+            snapshot_.nodes.SetFirstChild(node_id, node_.first_child);
+            snapshot_.nodes.SetNextSibling(node_id, node_.next_sibling);
+            if (node_.aggregated_files_count != 0)
+            {
+                snapshot_.nodes.AddAggregate(node_id, node_.aggregated_files_count);
+            }
+        }
+
+        --depth_;
+    }
+
+    void OnArrayBegin() { ++depth_; }
+    void OnArrayEnd() { --depth_; }
+
+    void OnKey(std::string_view key)
+    {
+        if (depth_ == 1) document_key_ = ToDocumentKey(key);
+        if (IsNode()) node_key_ = ToNodeKey(key);
+    }
+
+    void OnString(std::string_view value)
+    {
+        if (IsNode() && node_key_ == NodeKey::Name)
+        {
+            node_.name.assign(value);
+        }
+        else if (depth_ == 2 && document_key_ == DocumentKey::RootPaths)
+        {
+            snapshot_.root_paths.push_back(PathHelpers::PathFromUTF8(value));
+        }
+    }
+
+    void OnNumber(std::string_view text)
+    {
+        if (IsNode())
+        {
+            switch (node_key_)
+            {
+            case NodeKey::Value:
+                node_.value = ParseValue(text);
+                break;
+            case NodeKey::Parent:
+                node_.parent = ParseInteger<NodeId>(text);
+                break;
+            case NodeKey::FirstChild:
+                node_.first_child = ParseInteger<NodeId>(text);
+                break;
+            case NodeKey::NextSibling:
+                node_.next_sibling = ParseInteger<NodeId>(text);
+                break;
+            case NodeKey::AggregatedFiles:
+                node_.aggregated_files_count = ParseInteger<uint64_t>(text);
+                break;
+            default:
+                break;
+            }
+        }
+        else if (depth_ == 2 && document_key_ == DocumentKey::RootNodes)
+        {
+            root_nodes_.push_back(ParseInteger<NodeId>(text));
+        }
+    }
+
+    void OnBool(bool) {}
+    void OnNull() {}
+
+    // Path is for error messages
+    [[nodiscard]] TreeSnapshot TakeSnapshot(const fs::path& path)
+    {
+        const TreeNodes& nodes = snapshot_.nodes;
+        ValidateTreeColumns(nodes.GetColumns(), path);
+
+        klgl::ErrorHandling::Ensure(
+            root_nodes_.size() == snapshot_.root_paths.size(),
+            "The JSON tree has {} root nodes for {} root paths",
+            root_nodes_.size(),
+            snapshot_.root_paths.size());
+        for (size_t path_index = 0; path_index != root_nodes_.size(); ++path_index)
+        {
+            // Root paths that were not scanned yet have no node
+            if (root_nodes_[path_index] == kInvalidNodeId) continue;
+            klgl::ErrorHandling::Ensure(
+                root_nodes_[path_index] < nodes.Size(),
+                "Root node {} of the JSON tree does not exist",
+                root_nodes_[path_index]);
+            snapshot_.root_node_id_to_path_index[root_nodes_[path_index]] = path_index;
+        }
+
+        return std::move(snapshot_);
+    }
+
+private:
+    enum class DocumentKey : uint8_t
+    {
+        Other,
+        Nodes,
+        RootNodes,
+        RootPaths
+    };
+
+    enum class NodeKey : uint8_t
+    {
+        Other,
+        Name,
+        Value,
+        Parent,
+        FirstChild,
+        NextSibling,
+        AggregatedFiles
+    };
+
+    struct Node
+    {
+        std::string name;
+        uint64_t value = 0;
+        NodeId parent = kInvalidNodeId;
+        NodeId first_child = kInvalidNodeId;
+        NodeId next_sibling = kInvalidNodeId;
+        uint64_t aggregated_files_count = 0;
+    };
+
+    [[nodiscard]] static DocumentKey ToDocumentKey(std::string_view key)
+    {
+        if (key == "nodes") return DocumentKey::Nodes;
+        if (key == "root_nodes") return DocumentKey::RootNodes;
+        if (key == "root_paths") return DocumentKey::RootPaths;
+        return DocumentKey::Other;
+    }
+
+    [[nodiscard]] static NodeKey ToNodeKey(std::string_view key)
+    {
+        if (key == "name") return NodeKey::Name;
+        if (key == "value") return NodeKey::Value;
+        if (key == "parent") return NodeKey::Parent;
+        if (key == "first_child") return NodeKey::FirstChild;
+        if (key == "next_sibling") return NodeKey::NextSibling;
+        if (key == "aggregated_files") return NodeKey::AggregatedFiles;
+        return NodeKey::Other;
+    }
+
+    template <typename T>
+    [[nodiscard]] static T ParseInteger(std::string_view text)
+    {
+        T value = 0;
+        const char* text_end = text.data() + text.size();  // NOLINT
+        const auto [end, err] = std::from_chars(text.data(), text_end, value);
+        klgl::ErrorHandling::Ensure(
+            err == std::errc{} && end == text_end,
+            "Expected an unsigned integer in the JSON tree, got {}",
+            text);
+        return value;
+    }
+
+    // Files of earlier versions have sizes as floating point numbers, like 4096.0
+    [[nodiscard]] static uint64_t ParseValue(std::string_view text)
+    {
+        uint64_t value = 0;
+        const char* text_end = text.data() + text.size();  // NOLINT
+        const auto [integer_end, integer_err] = std::from_chars(text.data(), text_end, value);
+        if (integer_err == std::errc{} && integer_end == text_end) return value;
+
+        // 2^64, the first double that does not fit
+        constexpr double kValueLimit = 18446744073709551616.0;
+        double floating_value = 0;
+        const auto [end, err] = std::from_chars(text.data(), text_end, floating_value);
+        klgl::ErrorHandling::Ensure(
+            err == std::errc{} && end == text_end && std::isfinite(floating_value) && floating_value >= 0 &&
+                floating_value < kValueLimit && std::trunc(floating_value) == floating_value,
+            "Expected a whole non-negative size in the JSON tree, got {}",
+            text);
+        return static_cast<uint64_t>(floating_value);
+    }
+
+    [[nodiscard]] bool IsNode() const { return depth_ == 3 && document_key_ == DocumentKey::Nodes; }
+
+    TreeSnapshot snapshot_;
+    std::vector<NodeId> root_nodes_;
+    Node node_;
+    size_t depth_ = 0;
+    DocumentKey document_key_ = DocumentKey::Other;
+    NodeKey node_key_ = NodeKey::Other;
+};
+
+}  // namespace
+
+void WriteTreeJson(
+    const std::filesystem::path& path,
+    const TreeNodes& nodes,
+    std::span<const std::filesystem::path> root_paths,
+    const std::unordered_map<NodeId, size_t>& root_node_id_to_path_index,
+    bool compact)
+{
+    JsonFileWriter writer(path, compact);
+    writer.BeginObject();
+
+    writer.Key("nodes");
+    writer.BeginArray();
+    for (const NodeId node_id : nodes.Ids())
+    {
+        writer.BeginObject();
+        if (const uint64_t aggregated_files_count = nodes.GetAggregatedFilesCount(node_id); aggregated_files_count != 0)
+        {
+            writer.Key("aggregated_files");
+            writer.Number(aggregated_files_count);
+        }
+
+        if (const NodeId child = nodes.GetFirstChild(node_id); child != kInvalidNodeId)
+        {
+            writer.Key("first_child");
+            writer.Number(child);
+        }
+
+        writer.Key("name");
+        writer.String(nodes.GetName(node_id));
+
+        if (const NodeId sibling = nodes.GetNextSibling(node_id); sibling != kInvalidNodeId)
+        {
+            writer.Key("next_sibling");
+            writer.Number(sibling);
+        }
+
+        if (const NodeId parent = nodes.GetParent(node_id); parent != kInvalidNodeId)
+        {
+            writer.Key("parent");
+            writer.Number(parent);
+        }
+
+        writer.Key("value");
+        writer.Number(nodes.GetValue(node_id));
+        writer.EndObject();
+    }
+    writer.EndArray();
+
+    if (!root_paths.empty())
+    {
+        std::vector<NodeId> root_nodes(root_paths.size(), kInvalidNodeId);
+        for (const auto& [node_id, path_index] : root_node_id_to_path_index) root_nodes[path_index] = node_id;
+
+        writer.Key("root_nodes");
+        writer.BeginArray();
+        for (const NodeId node_id : root_nodes) writer.Number(node_id);
+        writer.EndArray();
+
+        writer.Key("root_paths");
+        writer.BeginArray();
+        for (const fs::path& root_path : root_paths) writer.String(PathHelpers::PathToUTF8(root_path));
+        writer.EndArray();
+    }
+
+    writer.EndObject();
+    writer.Finish();
+}
+
+TreeSnapshot ReadTreeJson(const std::filesystem::path& path)
+{
+    const MappedFile file(path, MappedFileAccess::Sequential);
+    const std::span<const std::byte> bytes = file.GetBytes();
+    const std::string_view text(reinterpret_cast<const char*>(bytes.data()), bytes.size());  // NOLINT
+
+    TreeJsonHandler handler;
+    JsonSaxParser(text, true).Parse(handler);
+    return handler.TakeSnapshot(path);
+}
+
+bool IsTreeJsonPath(const std::filesystem::path& path)
+{
+    return path.extension() == ".json";
+}
+
+TreeSnapshot LoadTreeFile(const std::filesystem::path& path)
+{
+    return IsTreeJsonPath(path) ? ReadTreeJson(path) : LoadTreeSnapshot(path);
+}
+
+void WriteTreeFile(
+    const std::filesystem::path& path,
+    const TreeNodes& nodes,
+    std::span<const std::filesystem::path> root_paths,
+    const std::unordered_map<NodeId, size_t>& root_node_id_to_path_index,
+    bool compact_json)
+{
+    if (IsTreeJsonPath(path))
+    {
+        WriteTreeJson(path, nodes, root_paths, root_node_id_to_path_index, compact_json);
+    }
+    else
+    {
+        WriteTreeSnapshot(path, nodes, root_paths, root_node_id_to_path_index);
+    }
+}
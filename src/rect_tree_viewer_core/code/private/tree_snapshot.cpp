@@ -0,0 +1,310 @@
+#include "tree_snapshot.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <ranges>
+#include <vector>
+
+#include "fmt/std.h"  // IWYU pragma: keep
+#include "klgl/error_handling.hpp"
+#include "mapped_file.hpp"
+#include "path_helpers.hpp"
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+constexpr std::array<char, 8> kSnapshotMagic{'R', 'T', 'V', 'S', 'N', 'A', 'P', '\0'};
+constexpr uint32_t kSnapshotVersion = 3;
+constexpr uint32_t kByteOrderMark = 0x01020304;
+constexpr size_t kSectionAlignment = 8;
+
+enum class SnapshotSection : uint8_t
+{
+    Values,
+    NameOffsets,
+    Parents,
+    FirstChildren,
+    NextSiblings,
+    NameLengths,
+    StampedDirectories,
+    DirectoryStamps,
+    AggregateNodes,
+    AggregatedFilesCounts,
+    Roots,
+    Names,
+    RootPaths,
+    Count
+};
+
+struct SnapshotSectionLocation
+{
+    uint64_t offset = 0;
+    uint64_t size = 0;
+};
+
+struct SnapshotHeader
+{
+    std::array<char, 8> magic = kSnapshotMagic;
+    uint32_t version = kSnapshotVersion;
+    uint32_t byte_order_mark = kByteOrderMark;
+    uint64_t nodes_count = 0;
+    uint64_t roots_count = 0;
+    uint64_t stamped_directories_count = 0;
+    uint64_t aggregate_nodes_count = 0;
+    std::array<SnapshotSectionLocation, static_cast<size_t>(SnapshotSection::Count)> sections{};
+
+    [[nodiscard]] const SnapshotSectionLocation& GetSection(SnapshotSection section) const
+    {
+        return sections[static_cast<size_t>(section)];
+    }
+};
+
+// Root path of the tree: node id and location of its UTF-8 path in the RootPaths section
+struct SnapshotRoot
+{
+    NodeId node_id = 0;
+    uint32_t path_size = 0;
+    uint64_t path_offset = 0;
+};
+
+[[nodiscard]] constexpr uint64_t AlignSectionOffset(uint64_t offset)
+{
+    return (offset + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment;
+}
+
+// Returns the section as an array of T after checking its bounds, size and alignment
+template <typename T>
+[[nodiscard]] std::span<const T> GetSectionItems(
+    std::span<const std::byte> bytes,
+    const SnapshotHeader& header,
+    SnapshotSection section,
+    uint64_t expected_count,
+    const fs::path& path)
+{
+    const SnapshotSectionLocation& location = header.GetSection(section);
+    klgl::ErrorHandling::Ensure(
+        location.offset <= bytes.size() && location.size <= bytes.size() - location.offset &&
+            location.size == expected_count * sizeof(T) && location.offset % alignof(T) == 0,
+        "Snapshot {} has corrupted section {}",
+        path,
+        static_cast<int>(section));
+    return {reinterpret_cast<const T*>(bytes.data() + location.offset), expected_count};  // NOLINT
+}
+
+}  // namespace
+
+void ValidateTreeColumns(const TreeNodes::Columns& columns, const fs::path& path)
+{
+    const size_t n = columns.values.size();
+    const size_t names_size = columns.names.size();
+    for (const size_t i : std::views::iota(size_t{0}, n))
+    {
+        klgl::ErrorHandling::Ensure(
+            columns.name_offsets[i] <= names_size && columns.name_lengths[i] <= names_size - columns.name_offsets[i],
+            "Snapshot {} has corrupted name of node {}",
+            path,
+            i);
+        klgl::ErrorHandling::Ensure(
+            columns.parents[i] < i || columns.parents[i] == kInvalidNodeId,
+            "Snapshot {} has corrupted parent of node {}",
+            path,
+            i);
+    }
+
+    // Every node with a parent is visited once, from the child list of that parent
+    std::vector<bool> visited(n, false);
+    for (const size_t parent : std::views::iota(size_t{0}, n))
+    {
+        for (NodeId child = columns.first_children[parent]; child != kInvalidNodeId;
+             child = columns.next_siblings[child])
+        {
+            klgl::ErrorHandling::Ensure(
+                child < n && columns.parents[child] == parent && !visited[child],
+                "Snapshot {} has corrupted children of node {}",
+                path,
+                parent);
+            visited[child] = true;
+        }
+    }
+
+    for (const size_t i : std::views::iota(size_t{0}, n))
+    {
+        klgl::ErrorHandling::Ensure(
+            visited[i] == (columns.parents[i] != kInvalidNodeId) &&
+                (visited[i] || columns.next_siblings[i] == kInvalidNodeId),
+            "Snapshot {} has corrupted links of node {}",
+            path,
+            i);
+    }
+
+    for (const size_t i : std::views::iota(size_t{0}, columns.stamped_directories.size()))
+    {
+        const NodeId node_id = columns.stamped_directories[i];
+        klgl::ErrorHandling::Ensure(
+            node_id < n && (i == 0 || columns.stamped_directories[i - 1] < node_id),
+            "Snapshot {} has corrupted directory stamp {}",
+            path,
+            i);
+    }
+
+    for (const size_t i : std::views::iota(size_t{0}, columns.aggregate_nodes.size()))
+    {
+        const NodeId node_id = columns.aggregate_nodes[i];
+        klgl::ErrorHandling::Ensure(
+            node_id < n && (i == 0 || columns.aggregate_nodes[i - 1] < node_id),
+            "Snapshot {} has corrupted aggregate node {}",
+            path,
+            i);
+    }
+}
+
+void WriteTreeSnapshot(
+    const fs::path& path,
+    const TreeNodes& nodes,
+    std::span<const fs::path> root_paths,
+    const std::unordered_map<NodeId, size_t>& root_node_id_to_path_index)
+{
+    static_assert(std::endian::native == std::endian::little, "Snapshot format assumes little endian");
+
+    std::vector<SnapshotRoot> roots;
+    std::string root_paths_blob;
+    for (const auto& [node_id, path_index] : root_node_id_to_path_index)
+    {
+        const std::string root_path = PathHelpers::PathToUTF8(root_paths[path_index]);
+        roots.push_back({
+            .node_id = node_id,
+            .path_size = static_cast<uint32_t>(root_path.size()),
+            .path_offset = root_paths_blob.size(),
+        });
+        root_paths_blob += root_path;
+    }
+
+    std::ranges::sort(roots, std::less{}, &SnapshotRoot::node_id);
+
+    const TreeNodes::Columns columns = nodes.GetColumns();
+
+    // Section contents in file order
+    std::array<std::span<const std::byte>, static_cast<size_t>(SnapshotSection::Count)> contents;
+    contents[static_cast<size_t>(SnapshotSection::Values)] = std::as_bytes(columns.values);
+    contents[static_cast<size_t>(SnapshotSection::NameOffsets)] = std::as_bytes(columns.name_offsets);
+    contents[static_cast<size_t>(SnapshotSection::Parents)] = std::as_bytes(columns.parents);
+    contents[static_cast<size_t>(SnapshotSection::FirstChildren)] = std::as_bytes(columns.first_children);
+    contents[static_cast<size_t>(SnapshotSection::NextSiblings)] = std::as_bytes(columns.next_siblings);
+    contents[static_cast<size_t>(SnapshotSection::NameLengths)] = std::as_bytes(columns.name_lengths);
+    contents[static_cast<size_t>(SnapshotSection::StampedDirectories)] = std::as_bytes(columns.stamped_directories);
+    contents[static_cast<size_t>(SnapshotSection::DirectoryStamps)] = std::as_bytes(columns.directory_stamps);
+    contents[static_cast<size_t>(SnapshotSection::AggregateNodes)] = std::as_bytes(columns.aggregate_nodes);
+    contents[static_cast<size_t>(SnapshotSection::AggregatedFilesCounts)] =
+        std::as_bytes(columns.aggregated_files_counts);
+    contents[static_cast<size_t>(SnapshotSection::Roots)] = std::as_bytes(std::span{roots});
+    contents[static_cast<size_t>(SnapshotSection::Names)] = std::as_bytes(columns.names);
+    contents[static_cast<size_t>(SnapshotSection::RootPaths)] = std::as_bytes(std::span{root_paths_blob});
+
+    SnapshotHeader header;
+    header.nodes_count = nodes.Size();
+    header.roots_count = roots.size();
+    header.stamped_directories_count = columns.stamped_directories.size();
+    header.aggregate_nodes_count = columns.aggregate_nodes.size();
+    uint64_t offset = AlignSectionOffset(sizeof(SnapshotHeader));
+    for (const size_t i : std::views::iota(size_t{0}, contents.size()))
+    {
+        header.sections[i] = {.offset = offset, .size = contents[i].size()};
+        offset = AlignSectionOffset(offset + contents[i].size());
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    klgl::ErrorHandling::Ensure(file.is_open(), "Failed to open {} for writing", path);
+
+    auto write_bytes = [&](std::span<const std::byte> bytes)
+    {
+        file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));  // NOLINT
+    };
+
+    constexpr std::array<std::byte, kSectionAlignment> padding{};
+    write_bytes(std::as_bytes(std::span{&header, 1}));
+    uint64_t written = sizeof(SnapshotHeader);
+    for (const size_t i : std::views::iota(size_t{0}, contents.size()))
+    {
+        write_bytes(std::span{padding}.first(header.sections[i].offset - written));
+        write_bytes(contents[i]);
+        written = header.sections[i].offset + contents[i].size();
+    }
+
+    file.flush();
+    klgl::ErrorHandling::Ensure(file.good(), "Failed to write snapshot to {}", path);
+}
+
+TreeSnapshot LoadTreeSnapshot(const fs::path& path)
+{
+    auto file = std::make_shared<const MappedFile>(path);
+    const std::span<const std::byte> bytes = file->GetBytes();
+
+    SnapshotHeader header;
+    klgl::ErrorHandling::Ensure(bytes.size() >= sizeof(SnapshotHeader), "{} is too small to be a snapshot", path);
+    std::memcpy(&header, bytes.data(), sizeof(SnapshotHeader));
+    klgl::ErrorHandling::Ensure(header.magic == kSnapshotMagic, "{} is not a tree snapshot", path);
+    klgl::ErrorHandling::Ensure(
+        header.version == kSnapshotVersion,
+        "Snapshot {} has version {}, expected {}",
+        path,
+        header.version,
+        kSnapshotVersion);
+    klgl::ErrorHandling::Ensure(header.byte_order_mark == kByteOrderMark, "Snapshot {} has foreign byte order", path);
+    klgl::ErrorHandling::Ensure(header.nodes_count < kInvalidNodeId, "Snapshot {} has too many nodes", path);
+    klgl::ErrorHandling::Ensure(
+        header.roots_count <= header.nodes_count && header.stamped_directories_count <= header.nodes_count &&
+            header.aggregate_nodes_count <= header.nodes_count,
+        "Snapshot {} has corrupted header",
+        path);
+
+    const uint64_t n = header.nodes_count;
+    const uint64_t stamps_count = header.stamped_directories_count;
+    const uint64_t aggregates_count = header.aggregate_nodes_count;
+    const uint64_t names_size = header.GetSection(SnapshotSection::Names).size;
+    const uint64_t root_paths_size = header.GetSection(SnapshotSection::RootPaths).size;
+    const TreeNodes::Columns columns{
+        .names = GetSectionItems<char>(bytes, header, SnapshotSection::Names, names_size, path),
+        .name_offsets = GetSectionItems<uint64_t>(bytes, header, SnapshotSection::NameOffsets, n, path),
+        .name_lengths = GetSectionItems<uint16_t>(bytes, header, SnapshotSection::NameLengths, n, path),
+        .values = GetSectionItems<uint64_t>(bytes, header, SnapshotSection::Values, n, path),
+        .parents = GetSectionItems<NodeId>(bytes, header, SnapshotSection::Parents, n, path),
+        .first_children = GetSectionItems<NodeId>(bytes, header, SnapshotSection::FirstChildren, n, path),
+        .next_siblings = GetSectionItems<NodeId>(bytes, header, SnapshotSection::NextSiblings, n, path),
+        .stamped_directories =
+            GetSectionItems<NodeId>(bytes, header, SnapshotSection::StampedDirectories, stamps_count, path),
+        .directory_stamps =
+            GetSectionItems<DirectoryStamp>(bytes, header, SnapshotSection::DirectoryStamps, stamps_count, path),
+        .aggregate_nodes =
+            GetSectionItems<NodeId>(bytes, header, SnapshotSection::AggregateNodes, aggregates_count, path),
+        .aggregated_files_counts =
+            GetSectionItems<uint64_t>(bytes, header, SnapshotSection::AggregatedFilesCounts, aggregates_count, path),
+    };
+
+    ValidateTreeColumns(columns, path);
+
+    const auto roots = GetSectionItems<SnapshotRoot>(bytes, header, SnapshotSection::Roots, header.roots_count, path);
+    const auto root_paths_blob =
+        GetSectionItems<char>(bytes, header, SnapshotSection::RootPaths, root_paths_size, path);
+
+    TreeSnapshot snapshot;
+    for (const SnapshotRoot& root : roots)
+    {
+        klgl::ErrorHandling::Ensure(
+            root.node_id < n && root.path_offset <= root_paths_blob.size() &&
+                root.path_size <= root_paths_blob.size() - root.path_offset,
+            "Snapshot {} has corrupted root {}",
+            path,
+            root.node_id);
+        const auto root_path = root_paths_blob.subspan(root.path_offset, root.path_size);
+        snapshot.root_node_id_to_path_index[root.node_id] = snapshot.root_paths.size();
+        snapshot.root_paths.push_back(PathHelpers::PathFromUTF8({root_path.data(), root_path.size()}));
+    }
+
+    snapshot.nodes.Borrow(columns, std::move(file));
+    return snapshot;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+// Heap allocations made through operator new by the calling thread. allocation_counter.cpp replaces the global
+// operator new and delete. It is built as the rect_tree_viewer_allocation_counter object library, which defines
+// RECT_TREE_VIEWER_ALLOCATION_COUNTER for the targets that link it: the benchmarks and debug builds of the viewer.
+// Other builds keep the default allocator and the counts stay zero. Compare counts around code that should not
+// allocate, the way the hover path in DrawGUI and the benchmarks do.
+class AllocationCounter
+{
+public:
+#ifdef RECT_TREE_VIEWER_ALLOCATION_COUNTER
+    static constexpr bool kEnabled = true;
+
+    [[nodiscard]] static uint64_t GetThreadAllocationsCount();
+    [[nodiscard]] static uint64_t GetThreadAllocatedBytes();
+#else
+    static constexpr bool kEnabled = false;
+
+    [[nodiscard]] static uint64_t GetThreadAllocationsCount() { return 0; }
+    [[nodiscard]] static uint64_t GetThreadAllocatedBytes() { return 0; }
+#endif
+};
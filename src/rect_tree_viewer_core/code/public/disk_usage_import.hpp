@@ -0,0 +1,16 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+
+#include "tree_snapshot.hpp"
+
+// Disk usage collected on other machines: ncdu exports (ncdu -o) and du -ab output. du -ab0 (NUL separated lines) is
+// accepted too, it keeps names with new lines intact.
+[[nodiscard]] bool IsDiskUsageDump(const std::filesystem::path& path);
+
+// Maps each dump and builds the tree from it. File values are apparent sizes, directories are sums of their
+// subtrees like in a scan: sizes of directory entries themselves are dropped. du does not tell empty directories from
+// files, they keep the size of their entry. Several dumps are put under a SELECTION root like several scanned paths.
+// Root paths are the ones recorded in the dumps.
+TreeSnapshot ImportDiskUsageDumps(std::span<const std::filesystem::path> paths);
@@ -0,0 +1,79 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <linux/io_uring.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Minimal io_uring on raw syscalls: one submission and one completion queue, used by the thread that created them.
+// Entries are submitted only by SubmitAndWait, so a caller that never queues more than GetEntriesCount requests
+// between calls cannot overflow either queue.
+class IoUring
+{
+public:
+    // None when the kernel is too old for openat and statx requests, has io_uring disabled or the sandbox blocks it
+    [[nodiscard]] static std::unique_ptr<IoUring> Create(uint32_t entries_count);
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+    ~IoUring();
+
+    [[nodiscard]] uint32_t GetEntriesCount() const { return sq_entries_count_; }
+
+    // Cleared entry to fill, null when GetEntriesCount entries are waiting for submission
+    [[nodiscard]] io_uring_sqe* GetSubmissionEntry();
+
+    // Submits queued entries and waits until at least wait_count completions are ready. False if the kernel refused
+    // the call, the ring should not be used after that. Adds the number of io_uring_enter calls to enter_calls
+    [[nodiscard]] bool SubmitAndWait(uint32_t wait_count, size_t& enter_calls);
+
+    // Calls callback(user_data, result) for every ready completion and frees their slots
+    template <typename Callback>
+    void ForEachCompletion(Callback&& callback)
+    {
+        uint32_t head = *cq_head_;
+        const uint32_t tail = std::atomic_ref(*cq_tail_).load(std::memory_order_acquire);
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe& completion = cqes_[head & cq_mask_];  // NOLINT
+            callback(completion.user_data, completion.res);
+        }
+
+        std::atomic_ref(*cq_head_).store(head, std::memory_order_release);
+    }
+
+private:
+    IoUring() = default;
+
+    [[nodiscard]] uint32_t GetReadyCompletionsCount() const;
+
+    int fd_ = -1;
+
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    uint32_t* sq_head_ = nullptr;
+    uint32_t* sq_tail_ = nullptr;
+    uint32_t* sq_array_ = nullptr;
+    uint32_t sq_mask_ = 0;
+    uint32_t sq_entries_count_ = 0;
+
+    // Entries up to queued_tail_ are filled, up to submitted_tail_ are passed to the kernel
+    uint32_t queued_tail_ = 0;
+    uint32_t submitted_tail_ = 0;
+
+    uint32_t* cq_head_ = nullptr;
+    uint32_t* cq_tail_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+    uint32_t cq_mask_ = 0;
+};
+
+#endif
@@ -0,0 +1,244 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "io_uring.hpp"
+#include "linux_directory_lister.hpp"
+#include "read_directory_tree.hpp"
+
+// LinuxDirectoryLister with the per-entry statx calls of a getdents64 buffer submitted as one io_uring batch, and the
+// openat of a directory submitted together with the statx of its stamp. getdents64 has no io_uring request, so
+// listing itself stays synchronous. Subdirectories are not opened ahead of their turn: queued descriptors would run
+// into the descriptor limit on wide trees. Each scan thread has its own lister and ring, created on first use, and
+// a lister whose ring cannot be created or fails makes synchronous calls instead.
+class IoUringDirectoryLister : public LinuxDirectoryLister
+{
+public:
+    // Opening a directory takes two requests. Bigger batches than the maximum bring nothing for directory listing
+    static constexpr uint32_t kMinQueueDepth = 2;
+    static constexpr uint32_t kMaxQueueDepth = 4096;
+
+    explicit IoUringDirectoryLister(const ReadDirectoryTreeParams& params)
+        : queue_depth_(std::clamp(params.io_uring_queue_depth, kMinQueueDepth, kMaxQueueDepth))
+    {
+    }
+
+    // Whether the kernel and the sandbox allow a ring with the requests this lister needs
+    [[nodiscard]] static bool IsAvailable() { return IoUring::Create(1) != nullptr; }
+
+    [[nodiscard]] std::optional<Directory> Open(const Task& task, ReadDirectoryTreeSyscalls& syscalls)
+    {
+        IoUring* ring = GetRing();
+        if (!ring) return LinuxDirectoryLister::Open(task, syscalls);
+
+        // Same flags as LinuxDirectoryLister::Open. The stamp is read by name rather than from the new descriptor,
+        // which is the same directory unless it is replaced between the two requests
+        const int parent_fd = task.parent ? task.parent->fd : AT_FDCWD;
+        const int open_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC | (task.parent ? O_NOFOLLOW : 0);
+        const int stat_flags = task.parent ? AT_SYMLINK_NOFOLLOW : 0;
+
+        io_uring_sqe* open_request = ring->GetSubmissionEntry();
+        open_request->opcode = IORING_OP_OPENAT;
+        open_request->fd = parent_fd;
+        open_request->addr = reinterpret_cast<uint64_t>(task.name.c_str());  // NOLINT
+        open_request->open_flags = static_cast<uint32_t>(open_flags);
+        open_request->user_data = 0;
+        ++syscalls.open_calls;
+
+        struct statx& directory_stat = stat_buffers_[0];
+        PrepareStat(
+            *ring->GetSubmissionEntry(),
+            parent_fd,
+            task.name.c_str(),
+            stat_flags,
+            kStampMask,
+            directory_stat,
+            1);
+        ++syscalls.stat_calls;
+
+        std::array<int32_t, 2> results{kPendingResult, kPendingResult};
+        if (!SubmitAndReap(*ring, syscalls, results))
+        {
+            // The open may have completed before the ring failed
+            if (results[0] >= 0) close(results[0]);
+            return LinuxDirectoryLister::Open(task, syscalls);
+        }
+
+        if (results[0] < 0) return std::nullopt;
+        Directory directory{.descriptor = std::make_shared<const DirectoryDescriptor>(results[0]), .stamp = {}};
+        if (results[1] == 0) directory.stamp = MakeStamp(directory_stat);
+        return directory;
+    }
+
+    template <typename AddFile, typename AddDirectory>
+    void List(
+        const Directory& directory,
+        ReadDirectoryTreeSyscalls& syscalls,
+        AddFile&& add_file,
+        AddDirectory&& add_directory)
+    {
+        if (!GetRing())
+        {
+            LinuxDirectoryLister::List(directory, syscalls, add_file, add_directory);
+            return;
+        }
+
+        const int fd = directory.descriptor->fd;
+        constexpr int stat_flags = AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT;
+        constexpr unsigned stat_mask = STATX_TYPE | STATX_SIZE;
+
+        // Names point into the getdents64 buffer, so the batch is done before the buffer is read again
+        alignas(dirent64) std::array<char, 32 * 1024> buffer;  // NOLINT
+        auto finish_batch = [&]
+        {
+            if (stat_names_.empty()) return;
+
+            const auto results = std::span{stat_results_}.first(stat_names_.size());
+            std::ranges::fill(results, kPendingResult);
+            if (IoUring* ring = GetRing()) static_cast<void>(SubmitAndReap(*ring, syscalls, results));
+
+            // Without a ring, or when it failed
+            for (const size_t index : std::views::iota(size_t{0}, stat_names_.size()))
+            {
+                if (results[index] != kPendingResult) continue;
+                results[index] = statx(fd, stat_names_[index].data(), stat_flags, stat_mask, &stat_buffers_[index]);
+            }
+
+            for (const size_t index : std::views::iota(size_t{0}, stat_names_.size()))
+            {
+                if (results[index] != 0) continue;
+
+                const struct statx& entry_stat = stat_buffers_[index];
+                const std::string_view name = stat_names_[index];
+                if (S_ISREG(entry_stat.stx_mode))
+                {
+                    add_file(name, entry_stat.stx_size);
+                }
+                else if (S_ISDIR(entry_stat.stx_mode))
+                {
+                    add_directory(name, MakeChildTask(directory, name));
+                }
+            }
+
+            stat_names_.clear();
+        };
+
+        while (true)
+        {
+            ++syscalls.read_directory_calls;
+            const auto bytes_read = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+            if (bytes_read <= 0) break;
+
+            for (long offset = 0; offset < bytes_read;)
+            {
+                const auto* entry = reinterpret_cast<const dirent64*>(buffer.data() + offset);  // NOLINT
+                offset += entry->d_reclen;
+
+                const std::string_view name = entry->d_name;  // NOLINT
+                if (name == "." || name == "..") continue;
+
+                if (entry->d_type == DT_DIR)
+                {
+                    add_directory(name, MakeChildTask(directory, name));
+                }
+                else if (entry->d_type == DT_REG || entry->d_type == DT_UNKNOWN)
+                {
+                    if (stat_names_.size() == queue_depth_) finish_batch();
+
+                    const size_t index = stat_names_.size();
+                    stat_names_.push_back(name);
+                    ++syscalls.stat_calls;
+                    if (IoUring* ring = GetRing())
+                    {
+                        PrepareStat(
+                            *ring->GetSubmissionEntry(),
+                            fd,
+                            name.data(),
+                            stat_flags,
+                            stat_mask,
+                            stat_buffers_[index],
+                            index);
+                    }
+                }
+            }
+
+            finish_batch();
+        }
+    }
+
+private:
+    // Result of a request that did not complete. Real ones are descriptors, zero or negative errors
+    static constexpr int32_t kPendingResult = std::numeric_limits<int32_t>::min();
+
+    // Null once the ring failed
+    [[nodiscard]] IoUring* GetRing()
+    {
+        if (!ring_created_)
+        {
+            ring_created_ = true;
+            ring_ = IoUring::Create(queue_depth_);
+            stat_buffers_.resize(queue_depth_);
+            stat_results_.resize(queue_depth_);
+            stat_names_.reserve(queue_depth_);
+        }
+
+        return ring_.get();
+    }
+
+    static void PrepareStat(
+        io_uring_sqe& request,
+        int fd,
+        const char* name,
+        int flags,
+        unsigned mask,
+        struct statx& result,
+        size_t index)
+    {
+        request.opcode = IORING_OP_STATX;
+        request.fd = fd;
+        request.addr = reinterpret_cast<uint64_t>(name);     // NOLINT
+        request.off = reinterpret_cast<uint64_t>(&result);  // NOLINT
+        request.len = mask;
+        request.statx_flags = static_cast<uint32_t>(flags);
+        request.user_data = index;
+    }
+
+    // Submits queued requests and writes their results by user data index. Drops the ring if the kernel refuses the
+    // submission, results of requests that did not complete are left as they were
+    [[nodiscard]] bool SubmitAndReap(IoUring& ring, ReadDirectoryTreeSyscalls& syscalls, std::span<int32_t> results)
+    {
+        const bool submitted =
+            ring.SubmitAndWait(static_cast<uint32_t>(results.size()), syscalls.io_uring_enter_calls);
+        ring.ForEachCompletion([&](uint64_t index, int32_t result) { results[index] = result; });
+        if (!submitted) ring_.reset();
+        return submitted;
+    }
+
+    uint32_t queue_depth_ = 1;
+    bool ring_created_ = false;
+    std::unique_ptr<IoUring> ring_;
+
+    // Requests of the current batch
+    std::vector<std::string_view> stat_names_;
+    std::vector<struct statx> stat_buffers_;
+    std::vector<int32_t> stat_results_;
+};
+
+#endif
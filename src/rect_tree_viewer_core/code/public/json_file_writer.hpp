@@ -0,0 +1,246 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <concepts>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "fmt/format.h"
+#include "fmt/std.h"  // IWYU pragma: keep
+#include "klgl/error_handling.hpp"
+#include "path_helpers.hpp"
+
+// Streams JSON into a file. Values are formatted into a buffer that is written in big chunks
+class JsonFileWriter
+{
+public:
+    static constexpr size_t kFlushSize = size_t{1} << 20;
+
+    JsonFileWriter(const std::filesystem::path& path, bool compact)
+        : file_(PathHelpers::OpenFileForWriting(path), &std::fclose),
+          compact_(compact)
+    {
+        klgl::ErrorHandling::Ensure(file_ != nullptr, "Failed to open {}", path);
+        buffer_.reserve(kFlushSize + 4096);
+    }
+
+    void BeginObject() { BeginContainer('{'); }
+    void EndObject() { EndContainer('}'); }
+    void BeginArray() { BeginContainer('['); }
+    void EndArray() { EndContainer(']'); }
+
+    void Key(std::string_view key)
+    {
+        BeginValue();
+        AppendString(key);
+        buffer_ += compact_ ? ":" : ": ";
+        after_key_ = true;
+    }
+
+    void String(std::string_view value)
+    {
+        BeginValue();
+        AppendString(value);
+    }
+
+    template <std::unsigned_integral T>
+    void Number(T value)
+    {
+        BeginValue();
+        std::array<char, 24> digits{};
+        const auto [end, err] = std::to_chars(digits.data(), digits.data() + digits.size(), value);
+        buffer_.append(digits.data(), end);
+    }
+
+    // Shortest representation that reads back the same. Must be finite
+    void Number(double value)
+    {
+        BeginValue();
+        fmt::format_to(std::back_inserter(buffer_), "{}", value);
+    }
+
+    void Finish()
+    {
+        Flush();
+        klgl::ErrorHandling::Ensure(std::fflush(file_.get()) == 0, "Failed to write JSON");
+    }
+
+private:
+    void BeginValue()
+    {
+        if (buffer_.size() >= kFlushSize) Flush();
+
+        if (after_key_)
+        {
+            after_key_ = false;
+            return;
+        }
+
+        if (depth_ != 0)
+        {
+            if (!first_in_container_) buffer_ += ',';
+            NewLine();
+        }
+
+        first_in_container_ = false;
+    }
+
+    void BeginContainer(char bracket)
+    {
+        BeginValue();
+        buffer_ += bracket;
+        ++depth_;
+        first_in_container_ = true;
+    }
+
+    // Empty containers stay on one line
+    void EndContainer(char bracket)
+    {
+        --depth_;
+        if (!first_in_container_) NewLine();
+        buffer_ += bracket;
+        first_in_container_ = false;
+    }
+
+    void NewLine()
+    {
+        if (compact_) return;
+        buffer_ += '\n';
+        buffer_.append(depth_ * 2, ' ');
+    }
+
+    // Escapes like nlohmann::json: short forms where there are ones, \u00xx for other control characters. Bytes that
+    // are not part of valid UTF-8 are escaped as the Latin-1 characters \u0080 to \u00ff, so the output is valid JSON
+    // and JsonSaxParser reads them back as bytes when asked to
+    void AppendString(std::string_view value)
+    {
+        buffer_ += '"';
+        for (size_t i = 0; i != value.size();)
+        {
+            const char c = value[i];
+            if (static_cast<unsigned char>(c) >= 0x80)
+            {
+                const size_t length = GetUtf8SequenceLength(value.substr(i));
+                if (length == 0)
+                {
+                    AppendByteEscape(c);
+                    ++i;
+                }
+                else
+                {
+                    buffer_.append(value.substr(i, length));
+                    i += length;
+                }
+
+                continue;
+            }
+
+            ++i;
+            switch (c)
+            {
+            case '"':
+                buffer_ += "\\\"";
+                break;
+            case '\\':
+                buffer_ += "\\\\";
+                break;
+            case '\b':
+                buffer_ += "\\b";
+                break;
+            case '\f':
+                buffer_ += "\\f";
+                break;
+            case '\n':
+                buffer_ += "\\n";
+                break;
+            case '\r':
+                buffer_ += "\\r";
+                break;
+            case '\t':
+                buffer_ += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    AppendByteEscape(c);
+                }
+                else
+                {
+                    buffer_ += c;
+                }
+                break;
+            }
+        }
+        buffer_ += '"';
+    }
+
+    void AppendByteEscape(char c)
+    {
+        constexpr std::string_view kHexDigits = "0123456789abcdef";
+        buffer_ += "\\u00";
+        buffer_ += kHexDigits[static_cast<unsigned char>(c) >> 4];
+        buffer_ += kHexDigits[static_cast<unsigned char>(c) & 0xF];
+    }
+
+    // Length of the UTF-8 sequence that text starts with, zero when it is not a valid one. Overlong forms, surrogates
+    // and code points above U+10FFFF are invalid
+    [[nodiscard]] static size_t GetUtf8SequenceLength(std::string_view text)
+    {
+        auto byte = [&](size_t i)
+        {
+            return static_cast<unsigned char>(text[i]);
+        };
+
+        size_t length = 0;
+        unsigned char min_second = 0x80;
+        unsigned char max_second = 0xBF;
+        if (byte(0) >= 0xC2 && byte(0) <= 0xDF)
+        {
+            length = 2;
+        }
+        else if (byte(0) >= 0xE0 && byte(0) <= 0xEF)
+        {
+            length = 3;
+            if (byte(0) == 0xE0) min_second = 0xA0;
+            if (byte(0) == 0xED) max_second = 0x9F;
+        }
+        else if (byte(0) >= 0xF0 && byte(0) <= 0xF4)
+        {
+            length = 4;
+            if (byte(0) == 0xF0) min_second = 0x90;
+            if (byte(0) == 0xF4) max_second = 0x8F;
+        }
+        else
+        {
+            return 0;
+        }
+
+        if (text.size() < length || byte(1) < min_second || byte(1) > max_second) return 0;
+        for (size_t i = 2; i != length; ++i)
+        {
+            if (byte(i) < 0x80 || byte(i) > 0xBF) return 0;
+        }
+
+        return length;
+    }
+
+    void Flush()
+    {
+        const size_t written = std::fwrite(buffer_.data(), 1, buffer_.size(), file_.get());
+        klgl::ErrorHandling::Ensure(written == buffer_.size(), "Failed to write JSON");
+        buffer_.clear();
+    }
+
+    std::unique_ptr<std::FILE, decltype(&std::fclose)> file_;
+    std::string buffer_;
+    size_t depth_ = 0;
+    bool compact_ = false;
+    bool first_in_container_ = true;
+    bool after_key_ = false;
+};
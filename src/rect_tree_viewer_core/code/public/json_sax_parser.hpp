@@ -0,0 +1,310 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "klgl/error_handling.hpp"
+
+// SAX parser: reports values to the handler as it reads them. Strings without escapes point into the text, the
+// others are decoded into a buffer that is reused, so views are valid only during the call.
+//
+// Handler: OnObjectBegin/End, OnArrayBegin/End, OnKey, OnString, OnNumber (text of the number), OnBool and OnNull
+class JsonSaxParser
+{
+public:
+    // With latin1_escapes_as_bytes, \u0080 to \u00ff decode to single bytes instead of UTF-8. JsonFileWriter writes
+    // bytes that are not valid UTF-8 this way
+    explicit JsonSaxParser(std::string_view text, bool latin1_escapes_as_bytes = false)
+        : text_(text),
+          latin1_escapes_as_bytes_(latin1_escapes_as_bytes)
+    {
+    }
+
+    template <typename Handler>
+    void Parse(Handler& handler)
+    {
+        bool expect_value = true;
+        while (true)
+        {
+            SkipWhitespace();
+            if (expect_value)
+            {
+                expect_value = false;
+                switch (Peek())
+                {
+                case '{':
+                    ++position_;
+                    handler.OnObjectBegin();
+                    containers_.push_back(Container::Object);
+                    SkipWhitespace();
+                    if (Peek() == '}')
+                    {
+                        ++position_;
+                        containers_.pop_back();
+                        handler.OnObjectEnd();
+                    }
+                    else
+                    {
+                        ParseKey(handler);
+                        expect_value = true;
+                    }
+                    break;
+                case '[':
+                    ++position_;
+                    handler.OnArrayBegin();
+                    containers_.push_back(Container::Array);
+                    SkipWhitespace();
+                    if (Peek() == ']')
+                    {
+                        ++position_;
+                        containers_.pop_back();
+                        handler.OnArrayEnd();
+                    }
+                    else
+                    {
+                        expect_value = true;
+                    }
+                    break;
+                case '"':
+                    handler.OnString(ParseString());
+                    break;
+                case 't':
+                    ExpectLiteral("true");
+                    handler.OnBool(true);
+                    break;
+                case 'f':
+                    ExpectLiteral("false");
+                    handler.OnBool(false);
+                    break;
+                case 'n':
+                    ExpectLiteral("null");
+                    handler.OnNull();
+                    break;
+                default:
+                    handler.OnNumber(ParseNumber());
+                    break;
+                }
+                continue;
+            }
+
+            if (containers_.empty()) break;
+
+            const char c = Next();
+            const Container container = containers_.back();
+            if (c == ',')
+            {
+                if (container == Container::Object) ParseKey(handler);
+                expect_value = true;
+            }
+            else if (c == '}' && container == Container::Object)
+            {
+                containers_.pop_back();
+                handler.OnObjectEnd();
+            }
+            else if (c == ']' && container == Container::Array)
+            {
+                containers_.pop_back();
+                handler.OnArrayEnd();
+            }
+            else
+            {
+                Fail("Unexpected character");
+            }
+        }
+
+        klgl::ErrorHandling::Ensure(position_ == text_.size(), "Unexpected data after JSON at {}", position_);
+    }
+
+private:
+    enum class Container : uint8_t
+    {
+        Object,
+        Array
+    };
+
+    [[noreturn]] void Fail(std::string_view message) const
+    {
+        throw klgl::ErrorHandling::RuntimeErrorWithMessage("Invalid JSON: {} at {}", message, position_);
+    }
+
+    void SkipWhitespace()
+    {
+        while (position_ != text_.size())
+        {
+            const char c = text_[position_];
+            if (c != ' ' && c != '\n' && c != '\r' && c != '\t') break;
+            ++position_;
+        }
+    }
+
+    [[nodiscard]] char Peek() const
+    {
+        if (position_ == text_.size()) Fail("Unexpected end");
+        return text_[position_];
+    }
+
+    char Next()
+    {
+        const char c = Peek();
+        ++position_;
+        return c;
+    }
+
+    void ExpectLiteral(std::string_view literal)
+    {
+        if (!text_.substr(position_).starts_with(literal)) Fail("Unknown literal");
+        position_ += literal.size();
+    }
+
+    template <typename Handler>
+    void ParseKey(Handler& handler)
+    {
+        SkipWhitespace();
+        if (Peek() != '"') Fail("Expected a key");
+        handler.OnKey(ParseString());
+        SkipWhitespace();
+        if (Next() != ':') Fail("Expected ':'");
+    }
+
+    // Text of the number, validated by the handler that knows the type it needs
+    [[nodiscard]] std::string_view ParseNumber()
+    {
+        const size_t begin = position_;
+        while (position_ != text_.size())
+        {
+            const char c = text_[position_];
+            const bool is_number_char = (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' ||
+                                        c == 'E';
+            if (!is_number_char) break;
+            ++position_;
+        }
+
+        if (position_ == begin) Fail("Unexpected character");
+        return text_.substr(begin, position_ - begin);
+    }
+
+    [[nodiscard]] std::string_view ParseString()
+    {
+        ++position_;  // Opening quote
+        const size_t begin = position_;
+        const size_t end = text_.find_first_of("\"\\", position_);
+        if (end == std::string_view::npos) Fail("Unterminated string");
+        if (text_[end] == '"')
+        {
+            position_ = end + 1;
+            return text_.substr(begin, end - begin);
+        }
+
+        scratch_.assign(text_.substr(begin, end - begin));
+        position_ = end;
+        while (true)
+        {
+            const char c = Next();
+            if (c == '"') return scratch_;
+            if (c != '\\')
+            {
+                scratch_ += c;
+                continue;
+            }
+
+            switch (Next())
+            {
+            case '"':
+                scratch_ += '"';
+                break;
+            case '\\':
+                scratch_ += '\\';
+                break;
+            case '/':
+                scratch_ += '/';
+                break;
+            case 'b':
+                scratch_ += '\b';
+                break;
+            case 'f':
+                scratch_ += '\f';
+                break;
+            case 'n':
+                scratch_ += '\n';
+                break;
+            case 'r':
+                scratch_ += '\r';
+                break;
+            case 't':
+                scratch_ += '\t';
+                break;
+            case 'u':
+                if (const uint32_t code_point = ParseUnicodeEscape();
+                    latin1_escapes_as_bytes_ && code_point >= 0x80 && code_point <= 0xFF)
+                {
+                    scratch_ += static_cast<char>(code_point);
+                }
+                else
+                {
+                    AppendCodePoint(code_point);
+                }
+                break;
+            default:
+                Fail("Unknown escape");
+            }
+        }
+    }
+
+    // Code point of \uXXXX (the backslash and 'u' are already read), joining surrogate pairs
+    [[nodiscard]] uint32_t ParseUnicodeEscape()
+    {
+        const uint32_t code_unit = ParseHex4();
+        if (code_unit < 0xD800 || code_unit > 0xDBFF) return code_unit;
+
+        if (Next() != '\\' || Next() != 'u') Fail("Expected a low surrogate");
+        const uint32_t low = ParseHex4();
+        if (low < 0xDC00 || low > 0xDFFF) Fail("Invalid low surrogate");
+        return 0x10000 + ((code_unit - 0xD800) << 10) + (low - 0xDC00);
+    }
+
+    [[nodiscard]] uint32_t ParseHex4()
+    {
+        if (text_.size() - position_ < 4) Fail("Unexpected end");
+        uint32_t value = 0;
+        const char* begin = text_.data() + position_;  // NOLINT
+        const auto [end, err] = std::from_chars(begin, begin + 4, value, 16);  // NOLINT
+        if (err != std::errc{} || end != begin + 4) Fail("Invalid unicode escape");  // NOLINT
+        position_ += 4;
+        return value;
+    }
+
+    void AppendCodePoint(uint32_t code_point)
+    {
+        if (code_point < 0x80)
+        {
+            scratch_ += static_cast<char>(code_point);
+        }
+        else if (code_point < 0x800)
+        {
+            scratch_ += static_cast<char>(0xC0 | (code_point >> 6));
+            scratch_ += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+        else if (code_point < 0x10000)
+        {
+            scratch_ += static_cast<char>(0xE0 | (code_point >> 12));
+            scratch_ += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            scratch_ += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+        else
+        {
+            scratch_ += static_cast<char>(0xF0 | (code_point >> 18));
+            scratch_ += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+            scratch_ += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+            scratch_ += static_cast<char>(0x80 | (code_point & 0x3F));
+        }
+    }
+
+    std::string_view text_;
+    bool latin1_escapes_as_bytes_ = false;
+    size_t position_ = 0;
+    std::vector<Container> containers_;
+    std::string scratch_;
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <array>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "read_directory_tree.hpp"
+
+// Lists directories with raw getdents64 and opens subdirectories relative to the parent descriptor. Entry types come
+// from d_type, so statx is issued only for regular files (to get the size), for entries of file systems that report
+// DT_UNKNOWN and once per opened directory to read its stamp. Symbolic links are not followed.
+class LinuxDirectoryLister
+{
+public:
+    class DirectoryDescriptor
+    {
+    public:
+        explicit DirectoryDescriptor(int in_fd) : fd(in_fd) {}
+        DirectoryDescriptor(const DirectoryDescriptor&) = delete;
+        DirectoryDescriptor& operator=(const DirectoryDescriptor&) = delete;
+        ~DirectoryDescriptor() { close(fd); }
+
+        int fd;
+    };
+
+    struct Task
+    {
+        // Parent stays open while any of its subdirectories waits in a queue. Null for root paths
+        std::shared_ptr<const DirectoryDescriptor> parent;
+        std::string name;
+    };
+
+    struct Directory
+    {
+        std::shared_ptr<const DirectoryDescriptor> descriptor;
+        DirectoryStamp stamp;
+    };
+
+    [[nodiscard]] static Task MakeRootTask(const std::filesystem::path& path)
+    {
+        return {.parent = nullptr, .name = path.string()};
+    }
+
+    [[nodiscard]] static Task MakeChildTask(const Directory& directory, std::string_view name)
+    {
+        return {.parent = directory.descriptor, .name = std::string{name}};
+    }
+
+    // Opens the directory and reads its stamp from the descriptor
+    [[nodiscard]] static std::optional<Directory> Open(const Task& task, ReadDirectoryTreeSyscalls& syscalls)
+    {
+        // Root paths may be symbolic links given by the user, everything below is opened without following them
+        const int parent_fd = task.parent ? task.parent->fd : AT_FDCWD;
+        const int open_flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC | (task.parent ? O_NOFOLLOW : 0);
+
+        ++syscalls.open_calls;
+        const int fd = openat(parent_fd, task.name.c_str(), open_flags);  // NOLINT
+        if (fd < 0) return std::nullopt;
+
+        Directory directory{.descriptor = std::make_shared<const DirectoryDescriptor>(fd), .stamp = {}};
+
+        struct statx directory_stat{};
+        ++syscalls.stat_calls;
+        if (statx(fd, "", AT_EMPTY_PATH, kStampMask, &directory_stat) == 0)
+        {
+            directory.stamp = MakeStamp(directory_stat);
+        }
+
+        return directory;
+    }
+
+    // Fields of statx needed by MakeStamp
+    static constexpr unsigned kStampMask = STATX_INO | STATX_MTIME | STATX_CTIME;
+
+    [[nodiscard]] static DirectoryStamp MakeStamp(const struct statx& directory_stat)
+    {
+        auto to_nanoseconds = [](const statx_timestamp& timestamp)
+        {
+            return int64_t{timestamp.tv_sec} * 1'000'000'000 + timestamp.tv_nsec;
+        };
+
+        return {
+            .device = (uint64_t{directory_stat.stx_dev_major} << 32) | directory_stat.stx_dev_minor,
+            .inode = directory_stat.stx_ino,
+            .modification_time = to_nanoseconds(directory_stat.stx_mtime),
+            .change_time = to_nanoseconds(directory_stat.stx_ctime),
+        };
+    }
+
+    template <typename AddFile, typename AddDirectory>
+    static void List(
+        const Directory& directory,
+        ReadDirectoryTreeSyscalls& syscalls,
+        AddFile&& add_file,
+        AddDirectory&& add_directory)
+    {
+        const int fd = directory.descriptor->fd;
+
+        alignas(dirent64) std::array<char, 32 * 1024> buffer;  // NOLINT
+        while (true)
+        {
+            ++syscalls.read_directory_calls;
+            const auto bytes_read = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+            if (bytes_read <= 0) break;
+
+            for (long offset = 0; offset < bytes_read;)
+            {
+                const auto* entry = reinterpret_cast<const dirent64*>(buffer.data() + offset);  // NOLINT
+                offset += entry->d_reclen;
+
+                const std::string_view name = entry->d_name;  // NOLINT
+                if (name == "." || name == "..") continue;
+
+                unsigned char type = entry->d_type;
+                uint64_t size = 0;
+                if (type == DT_REG || type == DT_UNKNOWN)
+                {
+                    struct statx entry_stat{};
+                    constexpr int stat_flags = AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT;
+                    ++syscalls.stat_calls;
+                    if (statx(fd, name.data(), stat_flags, STATX_TYPE | STATX_SIZE, &entry_stat) != 0) continue;
+
+                    if (S_ISREG(entry_stat.stx_mode))
+                    {
+                        type = DT_REG;
+                        size = entry_stat.stx_size;
+                    }
+                    else if (S_ISDIR(entry_stat.stx_mode))
+                    {
+                        type = DT_DIR;
+                    }
+                }
+
+                if (type == DT_REG)
+                {
+                    add_file(name, size);
+                }
+                else if (type == DT_DIR)
+                {
+                    add_directory(name, MakeChildTask(directory, name));
+                }
+            }
+        }
+    }
+};
+
+#endif
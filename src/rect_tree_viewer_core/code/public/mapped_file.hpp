@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+// How the mapping is going to be read, so that the OS can read ahead or not
+enum class MappedFileAccess : uint8_t
+{
+    Random,
+    Sequential
+};
+
+// Read-only memory mapping of a whole file. Pages are loaded lazily by the OS.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::filesystem::path& path, MappedFileAccess access = MappedFileAccess::Random);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    [[nodiscard]] std::span<const std::byte> GetBytes() const { return {data_, size_}; }
+
+private:
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+    const std::byte* data_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "tree.hpp"
+
+enum class NameSearchMode : uint8_t
+{
+    // Names containing the query
+    Substring,
+
+    // Whole names matching the query, where * is any run of characters, ? one character and [abc], [a-z], [!a-z]
+    // a set of characters
+    Glob,
+};
+
+// Case-insensitive for ASCII letters, other bytes compare as they are
+[[nodiscard]] bool MatchesGlob(std::string_view pattern, std::string_view name);
+
+// Finds nodes by name, case-insensitively, over the name pool of the tree. Candidates are found by comparing the
+// first and last bytes of a literal part of the query with whole SIMD registers of consecutive names, and only those
+// are compared in full. Nodes are searched in slices of parallel chunks until the time budget of an update is spent,
+// so matches come in over a few frames on big trees. Nodes added to the tree are searched by later updates, other
+// edits need a restart.
+class NameSearch
+{
+public:
+    // Smaller slices are searched on the calling thread
+    static constexpr size_t kMinParallelNodes = size_t{1} << 16;
+
+    // Queries with *, ? or [ are globs
+    [[nodiscard]] static NameSearchMode GetQueryMode(std::string_view query);
+
+    // An empty query matches nothing. When the previous query was a substring of the new one and both are substring
+    // queries, matches found so far are filtered instead of searched again
+    void SetQuery(std::string_view query);
+
+    // Searches all nodes again with the same query. Needed after edits other than added nodes
+    void Restart();
+
+    // Searches further nodes until all are searched or the time budget is spent, at least one slice per call
+    void Update(const TreeNodes& nodes, std::chrono::nanoseconds time_budget, size_t thread_count = 0);
+
+    [[nodiscard]] const std::string& GetQuery() const { return query_; }
+    [[nodiscard]] NameSearchMode GetMode() const { return mode_; }
+    [[nodiscard]] bool IsFinished(const TreeNodes& nodes) const
+    {
+        return query_.empty() || (!filter_matches_ && next_node_ >= nodes.Size());
+    }
+
+    // In id order. SetQuery may remove matches, updates only append them
+    [[nodiscard]] std::span<const NodeId> GetMatches() const { return matches_; }
+
+    // Searched nodes, out of the tree size
+    [[nodiscard]] size_t GetSearchedNodesCount() const { return next_node_; }
+
+private:
+    struct ChunkResults
+    {
+        std::vector<NodeId> matches;
+
+        // Found when the chunk was not searched before
+        std::vector<NodeId> run_starts;
+    };
+
+    void ResetMatches();
+
+    std::string query_;
+    NameSearchMode mode_ = NameSearchMode::Substring;
+
+    // Lowercase part of the query without wildcards that every match contains. Empty for globs without one
+    std::string literal_;
+
+    std::vector<NodeId> matches_;
+    size_t next_node_ = 0;
+
+    // Matches are filtered by the new query on the next update
+    bool filter_matches_ = false;
+
+    // Nodes whose names do not follow the name of the previous node in the pool, out of the first
+    // checked_name_runs_count_ nodes. Searches compare the first and last bytes of whole runs of names at once
+    std::vector<NodeId> name_run_starts_;
+    size_t checked_name_runs_count_ = 0;
+
+    std::vector<ChunkResults> chunk_results_;
+};
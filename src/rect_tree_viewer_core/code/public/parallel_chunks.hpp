@@ -0,0 +1,38 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Calls callback(begin, end) for chunks of [0, count) on thread_count threads, the calling thread included. Threads
+// take chunks in order, so a chunk index is begin / chunk_size
+template <typename Callback>
+void ForEachChunk(size_t count, size_t chunk_size, size_t thread_count, const Callback& callback)
+{
+    std::atomic<size_t> next_begin = 0;
+    auto run = [&]
+    {
+        for (size_t begin = next_begin.fetch_add(chunk_size, std::memory_order_relaxed); begin < count;
+             begin = next_begin.fetch_add(chunk_size, std::memory_order_relaxed))
+        {
+            callback(begin, std::min(begin + chunk_size, count));
+        }
+    };
+
+    // Other threads are joined on scope exit
+    std::vector<std::jthread> threads;
+    threads.reserve(thread_count - 1);
+    for (size_t i = 1; i < thread_count; ++i) threads.emplace_back(run);
+    run();
+}
+
+// Threads for a parallel pass over count items: one per hardware thread when thread_count is zero, one below
+// min_parallel_count
+[[nodiscard]] inline size_t GetPassThreadCount(size_t count, size_t thread_count, size_t min_parallel_count)
+{
+    if (count < min_parallel_count) return 1;
+    if (thread_count == 0) thread_count = std::max(size_t{std::thread::hardware_concurrency()}, size_t{1});
+    return thread_count;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "tree.hpp"
+
+class PathHelpers
+{
+public:
+    [[nodiscard]] static std::string StringToUTF8(const std::wstring_view& wstr);
+    [[nodiscard]] static std::string PathToUTF8(const std::filesystem::path& path);
+    [[nodiscard]] static std::filesystem::path PathFromUTF8(std::string_view str);
+
+    // Opens the file for binary writing, truncating it. Null on failure. Unlike std::fopen it takes wide paths on
+    // Windows, narrow ones in the ANSI code page cannot name every file
+    [[nodiscard]] static std::FILE* OpenFileForWriting(const std::filesystem::path& path);
+
+    // Path of the node from the root path of its tree, with forward slashes
+    [[nodiscard]] static std::string GetNodeFullPath(
+        const TreeNodes& nodes,
+        std::span<const std::filesystem::path> root_paths,
+        const std::unordered_map<NodeId, size_t>& root_node_id_to_path_index,
+        NodeId in_node_id);
+};
+
+// Full path of the hovered node, built every frame without allocations: roots are a sorted array instead of a hash
+// map, ancestors are collected in one walk up and the path is kept until the node or the tree changes. Buffers grow
+// to the deepest path seen and are reused.
+class NodeFullPathCache
+{
+public:
+    // Also drops the cached path
+    void SetRoots(
+        std::span<const std::filesystem::path> root_paths,
+        const std::unordered_map<NodeId, size_t>& root_node_id_to_path_index);
+
+    // Names or links changed
+    void Invalidate() { cached_node_id_ = kInvalidNodeId; }
+
+    // Same as PathHelpers::GetNodeFullPath. The view is valid until the next call
+    [[nodiscard]] std::string_view GetFullPath(const TreeNodes& nodes, NodeId node_id);
+
+private:
+    struct Root
+    {
+        NodeId node_id = kInvalidNodeId;
+        uint32_t path_index = 0;
+    };
+
+    [[nodiscard]] const Root* FindRoot(NodeId node_id) const;
+
+    std::vector<Root> roots_;
+    std::vector<std::string> root_paths_;
+    NodeId max_root_node_id_ = 0;
+
+    std::vector<NodeId> ancestors_;
+    std::string path_;
+    NodeId cached_node_id_ = kInvalidNodeId;
+};
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "storage_device.hpp"
+#include "tree.hpp"
+
+enum class ReadDirectoryTreeBackend : uint8_t
+{
+    // Linux native backend where available, std::filesystem otherwise
+    Auto,
+    Filesystem,
+    Linux,
+
+    // Linux backend that batches stat and open requests in io_uring. Falls back to Linux where io_uring is missing
+    // or blocked
+    IoUring,
+};
+
+[[nodiscard]] std::string_view ToString(ReadDirectoryTreeBackend backend);
+
+// Result of an earlier scan. Directories whose stamp did not change since then are not listed again: their entries
+// are taken from this tree. Subdirectories are still opened to compare their stamps, but file sizes in unchanged
+// directories are reused, so a file rewritten in place is noticed only when its directory changes.
+struct PreviousDirectoryTree
+{
+    const TreeNodes* nodes = nullptr;
+    std::span<const std::filesystem::path> root_paths;
+    const std::unordered_map<NodeId, size_t>* root_node_id_to_path_index = nullptr;
+};
+
+// Entries of one directory, reported while the scan is running. Keys identify nodes only during the scan, the
+// entry i has the key first_key + i.
+struct ReadDirectoryTreeListing
+{
+    static constexpr uint64_t kNoParent = std::numeric_limits<uint64_t>::max();
+
+    uint64_t parent_key = kNoParent;
+    uint64_t first_key = 0;
+    std::vector<std::string_view> names;
+    std::vector<uint64_t> values;
+
+    // Indices of entries that are directories, their listings come later
+    std::vector<uint32_t> directories;
+};
+
+class IReadDirectoryTreeListener
+{
+public:
+    virtual ~IReadDirectoryTreeListener() = default;
+
+    // Called from scan threads, concurrently. Names are valid only during the call. A listing is always reported
+    // before the listings of its subdirectories.
+    virtual void OnDirectoryListed(const ReadDirectoryTreeListing& listing) = 0;
+};
+
+struct ReadDirectoryTreeParams
+{
+    // Number of threads walking directories. Zero means one thread per hardware thread.
+    size_t thread_count = 0;
+
+    // Directories are queued by the device they are on, each device lists at most this many at once. Spinning disks
+    // seek between directories, so a couple of requests in flight is their best. Zero means thread_count
+    size_t rotational_device_concurrency = 2;
+    size_t other_device_concurrency = 0;
+
+    ReadDirectoryTreeBackend backend = ReadDirectoryTreeBackend::Auto;
+
+    // Requests per io_uring submission of the IoUring backend, one ring per thread
+    uint32_t io_uring_queue_depth = 64;
+
+    // Makes the scan incremental when set. Must stay alive until the scan ends
+    PreviousDirectoryTree previous_tree;
+
+    // Optional, must stay alive until the scan ends
+    IReadDirectoryTreeListener* listener = nullptr;
+
+    // Small files of each directory are folded into one aggregate node (see TreeNodes::AddAggregate) to keep the tree
+    // within this many nodes. Directories are never folded, so the budget is exceeded when directories alone need
+    // more. Folding starts during the scan once the budget is reached, which bounds the memory taken by the scan, and
+    // the final tree is folded down to the budget. Zero keeps all files. Directory values stay exact either way.
+    size_t node_budget = 0;
+
+    // Files smaller than this fraction of the total size are folded too. Applied to the final tree only: the total
+    // is not known before the scan ends
+    double min_file_fraction = 0;
+
+    // Levels of directories listed under each root path, the root path is level 1. Zero lists all levels
+    size_t max_depth = 0;
+
+    // Directories still queued when the time is over are not listed. Zero means no limit
+    std::chrono::milliseconds time_budget{};
+
+    // Stops the scan early. The result then has the directories listed so far, the others are left empty and get
+    // zero stamps, so an incremental scan based on it lists them again.
+    std::stop_token stop_token;
+};
+
+// Calls that reach the file system. The std::filesystem backend counts library calls, which is approximate because
+// the standard library may batch directory reads or issue hidden stats. The io_uring backend counts opens and stats
+// it submits, and the submissions themselves in io_uring_enter_calls.
+struct ReadDirectoryTreeSyscalls
+{
+    ReadDirectoryTreeSyscalls& operator+=(const ReadDirectoryTreeSyscalls& other)
+    {
+        open_calls += other.open_calls;
+        read_directory_calls += other.read_directory_calls;
+        stat_calls += other.stat_calls;
+        io_uring_enter_calls += other.io_uring_enter_calls;
+        return *this;
+    }
+
+    size_t open_calls = 0;
+    size_t read_directory_calls = 0;
+    size_t stat_calls = 0;
+    size_t io_uring_enter_calls = 0;
+};
+
+struct ReadDirectoryTreeDeviceStats
+{
+    // Zero for directories whose device is not known, see GetPathDevice
+    uint64_t device = 0;
+    StorageDeviceKind kind = StorageDeviceKind::Unknown;
+    size_t concurrency_limit = 0;
+    size_t directories_count = 0;
+    size_t entries_count = 0;
+
+    // Time spent listing, summed over threads, and from the first listing to the end of the last one
+    std::chrono::nanoseconds busy_duration{};
+    std::chrono::nanoseconds active_duration{};
+};
+
+struct ReadDirectoryTreeStats
+{
+    // Backend that did the scan, never Auto, and Linux when io_uring was asked for but is not available
+    ReadDirectoryTreeBackend backend = ReadDirectoryTreeBackend::Auto;
+    ReadDirectoryTreeSyscalls syscalls;
+    size_t thread_count = 0;
+    size_t nodes_count = 0;
+    size_t directories_count = 0;
+    size_t reused_directories_count = 0;
+    size_t stolen_tasks_count = 0;
+
+    // Directories left unlisted by max_depth or time_budget
+    size_t unexpanded_directories_count = 0;
+
+    // Aggregate nodes in the result and files they stand for
+    size_t aggregate_nodes_count = 0;
+    size_t folded_files_count = 0;
+
+    // In the order the devices were found, the device of the first root path goes first
+    std::vector<ReadDirectoryTreeDeviceStats> devices;
+
+    bool cancelled = false;
+    std::chrono::nanoseconds walk_duration{};
+    std::chrono::nanoseconds merge_duration{};
+};
+
+// Writes the stats as a few lines of text: totals, system calls, limits that were hit and the work of every device
+void PrintScanStats(std::FILE* file, const ReadDirectoryTreeStats& stats);
+
+// Directories that were not listed: below the depth or time budget of the scan, left by a cancelled scan or failed to
+// open. Those skipped by a budget have an estimated size (included in their ancestors), the others are zero. Listing
+// one with ReadDirectoryTreeMulti gives its actual subtree, see SubtreeExpansion.
+[[nodiscard]] bool IsUnexpandedDirectory(const TreeNodes& nodes, NodeId node_id);
+
+// Display name of a node that stands for files_count folded files of a directory, its value is their total size. The
+// count itself is kept by TreeNodes::AddAggregate
+[[nodiscard]] std::string MakeAggregateNodeName(uint64_t files_count);
+
+// Walks directories from a work-stealing pool of threads. Each thread keeps its own deque of directories to list per
+// storage device: the owner pops the most recent directory and idle threads steal the oldest one (usually the
+// biggest subtree). Per-thread node batches are merged and renumbered in breadth-first order at the end, so every
+// parent precedes its children and children of one node have consecutive ids. Stamps of listed directories are
+// stored in the tree for the next incremental scan.
+TreeNodes ReadDirectoryTreeMulti(
+    std::optional<std::string_view> root_node_name,
+    std::span<const std::filesystem::path> paths,
+    std::unordered_map<NodeId, size_t>* out_root_node_id_to_path_index,
+    const ReadDirectoryTreeParams& params = {},
+    ReadDirectoryTreeStats* out_stats = nullptr);
+
+inline TreeNodes ReadDirectoryTree(const std::filesystem::path& root_path)
+{
+    return ReadDirectoryTreeMulti(std::nullopt, std::span{&root_path, 1}, nullptr);
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "EverydayTools/Math/Matrix.hpp"
+#include "klgl/rendering/painter2d.hpp"
+#include "rect_tree_draw_data.hpp"
+#include "tree.hpp"
+
+namespace rect_tree_viewer
+{
+
+// A rectangle as it is drawn, packed for upload as one instance
+struct RectInstance
+{
+    edt::Vec2f center{};
+    edt::Vec2f size{};
+    edt::Vec4u8 color{};
+
+    [[nodiscard]] constexpr klgl::Painter2d::Rect2d ToPainterRect() const
+    {
+        return {
+            .center = center,
+            .size = size,
+            .color = color,
+            .rotation_degrees = 0.f,
+        };
+    }
+};
+
+// Consecutive instances drawn by one call
+struct RectDrawBatch
+{
+    uint32_t first = 0;
+    uint32_t count = 0;
+};
+
+class IRectDrawBackend
+{
+public:
+    virtual ~IRectDrawBackend() = default;
+
+    // Instances [offset, offset + instances.size()) changed since the last upload. instances_count is the size of the
+    // whole array
+    virtual void Upload(size_t instances_count, size_t offset, std::span<const RectInstance> instances) = 0;
+
+    // Batches refer to the whole instances array, which is the same as the uploaded one
+    virtual void Draw(std::span<const RectInstance> instances, std::span<const RectDrawBatch> batches) = 0;
+};
+
+// Draws with Painter2d, which takes rectangles one by one and has no buffers to upload to
+class PainterRectDrawBackend final : public IRectDrawBackend
+{
+public:
+    explicit PainterRectDrawBackend(klgl::Painter2d& painter) : painter_(painter) {}
+
+    void Upload(size_t, size_t, std::span<const RectInstance>) override {}
+    void Draw(std::span<const RectInstance> instances, std::span<const RectDrawBatch> batches) override;
+
+private:
+    klgl::Painter2d& painter_;
+};
+
+// Only counts the work, so that batching and upload volume can be checked without a GPU
+class CountingRectDrawBackend final : public IRectDrawBackend
+{
+public:
+    void Upload(size_t instances_count, size_t offset, std::span<const RectInstance> instances) override;
+    void Draw(std::span<const RectInstance> instances, std::span<const RectDrawBatch> batches) override;
+
+    size_t allocated_instances_count = 0;
+    size_t upload_calls_count = 0;
+    size_t uploaded_instances_count = 0;
+    size_t draw_calls_count = 0;
+    size_t batches_count = 0;
+    size_t drawn_instances_count = 0;
+};
+
+// Instances of all nodes indexed by node id. They are packed when the layout changes rather than every frame, and
+// only the changed ranges are uploaded. A frame draws a list of nodes, runs of consecutive ids make one batch.
+class RectDrawList
+{
+public:
+    // Dirty ranges closer than this are uploaded as one, so that a scattered change does not make many small uploads
+    static constexpr size_t kMergeGap = 64;
+
+    // Packs all nodes
+    void Rebuild(std::span<const Rect2d> rects, std::span<const edt::Vec4u8> colors);
+
+    // Repacks changed nodes, in any order. Nodes added since the last call are packed as well
+    void Update(std::span<const Rect2d> rects, std::span<const edt::Vec4u8> colors, std::span<const NodeId> nodes);
+
+    // Sends changed instances to the backend
+    void Upload(IRectDrawBackend& backend);
+
+    // Draws nodes in the given order
+    void Draw(IRectDrawBackend& backend, std::span<const NodeId> nodes);
+
+    [[nodiscard]] size_t GetInstancesCount() const { return instances_.size(); }
+    [[nodiscard]] std::span<const RectDrawBatch> GetLastBatches() const { return batches_; }
+
+private:
+    struct Range
+    {
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    void Pack(std::span<const Rect2d> rects, std::span<const edt::Vec4u8> colors, size_t index);
+
+    std::vector<RectInstance> instances_;
+
+    // Instances changed since the last upload
+    std::vector<Range> dirty_ranges_;
+
+    // Size of the array known to the backend
+    size_t uploaded_instances_count_ = 0;
+
+    std::vector<RectDrawBatch> batches_;
+};
+
+}  // namespace rect_tree_viewer
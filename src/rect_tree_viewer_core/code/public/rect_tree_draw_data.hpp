@@ -0,0 +1,275 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "EverydayTools/Math/Matrix.hpp"
+#include "klgl/rendering/painter2d.hpp"
+#include "tree.hpp"
+#include "tree_child_index.hpp"
+
+
+namespace rect_tree_viewer
+{
+
+struct Rect2d
+{
+    edt::Vec2f bottom_left{};
+    edt::Vec2f size{};
+
+    [[nodiscard]] constexpr klgl::Painter2d::Rect2d ToPainterRect(edt::Vec4u8 color) const
+    {
+        return {
+            .center = bottom_left + size / 2,
+            .size = size,
+            .color = color,
+            .rotation_degrees = 0.f,
+        };
+    }
+
+    [[nodiscard]] constexpr bool Contains(const edt::Vec2f& position) const
+    {
+        auto d = position - bottom_left;
+
+        return d.x() >= 0 && d.x() <= size.x() && d.y() >= 0 && d.y() <= size.y();
+    }
+
+    // Touching rectangles intersect
+    [[nodiscard]] constexpr bool Intersects(const Rect2d& other) const
+    {
+        const edt::Vec2f top_right = bottom_left + size;
+        const edt::Vec2f other_top_right = other.bottom_left + other.size;
+        return bottom_left.x() <= other_top_right.x() && other.bottom_left.x() <= top_right.x() &&
+               bottom_left.y() <= other_top_right.y() && other.bottom_left.y() <= top_right.y();
+    }
+};
+
+// Keeps the binary splits that lay out children of each node. Children of a node are found by following the splits
+// of its rectangle instead of testing every child, so a point query costs O(depth * log fan-out) for trees with
+// balanced splits and allocates nothing. Rectangles are not stored here, queries take the ones from RectTreeDrawData.
+class RectTreeSpatialIndex
+{
+public:
+    // A region of the split hierarchy: either a split or a single child node (with kLeafBit). Refs to splits tell the
+    // axis of the split with kAlongYBit.
+    using Ref = uint32_t;
+    static constexpr Ref kNoRef = std::numeric_limits<Ref>::max();
+    static constexpr Ref kLeafBit = Ref{1} << 31;
+    static constexpr Ref kAlongYBit = Ref{1} << 30;
+    static constexpr Ref kIndexMask = kAlongYBit - 1;
+
+    struct Split
+    {
+        // Boundary between the regions, x or y coordinate depending on the axis
+        float position = 0;
+
+        // Regions before and after the boundary
+        Ref first = kNoRef;
+        Ref second = kNoRef;
+    };
+
+    // Deepest node at the position
+    [[nodiscard]] std::optional<NodeId> FindNodeAt(std::span<const Rect2d> rects, const edt::Vec2f& position) const;
+
+    // Calls visitor(node_id, rect) for nodes intersecting the range, every parent before its children. Children of a
+    // node are visited only if the visitor returns true for it.
+    template <typename Visitor>
+    void VisitIntersecting(std::span<const Rect2d> rects, const Rect2d& range, Visitor&& visitor);
+
+    // Collects nodes intersecting the range
+    void FindNodesIn(std::span<const Rect2d> rects, const Rect2d& range, std::vector<NodeId>& out_nodes)
+    {
+        VisitIntersecting(
+            rects,
+            range,
+            [&](NodeId node_id, const Rect2d&)
+            {
+                out_nodes.push_back(node_id);
+                return true;
+            });
+    }
+
+    void Clear();
+    [[nodiscard]] bool IsEmpty() const { return root_refs_.empty(); }
+    [[nodiscard]] size_t GetMemoryUsage() const;
+
+    // Used by RectTreeDrawData. Reserve makes room for the splits of every node, so that Store calls for different
+    // nodes may run in parallel. Without reserved_in_place splits are appended and the old ones are left unused until
+    // Compact. Resize adds nodes without children.
+    void Reserve(const TreeNodes& nodes);
+    void Resize(size_t nodes_count);
+    void Store(NodeId node_id, Ref root, std::span<const Split> splits, bool reserved_in_place);
+    void Compact();
+    [[nodiscard]] size_t GetSplitsCount() const { return splits_.size(); }
+
+private:
+    // Region bounds, kept as corners so that split positions are compared without rounding
+    struct Bounds
+    {
+        edt::Vec2f min;
+        edt::Vec2f max;
+    };
+
+    struct StackEntry
+    {
+        Ref ref = kNoRef;
+        Bounds bounds;
+    };
+
+    [[nodiscard]] static Bounds ToBounds(const Rect2d& rect)
+    {
+        return {.min = rect.bottom_left, .max = rect.bottom_left + rect.size};
+    }
+
+    [[nodiscard]] static bool Intersects(const Bounds& a, const Bounds& b)
+    {
+        return a.min.x() <= b.max.x() && b.min.x() <= a.max.x() && a.min.y() <= b.max.y() && b.min.y() <= a.max.y();
+    }
+
+    // Root region of each node, kNoRef for nodes without children
+    std::vector<Ref> root_refs_;
+    std::vector<Split> splits_;
+    std::vector<StackEntry> stack_;
+};
+
+template <typename Visitor>
+void RectTreeSpatialIndex::VisitIntersecting(std::span<const Rect2d> rects, const Rect2d& range, Visitor&& visitor)
+{
+    if (rects.empty() || root_refs_.empty() || !rects[0].Intersects(range)) return;
+    if (!visitor(NodeId{0}, rects[0]) || root_refs_[0] == kNoRef) return;
+
+    const Bounds range_bounds = ToBounds(range);
+    stack_.clear();
+    stack_.push_back({.ref = root_refs_[0], .bounds = ToBounds(rects[0])});
+    while (!stack_.empty())
+    {
+        const StackEntry entry = stack_.back();
+        stack_.pop_back();
+
+        if (entry.ref & kLeafBit)
+        {
+            const NodeId child = entry.ref & ~kLeafBit;
+            const Rect2d& child_rect = rects[child];
+            if (!child_rect.Intersects(range) || !visitor(child, child_rect)) continue;
+            if (root_refs_[child] != kNoRef)
+            {
+                stack_.push_back({.ref = root_refs_[child], .bounds = ToBounds(child_rect)});
+            }
+            continue;
+        }
+
+        // Split bounds of the region at the boundary, children rectangles stay within them
+        const Split& split = splits_[entry.ref & kIndexMask];
+        StackEntry first{.ref = split.first, .bounds = entry.bounds};
+        StackEntry second{.ref = split.second, .bounds = entry.bounds};
+        if (entry.ref & kAlongYBit)
+        {
+            first.bounds.max.y() = split.position;
+            second.bounds.min.y() = split.position;
+        }
+        else
+        {
+            first.bounds.max.x() = split.position;
+            second.bounds.min.x() = split.position;
+        }
+
+        if (Intersects(second.bounds, range_bounds)) stack_.push_back(second);
+        if (Intersects(first.bounds, range_bounds)) stack_.push_back(first);
+    }
+}
+
+class RectTreeDrawData
+{
+public:
+    // Part of the node size given to its children
+    static constexpr float kDefaultPaddingFactor = 0.97f;
+
+    // Lays out subtrees on thread_count threads, zero means one thread per hardware thread. The result does not
+    // depend on the number of threads. Splits of the layout are kept in out_spatial_index if it is given. The child
+    // index has to be built for the same tree.
+    [[nodiscard]] static std::vector<Rect2d> Create(
+        const TreeNodes& nodes,
+        const TreeChildIndex& child_index,
+        const float padding_factor = kDefaultPaddingFactor,
+        size_t thread_count = 0,
+        RectTreeSpatialIndex* out_spatial_index = nullptr);
+
+    // Recomputes rectangles after edits of the tree. dirty_nodes (sorted) are nodes whose children were added, removed
+    // or changed their values, together with all their ancestors. Subtrees of clean nodes whose rectangle did not move
+    // are skipped, so the result is the same as Create but the cost follows the changes. The spatial index, if any, has
+    // to be the one made with these rectangles. Nodes whose rectangle changed are appended to out_moved_nodes. The
+    // child index has to be updated with the same dirty nodes first.
+    static void Update(
+        const TreeNodes& nodes,
+        const TreeChildIndex& child_index,
+        std::span<const NodeId> dirty_nodes,
+        std::vector<Rect2d>& rects,
+        const float padding_factor = kDefaultPaddingFactor,
+        RectTreeSpatialIndex* spatial_index = nullptr,
+        std::vector<NodeId>* out_moved_nodes = nullptr);
+};
+
+// Lays out children of a node only when the node is visible and big enough, so the cost and memory follow what is on
+// screen rather than the size of the tree. Children rectangles of one node (a level) are cached until they are the
+// least recently used ones and the cache exceeds its budget. Rectangles are the same as the ones from
+// RectTreeDrawData::Create.
+class LazyRectTreeDrawData
+{
+public:
+    struct VisibleNode
+    {
+        NodeId node_id = kInvalidNodeId;
+        Rect2d rect;
+    };
+
+    explicit LazyRectTreeDrawData(
+        size_t max_cached_rects = size_t{1} << 20,
+        float padding_factor = RectTreeDrawData::kDefaultPaddingFactor)
+        : max_cached_rects_(max_cached_rects),
+          padding_factor_(padding_factor)
+    {
+    }
+
+    // Finds nodes intersecting the view. Children of visible nodes smaller than min_size in either dimension are
+    // not laid out: the node is drawn as a whole.
+    void Update(const TreeNodes& nodes, const TreeChildIndex& child_index, const Rect2d& view, float min_size);
+
+    // Visible nodes found by the last Update, every parent goes before its children
+    [[nodiscard]] std::span<const VisibleNode> GetVisibleNodes() const { return visible_nodes_; }
+
+    // Deepest node at the position among the laid out ones
+    [[nodiscard]] std::optional<NodeId> FindNodeAt(const TreeChildIndex& child_index, const edt::Vec2f& position) const;
+
+    // Drops levels of nodes whose children were added, removed or changed their values. Levels of nodes whose
+    // rectangle moved are recomputed anyway. Must be called with the dirty nodes the child index was updated with.
+    void Invalidate(std::span<const NodeId> dirty_nodes);
+    void Clear();
+
+    [[nodiscard]] size_t GetCachedRectsCount() const { return cached_rects_count_; }
+
+private:
+    // Children of a level are the ones from the child index, in the same order
+    struct Level
+    {
+        // Rectangle of the node when its children were laid out
+        Rect2d rect;
+        std::vector<Rect2d> children_rects;
+        uint64_t last_used_frame = 0;
+    };
+
+    void EvictLeastRecentlyUsed();
+
+    size_t max_cached_rects_ = 0;
+    float padding_factor_ = 1.f;
+    uint64_t frame_ = 0;
+    size_t cached_rects_count_ = 0;
+    std::unordered_map<NodeId, Level> levels_;
+    std::vector<VisibleNode> visible_nodes_;
+    std::vector<VisibleNode> stack_;
+    std::vector<std::pair<uint64_t, NodeId>> eviction_order_;
+};
+}  // namespace rect_tree_viewer
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+enum class StorageDeviceKind : uint8_t
+{
+    // Virtual and network file systems, or no way to tell
+    Unknown,
+    Rotational,
+    SolidState,
+};
+
+// Device ids are major << 32 | minor, like DirectoryStamp::device of the Linux backend. Platforms without device
+// numbers have none.
+[[nodiscard]] std::optional<uint64_t> GetPathDevice(const std::filesystem::path& path);
+
+// Block devices tell whether they rotate in sysfs, partitions inherit the answer of their disk
+[[nodiscard]] StorageDeviceKind GetStorageDeviceKind(uint64_t device);
+
+// major:minor
+[[nodiscard]] std::string FormatDevice(uint64_t device);
+[[nodiscard]] std::string_view ToString(StorageDeviceKind kind);
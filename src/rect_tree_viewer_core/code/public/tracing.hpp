@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <string_view>
+
+// Phase tracing: scopes and counters go to a ring buffer of the thread that records them and are exported as Chrome
+// trace_event JSON (chrome://tracing, ui.perfetto.dev). Recording starts with Tracing::Enable, until then a scope
+// costs one relaxed load. Without RECT_TREE_VIEWER_TRACING the macros below compile to nothing.
+class Tracing
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Events kept per thread, older ones are overwritten. Buffers grow up to this size as events come
+    static constexpr size_t kRingBufferSize = size_t{1} << 16;
+
+    // Buffers of threads that exited are kept for the export, the oldest ones are dropped past this count
+    static constexpr size_t kMaxExitedThreadsCount = 64;
+
+    static void Enable();
+    [[nodiscard]] static bool IsEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    static void SetThreadName(std::string_view name);
+
+    // Names must be string literals: events keep the pointers
+    static void RecordScope(const char* name, Clock::time_point begin, Clock::time_point end);
+    static void RecordCounter(const char* name, double value);
+
+    // Events of all threads so far, threads that keep recording may lose the ones written during the export
+    static void WriteChromeTrace(const std::filesystem::path& path);
+
+private:
+    static inline std::atomic<bool> enabled_ = false;
+};
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name) : name_(name)
+    {
+        if (Tracing::IsEnabled()) begin_ = Tracing::Clock::now();
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    ~TraceScope()
+    {
+        if (begin_ != Tracing::Clock::time_point{}) Tracing::RecordScope(name_, begin_, Tracing::Clock::now());
+    }
+
+private:
+    const char* name_ = nullptr;
+    Tracing::Clock::time_point begin_{};
+};
+
+#define RECT_TREE_VIEWER_TRACE_CONCAT_IMPL(a, b) a##b
+#define RECT_TREE_VIEWER_TRACE_CONCAT(a, b) RECT_TREE_VIEWER_TRACE_CONCAT_IMPL(a, b)
+
+#ifdef RECT_TREE_VIEWER_TRACING
+#define TRACE_SCOPE(name) const TraceScope RECT_TREE_VIEWER_TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_SPAN(name, begin, end)                                      \
+    do                                                                    \
+    {                                                                     \
+        if (Tracing::IsEnabled()) Tracing::RecordScope(name, begin, end); \
+    } while (false)
+#define TRACE_COUNTER(name, value)                                                          \
+    do                                                                                      \
+    {                                                                                       \
+        if (Tracing::IsEnabled()) Tracing::RecordCounter(name, static_cast<double>(value)); \
+    } while (false)
+#define TRACE_THREAD_NAME(name)                                 \
+    do                                                          \
+    {                                                           \
+        if (Tracing::IsEnabled()) Tracing::SetThreadName(name); \
+    } while (false)
+#else
+#define TRACE_SCOPE(name) static_cast<void>(0)
+#define TRACE_SPAN(name, begin, end) static_cast<void>(0)
+#define TRACE_COUNTER(name, value) static_cast<void>(0)
+#define TRACE_THREAD_NAME(name) static_cast<void>(0)
+#endif
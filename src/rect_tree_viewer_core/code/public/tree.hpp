@@ -0,0 +1,309 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "klgl/error_handling.hpp"
+#include "tree_column.hpp"
+
+using NodeId = uint32_t;
+inline constexpr NodeId kInvalidNodeId = std::numeric_limits<NodeId>::max();
+
+// Identity and change times (nanoseconds) of a directory at the moment it was listed. Fields that the scan backend
+// cannot provide are zero. A zero stamp marks a directory that could not be opened.
+struct DirectoryStamp
+{
+    uint64_t device = 0;
+    uint64_t inode = 0;
+    int64_t modification_time = 0;
+    int64_t change_time = 0;
+
+    [[nodiscard]] bool IsValid() const { return *this != DirectoryStamp{}; }
+    [[nodiscard]] bool operator==(const DirectoryStamp&) const = default;
+};
+
+// Struct-of-arrays tree storage. Every node attribute lives in its own array indexed by NodeId, links use
+// kInvalidNodeId instead of optionals and all names are packed into a single pool. A scanned tree is in breadth-first
+// order. Edits append new nodes and relink existing ones, so after them only the links describe the tree.
+class TreeNodes
+{
+public:
+    // Raw view of all arrays, used to save and restore the tree without per-node work
+    struct Columns
+    {
+        std::span<const char> names;
+        std::span<const uint64_t> name_offsets;
+        std::span<const uint16_t> name_lengths;
+        std::span<const uint64_t> values;
+        std::span<const NodeId> parents;
+        std::span<const NodeId> first_children;
+        std::span<const NodeId> next_siblings;
+        std::span<const NodeId> stamped_directories;
+        std::span<const DirectoryStamp> directory_stamps;
+        std::span<const NodeId> aggregate_nodes;
+        std::span<const uint64_t> aggregated_files_counts;
+    };
+
+    [[nodiscard]] size_t Size() const { return values_.Size(); }
+    [[nodiscard]] bool IsEmpty() const { return Size() == 0; }
+    [[nodiscard]] auto Ids() const { return std::views::iota(NodeId{0}, static_cast<NodeId>(Size())); }
+
+    void Reserve(size_t nodes_count, size_t names_size)
+    {
+        names_.Reserve(names_size);
+        name_offsets_.Reserve(nodes_count);
+        name_lengths_.Reserve(nodes_count);
+        values_.Reserve(nodes_count);
+        parents_.Reserve(nodes_count);
+        first_children_.Reserve(nodes_count);
+        next_siblings_.Reserve(nodes_count);
+    }
+
+    // Appends a node. Only the parent link is set, child and sibling links are up to the caller.
+    NodeId Add(std::string_view name, uint64_t value, NodeId parent = kInvalidNodeId)
+    {
+        klgl::ErrorHandling::Ensure(Size() < kInvalidNodeId, "Too many nodes in the tree");
+        klgl::ErrorHandling::Ensure(
+            name.size() <= std::numeric_limits<uint16_t>::max(),
+            "Node name is too long: {} bytes",
+            name.size());
+
+        const auto id = static_cast<NodeId>(Size());
+        name_offsets_.PushBack(names_.Size());
+        name_lengths_.PushBack(static_cast<uint16_t>(name.size()));
+        names_.Append(name);
+        values_.PushBack(value);
+        parents_.PushBack(parent);
+        first_children_.PushBack(kInvalidNodeId);
+        next_siblings_.PushBack(kInvalidNodeId);
+        return id;
+    }
+
+    [[nodiscard]] std::string_view GetName(NodeId id) const
+    {
+        return {names_.Data() + name_offsets_[id], name_lengths_[id]};  // NOLINT
+    }
+
+    [[nodiscard]] uint64_t GetValue(NodeId id) const { return values_[id]; }
+    [[nodiscard]] NodeId GetParent(NodeId id) const { return parents_[id]; }
+    [[nodiscard]] NodeId GetFirstChild(NodeId id) const { return first_children_[id]; }
+    [[nodiscard]] NodeId GetNextSibling(NodeId id) const { return next_siblings_[id]; }
+
+    void SetValue(NodeId id, uint64_t value) { values_.Mutable()[id] = value; }
+    void SetFirstChild(NodeId id, NodeId child) { first_children_.Mutable()[id] = child; }
+    void SetNextSibling(NodeId id, NodeId sibling) { next_siblings_.Mutable()[id] = sibling; }
+
+    // Stamps are stored only for directories, sorted by node id
+    void AddDirectoryStamp(NodeId id, const DirectoryStamp& stamp)
+    {
+        klgl::ErrorHandling::Ensure(
+            stamped_directories_.Size() == 0 || stamped_directories_[stamped_directories_.Size() - 1] < id,
+            "Directory stamps must be added in the order of node ids");
+        stamped_directories_.PushBack(id);
+        directory_stamps_.PushBack(stamp);
+    }
+
+    // Null for files and for nodes scanned without stamps
+    [[nodiscard]] const DirectoryStamp* FindDirectoryStamp(NodeId id) const
+    {
+        const std::span<const NodeId> ids = stamped_directories_.View();
+        const auto it = std::ranges::lower_bound(ids, id);
+        if (it == ids.end() || *it != id) return nullptr;
+        return &directory_stamps_[static_cast<size_t>(it - ids.begin())];
+    }
+
+    // Aggregate nodes stand for small files folded by the scan. They are stored sorted by node id with the number of
+    // files behind each one, so that nothing has to be recovered from their names
+    void AddAggregate(NodeId id, uint64_t files_count)
+    {
+        klgl::ErrorHandling::Ensure(
+            aggregate_nodes_.Size() == 0 || aggregate_nodes_[aggregate_nodes_.Size() - 1] < id,
+            "Aggregate nodes must be added in the order of node ids");
+        aggregate_nodes_.PushBack(id);
+        aggregated_files_counts_.PushBack(files_count);
+    }
+
+    // Zero for nodes that are not aggregates
+    [[nodiscard]] uint64_t GetAggregatedFilesCount(NodeId id) const
+    {
+        const std::span<const NodeId> ids = aggregate_nodes_.View();
+        const auto it = std::ranges::lower_bound(ids, id);
+        if (it == ids.end() || *it != id) return 0;
+        return aggregated_files_counts_[static_cast<size_t>(it - ids.begin())];
+    }
+
+    // Links a detached node as the first child of the parent
+    void LinkChild(NodeId parent, NodeId child)
+    {
+        parents_.Mutable()[child] = parent;
+        SetNextSibling(child, GetFirstChild(parent));
+        SetFirstChild(parent, child);
+    }
+
+    // Removes the node from the children of its parent. The node and its subtree stay in the arrays but become
+    // unreachable from the root.
+    void Unlink(NodeId id)
+    {
+        const NodeId parent = GetParent(id);
+        if (parent == kInvalidNodeId) return;
+
+        if (GetFirstChild(parent) == id)
+        {
+            SetFirstChild(parent, GetNextSibling(id));
+        }
+        else
+        {
+            NodeId sibling = GetFirstChild(parent);
+            while (GetNextSibling(sibling) != id) sibling = GetNextSibling(sibling);
+            SetNextSibling(sibling, GetNextSibling(id));
+        }
+
+        parents_.Mutable()[id] = kInvalidNodeId;
+        SetNextSibling(id, kInvalidNodeId);
+    }
+
+    // The old name stays in the pool
+    void Rename(NodeId id, std::string_view name)
+    {
+        klgl::ErrorHandling::Ensure(
+            name.size() <= std::numeric_limits<uint16_t>::max(),
+            "Node name is too long: {} bytes",
+            name.size());
+        name_offsets_.Mutable()[id] = names_.Size();
+        name_lengths_.Mutable()[id] = static_cast<uint16_t>(name.size());
+        names_.Append(name);
+    }
+
+    // Adds a signed delta to the value of the node and all its ancestors
+    void AddValueDelta(NodeId id, int64_t delta)
+    {
+        const std::span<uint64_t> values = values_.Mutable();
+        for (; id != kInvalidNodeId; id = GetParent(id))
+        {
+            values[id] += static_cast<uint64_t>(delta);
+        }
+    }
+
+    // Appends all nodes of another tree, including directory stamps and aggregates. Returns the new id of its node 0,
+    // which is left without a parent.
+    NodeId AppendTree(const TreeNodes& other)
+    {
+        const auto base = static_cast<NodeId>(Size());
+        auto shift = [&](NodeId id)
+        {
+            return id == kInvalidNodeId ? kInvalidNodeId : base + id;
+        };
+
+        for (const NodeId id : other.Ids())
+        {
+            const NodeId new_id = Add(other.GetName(id), other.GetValue(id), shift(other.GetParent(id)));
+            SetFirstChild(new_id, shift(other.GetFirstChild(id)));
+            SetNextSibling(new_id, shift(other.GetNextSibling(id)));
+        }
+
+        for (const size_t i : std::views::iota(size_t{0}, other.stamped_directories_.Size()))
+        {
+            AddDirectoryStamp(base + other.stamped_directories_[i], other.directory_stamps_[i]);
+        }
+
+        for (const size_t i : std::views::iota(size_t{0}, other.aggregate_nodes_.Size()))
+        {
+            AddAggregate(base + other.aggregate_nodes_[i], other.aggregated_files_counts_[i]);
+        }
+
+        return base;
+    }
+
+    // Adds the value of every node to its parent. Parents must precede their children.
+    void PropagateValuesToParents()
+    {
+        const std::span<uint64_t> values = values_.Mutable();
+        for (const NodeId id : Ids() | std::views::reverse)
+        {
+            [[likely]] if (parents_[id] != kInvalidNodeId)
+            {
+                values[parents_[id]] += values[id];
+            }
+        }
+    }
+
+    // Bytes taken by node arrays and names, unused capacity excluded
+    [[nodiscard]] size_t GetMemoryUsage() const
+    {
+        constexpr size_t bytes_per_node = sizeof(uint64_t) + sizeof(uint16_t) + sizeof(uint64_t) + 3 * sizeof(NodeId);
+        constexpr size_t bytes_per_directory = sizeof(NodeId) + sizeof(DirectoryStamp);
+        constexpr size_t bytes_per_aggregate = sizeof(NodeId) + sizeof(uint64_t);
+        return Size() * bytes_per_node + names_.Size() + stamped_directories_.Size() * bytes_per_directory +
+               aggregate_nodes_.Size() * bytes_per_aggregate;
+    }
+
+    [[nodiscard]] std::span<const uint64_t> GetValues() const { return values_.View(); }
+
+    [[nodiscard]] Columns GetColumns() const
+    {
+        return {
+            .names = names_.View(),
+            .name_offsets = name_offsets_.View(),
+            .name_lengths = name_lengths_.View(),
+            .values = values_.View(),
+            .parents = parents_.View(),
+            .first_children = first_children_.View(),
+            .next_siblings = next_siblings_.View(),
+            .stamped_directories = stamped_directories_.View(),
+            .directory_stamps = directory_stamps_.View(),
+            .aggregate_nodes = aggregate_nodes_.View(),
+            .aggregated_files_counts = aggregated_files_counts_.View(),
+        };
+    }
+
+    // Uses external memory without copying it. The storage object is kept alive while the tree exists, columns are
+    // copied out of it only when modified.
+    void Borrow(const Columns& columns, std::shared_ptr<const void> storage)
+    {
+        names_.Borrow(columns.names);
+        name_offsets_.Borrow(columns.name_offsets);
+        name_lengths_.Borrow(columns.name_lengths);
+        values_.Borrow(columns.values);
+        parents_.Borrow(columns.parents);
+        first_children_.Borrow(columns.first_children);
+        next_siblings_.Borrow(columns.next_siblings);
+        stamped_directories_.Borrow(columns.stamped_directories);
+        directory_stamps_.Borrow(columns.directory_stamps);
+        aggregate_nodes_.Borrow(columns.aggregate_nodes);
+        aggregated_files_counts_.Borrow(columns.aggregated_files_counts);
+        borrowed_storage_ = std::move(storage);
+    }
+
+private:
+    TreeColumn<char> names_;
+    TreeColumn<uint64_t> name_offsets_;
+    TreeColumn<uint16_t> name_lengths_;
+    TreeColumn<uint64_t> values_;
+    TreeColumn<NodeId> parents_;
+    TreeColumn<NodeId> first_children_;
+    TreeColumn<NodeId> next_siblings_;
+    TreeColumn<NodeId> stamped_directories_;
+    TreeColumn<DirectoryStamp> directory_stamps_;
+    TreeColumn<NodeId> aggregate_nodes_;
+    TreeColumn<uint64_t> aggregated_files_counts_;
+    std::shared_ptr<const void> borrowed_storage_;
+};
+
+struct TreeHelper
+{
+    static void GetChildren(const TreeNodes& nodes, NodeId node_id, std::vector<NodeId>& out_children)
+    {
+        for (NodeId child_id = nodes.GetFirstChild(node_id); child_id != kInvalidNodeId;
+             child_id = nodes.GetNextSibling(child_id))
+        {
+            out_children.push_back(child_id);
+        }
+    }
+};
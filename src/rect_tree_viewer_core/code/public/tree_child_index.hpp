@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "tree.hpp"
+
+// Children of every node stored contiguously, sorted by value in descending order (ties by id) and addressed by a
+// [begin, end) range per node. Layout, hit testing and export read children from here instead of following sibling
+// links and sorting them on every call. Edits of the tree go through Update: ranges of changed nodes are rewritten in
+// place, or appended when they grow, until the unused entries make a rebuild cheaper.
+class TreeChildIndex
+{
+public:
+    // Indexes the whole tree on thread_count threads, zero means one thread per hardware thread
+    void Build(const TreeNodes& nodes, size_t thread_count = 0);
+
+    // Reindexes dirty_nodes (sorted, see TreeChanges) and the nodes added to the tree since the last call
+    void Update(const TreeNodes& nodes, std::span<const NodeId> dirty_nodes);
+
+    [[nodiscard]] std::span<const NodeId> GetChildren(NodeId node_id) const
+    {
+        const Range range = ranges_[node_id];
+        return std::span{children_}.subspan(range.begin, range.end - range.begin);
+    }
+
+    [[nodiscard]] bool HasChildren(NodeId node_id) const { return ranges_[node_id].begin != ranges_[node_id].end; }
+
+    // Number of nodes in the subtree of every node reachable from the root, the node itself included. Nodes that are
+    // not reachable get zero
+    void ComputeSubtreeSizes(NodeId root, std::vector<uint32_t>& out_sizes) const;
+
+    // Number of indexed nodes, the size of the tree after Build or Update
+    [[nodiscard]] size_t Size() const { return ranges_.size(); }
+    [[nodiscard]] size_t GetMemoryUsage() const;
+    void Clear();
+
+private:
+    struct Range
+    {
+        uint32_t begin = 0;
+        uint32_t end = 0;
+    };
+
+    void Reindex(const TreeNodes& nodes, NodeId node_id);
+
+    std::vector<Range> ranges_;
+    std::vector<NodeId> children_;
+
+    // Entries of children_ that no range refers to
+    size_t unused_count_ = 0;
+    std::vector<NodeId> scratch_;
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+// Array of node attributes. Either owns its elements or borrows them from external memory (for example a mapped
+// snapshot). Borrowed elements are copied into owned storage on the first modification.
+template <typename T>
+class TreeColumn
+{
+public:
+    TreeColumn() = default;
+    TreeColumn(const TreeColumn& other) { *this = other; }
+    TreeColumn(TreeColumn&& other) noexcept { *this = std::move(other); }
+
+    TreeColumn& operator=(const TreeColumn& other)
+    {
+        if (this != &other)
+        {
+            owned_ = other.owned_;
+            is_borrowed_ = other.is_borrowed_;
+            if (is_borrowed_)
+            {
+                data_ = other.data_;
+                size_ = other.size_;
+            }
+            else
+            {
+                SyncWithOwned();
+            }
+        }
+
+        return *this;
+    }
+
+    TreeColumn& operator=(TreeColumn&& other) noexcept
+    {
+        if (this != &other)
+        {
+            owned_ = std::move(other.owned_);
+            is_borrowed_ = other.is_borrowed_;
+            data_ = other.data_;
+            size_ = other.size_;
+            other.owned_ = {};
+            other.is_borrowed_ = false;
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+
+        return *this;
+    }
+
+    ~TreeColumn() = default;
+
+    [[nodiscard]] size_t Size() const { return size_; }
+    [[nodiscard]] bool IsBorrowed() const { return is_borrowed_; }
+    [[nodiscard]] const T* Data() const { return data_; }
+    [[nodiscard]] std::span<const T> View() const { return {data_, size_}; }
+    [[nodiscard]] const T& operator[](size_t index) const { return data_[index]; }  // NOLINT
+
+    [[nodiscard]] std::span<T> Mutable()
+    {
+        Own();
+        return owned_;
+    }
+
+    void Reserve(size_t capacity)
+    {
+        Own();
+        owned_.reserve(capacity);
+        SyncWithOwned();
+    }
+
+    void PushBack(const T& value)
+    {
+        Own();
+        owned_.push_back(value);
+        SyncWithOwned();
+    }
+
+    void Append(std::span<const T> values)
+    {
+        Own();
+        owned_.insert(owned_.end(), values.begin(), values.end());
+        SyncWithOwned();
+    }
+
+    void Borrow(std::span<const T> values)
+    {
+        owned_ = {};
+        is_borrowed_ = true;
+        data_ = values.data();
+        size_ = values.size();
+    }
+
+private:
+    void Own()
+    {
+        if (is_borrowed_)
+        {
+            owned_.assign(data_, data_ + size_);  // NOLINT
+            is_borrowed_ = false;
+            SyncWithOwned();
+        }
+    }
+
+    void SyncWithOwned()
+    {
+        data_ = owned_.data();
+        size_ = owned_.size();
+    }
+
+    std::vector<T> owned_;
+    const T* data_ = nullptr;
+    size_t size_ = 0;
+    bool is_borrowed_ = false;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+#include <unordered_map>
+
+#include "tree.hpp"
+#include "tree_snapshot.hpp"
+
+// JSON tree: {"nodes": [{"first_child": 1, "name": "root", "value": 10}, ...], "root_nodes": [0], "root_paths": [...]}
+// Node ids are positions in the nodes array, links that are not set are omitted. Aggregate nodes have the number of
+// files behind them in "aggregated_files". Keys are sorted like nlohmann::json writes them. Bytes of names and paths
+// that are not valid UTF-8 are written as \u0080 to \u00ff and read back as the same bytes.
+//
+// Nodes are written one by one through a buffered file sink: memory does not depend on the number of nodes.
+void WriteTreeJson(
+    const std::filesystem::path& path,
+    const TreeNodes& nodes,
+    std::span<const std::filesystem::path> root_paths,
+    const std::unordered_map<NodeId, size_t>& root_node_id_to_path_index,
+    bool compact = false);
+
+// Maps the file and rebuilds the tree from parser events without a document in between. Unknown keys are skipped,
+// the tree is validated like a binary snapshot.
+TreeSnapshot ReadTreeJson(const std::filesystem::path& path);
+
+// Snapshot paths ending in .json are read and written as JSON, the others as binary snapshots
+[[nodiscard]] bool IsTreeJsonPath(const std::filesystem::path& path);
+TreeSnapshot LoadTreeFile(const std::filesystem::path& path);
+void WriteTreeFile(
+    const std::filesystem::path& path,
+    const TreeNodes& nodes,
+    std::span<const std::filesystem::path> root_paths,
+    const std::unordered_map<NodeId, size_t>& root_node_id_to_path_index,
+    bool compact_json = false);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "tree.hpp"
+
+struct TreeSnapshot
+{
+    TreeNodes nodes;
+    std::vector<std::filesystem::path> root_paths;
+    std::unordered_map<NodeId, size_t> root_node_id_to_path_index;
+};
+
+// Binary snapshot: a fixed header with a section table followed by the TreeNodes columns (fixed width per node),
+// directory stamps, aggregate nodes, the name pool and root paths. Columns are written as they are in memory in one
+// sequential pass.
+void WriteTreeSnapshot(
+    const std::filesystem::path& path,
+    const TreeNodes& nodes,
+    std::span<const std::filesystem::path> root_paths,
+    const std::unordered_map<NodeId, size_t>& root_node_id_to_path_index);
+
+// Checks the columns of a loaded tree and throws on the first corrupted one, path is for the message. Borrowed columns
+// are used without checks: every name has to lie in the pool, parents have to precede their children and child lists
+// have to match the parents, otherwise walks up or down the tree could read outside the columns or never end. Stamps
+// and aggregates are searched by node id and have to be sorted
+void ValidateTreeColumns(const TreeNodes::Columns& columns, const std::filesystem::path& path);
+
+// Maps the file and lets the tree borrow its columns instead of copying them. The header, names and node links are
+// validated first, a corrupted snapshot throws instead of being read out of bounds.
+TreeSnapshot LoadTreeSnapshot(const std::filesystem::path& path);
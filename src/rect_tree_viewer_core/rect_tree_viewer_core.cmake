@@ -0,0 +1,13 @@
+# Scopes and counters for --trace, see tracing.hpp. Until --trace enables recording, a scope costs one relaxed load
+option(RECT_TREE_VIEWER_TRACING "Build rect_tree_viewer with phase tracing" ON)
+if(RECT_TREE_VIEWER_TRACING)
+    target_compile_definitions(rect_tree_viewer_core PUBLIC RECT_TREE_VIEWER_TRACING)
+endif()
+
+# Replaces the global operator new to count allocations, see allocation_counter.hpp. Only the benchmarks and
+# debug builds of the viewer link it
+add_library(rect_tree_viewer_allocation_counter OBJECT
+    ${CMAKE_CURRENT_SOURCE_DIR}/allocation_counter/allocation_counter.cpp)
+set_generic_compiler_options(rect_tree_viewer_allocation_counter PRIVATE)
+target_link_libraries(rect_tree_viewer_allocation_counter PUBLIC rect_tree_viewer_core)
+target_compile_definitions(rect_tree_viewer_allocation_counter PUBLIC RECT_TREE_VIEWER_ALLOCATION_COUNTER)
@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "disk_usage_import.hpp"
+#include "test_helpers.hpp"
+#include "tree.hpp"
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+// du -ab of /data: directories follow their contents, the root is last. Directory lines carry the size of the
+// directory entry, which the import drops
+constexpr std::string_view kDuOutput =
+    "100\t/data/docs/a.txt\n"
+    "250\t/data/docs/deep/b.txt\n"
+    "4096\t/data/docs/deep\n"
+    "4096\t/data/docs\n"
+    "4096\t/data/empty\n"
+    "7\t/data/c.bin\n"
+    "4096\t/data\n";
+
+constexpr std::string_view kNcduExport = R"([1, 2, {"progname": "ncdu", "progver": "1.19", "timestamp": 1700000000},
+[{"name": "/srv/www", "asize": 4096, "dsize": 4096},
+ {"name": "index.html", "asize": 1200, "dsize": 4096, "ino": 12},
+ [{"name": "img", "asize": 4096},
+  {"name": "logo.png", "asize": 30000},
+  {"name": "bg.jpg", "asize": 70000, "extended": {"mode": 420}}],
+ [{"name": "empty", "asize": 4096}]]])";
+
+}  // namespace
+
+TEST(DiskUsageImportTest, DetectsDumps)
+{
+    const TestDirectory directory;
+    EXPECT_TRUE(IsDiskUsageDump(directory.WriteFile("du.txt", kDuOutput)));
+    EXPECT_TRUE(IsDiskUsageDump(directory.WriteFile("ncdu.json", kNcduExport)));
+    EXPECT_FALSE(IsDiskUsageDump(directory.WriteFile("notes.txt", "Not a dump\n")));
+    EXPECT_FALSE(IsDiskUsageDump(directory.WriteFile("size.txt", "123 /data\n")));
+    EXPECT_FALSE(IsDiskUsageDump(directory.WriteFile("empty.txt", "")));
+    EXPECT_FALSE(IsDiskUsageDump(directory.GetPath() / "missing.txt"));
+}
+
+TEST(DiskUsageImportTest, ImportsDuOutput)
+{
+    const TestDirectory directory;
+    const fs::path path = directory.WriteFile("du.txt", kDuOutput);
+    const TreeSnapshot snapshot = ImportDiskUsageDumps(std::span{&path, 1});
+    const TreeNodes& nodes = snapshot.nodes;
+    ExpectValidTree(nodes);
+
+    ASSERT_EQ(nodes.Size(), 7u);
+    EXPECT_EQ(nodes.GetName(0), "data");
+    EXPECT_EQ(nodes.GetValue(0), 4453u);
+    EXPECT_EQ(nodes.GetValue(FindPath(nodes, 0, "docs")), 350u);
+    EXPECT_EQ(nodes.GetValue(FindPath(nodes, 0, "docs/deep/b.txt")), 250u);
+    EXPECT_EQ(nodes.GetValue(FindPath(nodes, 0, "c.bin")), 7u);
+
+    // du does not tell an empty directory from a file, it keeps the size of its entry
+    EXPECT_EQ(nodes.GetValue(FindPath(nodes, 0, "empty")), 4096u);
+
+    EXPECT_EQ(snapshot.root_paths, (std::vector<fs::path>{"/data"}));
+    EXPECT_EQ(snapshot.root_node_id_to_path_index, (std::unordered_map<NodeId, size_t>{{0, 0}}));
+}
+
+// du -ab0 keeps new lines in names
+TEST(DiskUsageImportTest, ImportsNulSeparatedDuOutput)
+{
+    const TestDirectory directory;
+    using namespace std::string_view_literals;
+    const fs::path path = directory.WriteFile("du0.txt", "5\t/data/two\nlines\0" "9\t/data/plain\0" "4096\t/data\0"sv);
+    const TreeSnapshot snapshot = ImportDiskUsageDumps(std::span{&path, 1});
+    ExpectValidTree(snapshot.nodes);
+    EXPECT_EQ(snapshot.nodes.GetValue(FindChild(snapshot.nodes, 0, "two\nlines")), 5u);
+    EXPECT_EQ(snapshot.nodes.GetValue(0), 14u);
+}
+
+TEST(DiskUsageImportTest, ImportsNcduExport)
+{
+    const TestDirectory directory;
+    const fs::path path = directory.WriteFile("ncdu.json", kNcduExport);
+    const TreeSnapshot snapshot = ImportDiskUsageDumps(std::span{&path, 1});
+    const TreeNodes& nodes = snapshot.nodes;
+    ExpectValidTree(nodes);
+
+    ASSERT_EQ(nodes.Size(), 6u);
+    EXPECT_EQ(nodes.GetName(0), "www");
+    EXPECT_EQ(nodes.GetValue(0), 101200u);
+    EXPECT_EQ(nodes.GetValue(FindPath(nodes, 0, "img")), 100000u);
+    EXPECT_EQ(nodes.GetValue(FindPath(nodes, 0, "img/bg.jpg")), 70000u);
+    EXPECT_EQ(nodes.GetValue(FindPath(nodes, 0, "index.html")), 1200u);
+    EXPECT_NE(FindPath(nodes, 0, "empty"), kInvalidNodeId);
+    EXPECT_EQ(snapshot.root_paths, (std::vector<fs::path>{"/srv/www"}));
+}
+
+TEST(DiskUsageImportTest, PutsSeveralDumpsUnderSelection)
+{
+    const TestDirectory directory;
+    const std::vector<fs::path> paths{
+        directory.WriteFile("du.txt", kDuOutput),
+        directory.WriteFile("ncdu.json", kNcduExport),
+    };
+    const TreeSnapshot snapshot = ImportDiskUsageDumps(paths);
+    const TreeNodes& nodes = snapshot.nodes;
+    ExpectValidTree(nodes);
+
+    EXPECT_EQ(nodes.GetName(0), "SELECTION");
+    EXPECT_EQ(nodes.GetValue(0), 4453u + 101200u);
+    ASSERT_EQ(GetChildren(nodes, 0).size(), 2u);
+
+    const NodeId data = FindChild(nodes, 0, "data");
+    const NodeId www = FindChild(nodes, 0, "www");
+    ASSERT_NE(data, kInvalidNodeId);
+    ASSERT_NE(www, kInvalidNodeId);
+    EXPECT_EQ(snapshot.root_paths, (std::vector<fs::path>{"/data", "/srv/www"}));
+    EXPECT_EQ(snapshot.root_node_id_to_path_index, (std::unordered_map<NodeId, size_t>{{data, 0}, {www, 1}}));
+}
+
+TEST(DiskUsageImportTest, RejectsBrokenDumps)
+{
+    const TestDirectory directory;
+    const std::string_view dumps[]{
+        // Line outside of the root, which du prints last
+        "5\t/other/file\n4096\t/data\n",
+        // Size without a tab
+        "5 /data/file\n4096\t/data\n",
+        // Unknown ncdu export version
+        R"([2, 0, {}, [{"name": "/"}]])",
+        // ncdu export without a root directory
+        R"([1, 0, {}])",
+        // Truncated ncdu export
+        R"([1, 0, {}, [{"name": "/"}, {"name": "f", "asize": )",
+    };
+
+    for (const std::string_view dump : dumps)
+    {
+        const fs::path path = directory.WriteFile("dump.txt", dump);
+        EXPECT_THROW(std::ignore = ImportDiskUsageDumps(std::span{&path, 1}), std::runtime_error) << dump;
+    }
+}
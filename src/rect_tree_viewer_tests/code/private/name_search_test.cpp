@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "fmt/format.h"
+#include "name_search.hpp"
+#include "tree.hpp"
+
+namespace
+{
+
+std::vector<NodeId> SearchRest(NameSearch& search, const TreeNodes& nodes, size_t thread_count = 1)
+{
+    while (!search.IsFinished(nodes)) search.Update(nodes, std::chrono::milliseconds{100}, thread_count);
+    return {search.GetMatches().begin(), search.GetMatches().end()};
+}
+
+std::vector<NodeId> SearchAll(const TreeNodes& nodes, std::string_view query, size_t thread_count = 1)
+{
+    NameSearch search;
+    search.SetQuery(query);
+    return SearchRest(search, nodes, thread_count);
+}
+
+TreeNodes MakeFlatTree(std::span<const std::string_view> names)
+{
+    TreeNodes nodes;
+    const NodeId root = nodes.Add("root", 0);
+    for (const std::string_view name : names) nodes.LinkChild(root, nodes.Add(name, 1, root));
+    return nodes;
+}
+
+}  // namespace
+
+TEST(MatchesGlobTest, Wildcards)
+{
+    EXPECT_TRUE(MatchesGlob("*", ""));
+    EXPECT_TRUE(MatchesGlob("*", "anything"));
+    EXPECT_TRUE(MatchesGlob("*.cpp", "tree.cpp"));
+    EXPECT_FALSE(MatchesGlob("*.cpp", "tree.cpp.bak"));
+    EXPECT_TRUE(MatchesGlob("tree*", "tree_json.hpp"));
+    EXPECT_TRUE(MatchesGlob("t*e*.h?p", "tree.hpp"));
+    EXPECT_FALSE(MatchesGlob("t*e*.h?p", "tree.hp"));
+    EXPECT_TRUE(MatchesGlob("???", "abc"));
+    EXPECT_FALSE(MatchesGlob("???", "ab"));
+    EXPECT_FALSE(MatchesGlob("???", "abcd"));
+    EXPECT_TRUE(MatchesGlob("a**b", "ab"));
+}
+
+TEST(MatchesGlobTest, CharacterSets)
+{
+    EXPECT_TRUE(MatchesGlob("file[123].txt", "file2.txt"));
+    EXPECT_FALSE(MatchesGlob("file[123].txt", "file4.txt"));
+    EXPECT_TRUE(MatchesGlob("[a-c]x", "bx"));
+    EXPECT_FALSE(MatchesGlob("[a-c]x", "dx"));
+    EXPECT_TRUE(MatchesGlob("[!a-c]x", "dx"));
+    EXPECT_FALSE(MatchesGlob("[!a-c]x", "ax"));
+    EXPECT_FALSE(MatchesGlob("[abc]", ""));
+}
+
+TEST(MatchesGlobTest, CaseInsensitiveForAsciiOnly)
+{
+    EXPECT_TRUE(MatchesGlob("*.CPP", "tree.cpp"));
+    EXPECT_TRUE(MatchesGlob("[A-C]x", "bX"));
+    EXPECT_TRUE(MatchesGlob("\xc3\xa9*", "\xc3\xa9t\xc3\xa9"));
+    EXPECT_FALSE(MatchesGlob("\xc3\x89*", "\xc3\xa9t\xc3\xa9"));
+}
+
+TEST(NameSearchTest, QueryMode)
+{
+    EXPECT_EQ(NameSearch::GetQueryMode("tree"), NameSearchMode::Substring);
+    EXPECT_EQ(NameSearch::GetQueryMode("*.cpp"), NameSearchMode::Glob);
+    EXPECT_EQ(NameSearch::GetQueryMode("file?"), NameSearchMode::Glob);
+    EXPECT_EQ(NameSearch::GetQueryMode("[ab]"), NameSearchMode::Glob);
+}
+
+TEST(NameSearchTest, SubstringAndGlobMatches)
+{
+    constexpr std::string_view names[]{"tree.cpp", "Tree.hpp", "subtree", "forest.cpp", "tre", "README"};
+    const TreeNodes nodes = MakeFlatTree(names);
+
+    EXPECT_EQ(SearchAll(nodes, "tree"), (std::vector<NodeId>{1, 2, 3}));
+    EXPECT_EQ(SearchAll(nodes, "TREE."), (std::vector<NodeId>{1, 2}));
+    EXPECT_EQ(SearchAll(nodes, "*.cpp"), (std::vector<NodeId>{1, 4}));
+    EXPECT_EQ(SearchAll(nodes, "tre?"), (std::vector<NodeId>{}));
+    EXPECT_EQ(SearchAll(nodes, "[rt]*"), (std::vector<NodeId>{0, 1, 2, 5, 6}));
+    EXPECT_TRUE(SearchAll(nodes, "").empty());
+    EXPECT_TRUE(SearchAll(nodes, "missing").empty());
+}
+
+TEST(NameSearchTest, NarrowedQueryFiltersMatches)
+{
+    constexpr std::string_view names[]{"alpha", "alphabet", "beta", "alpine"};
+    const TreeNodes nodes = MakeFlatTree(names);
+
+    NameSearch search;
+    search.SetQuery("alp");
+    EXPECT_EQ(SearchRest(search, nodes), (std::vector<NodeId>{1, 2, 4}));
+
+    search.SetQuery("alpha");
+    EXPECT_EQ(SearchRest(search, nodes), (std::vector<NodeId>{1, 2}));
+}
+
+TEST(NameSearchTest, AddedNodesAreSearchedByLaterUpdates)
+{
+    constexpr std::string_view names[]{"data.bin", "notes.txt"};
+    TreeNodes nodes = MakeFlatTree(names);
+
+    NameSearch search;
+    search.SetQuery("*.txt");
+    EXPECT_EQ(SearchRest(search, nodes).size(), 1u);
+
+    nodes.LinkChild(0, nodes.Add("todo.txt", 1, 0));
+    EXPECT_FALSE(search.IsFinished(nodes));
+    EXPECT_EQ(SearchRest(search, nodes), (std::vector<NodeId>{2, 3}));
+}
+
+// Enough nodes for parallel slices, names share the pool with no gaps like in a scanned tree
+TEST(NameSearchTest, ParallelSearchMatchesSerial)
+{
+    constexpr size_t kNodesCount = NameSearch::kMinParallelNodes * 3;
+    TreeNodes nodes;
+    const NodeId root = nodes.Add("root", 0);
+    for (size_t i = 1; i != kNodesCount; ++i)
+    {
+        const std::string name = i % 7 == 0 ? fmt::format("match_{}.log", i) : fmt::format("file_{}.dat", i);
+        nodes.LinkChild(root, nodes.Add(name, 1, root));
+    }
+
+    for (const std::string_view query : {"match", "*.LOG", "file_1?.dat"})
+    {
+        const std::vector<NodeId> serial = SearchAll(nodes, query, 1);
+        EXPECT_FALSE(serial.empty()) << query;
+        EXPECT_TRUE(std::ranges::is_sorted(serial)) << query;
+        EXPECT_EQ(SearchAll(nodes, query, 4), serial) << query;
+    }
+
+    EXPECT_EQ(SearchAll(nodes, "match").size(), (kNodesCount - 1) / 7);
+}
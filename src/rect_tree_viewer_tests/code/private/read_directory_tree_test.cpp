@@ -0,0 +1,270 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "fmt/format.h"
+#include "read_directory_tree.hpp"
+#include "test_helpers.hpp"
+#include "tree.hpp"
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+// Directories of different depths and widths, so that threads steal work and batches of several threads are merged:
+// branchN/level0/.../levelN with 3 * depth + 1 small files at each depth, one empty directory and one big file
+struct SampleDirectoryTree
+{
+    explicit SampleDirectoryTree(const TestDirectory& directory) : root(directory.GetPath() / "scan")
+    {
+        fs::create_directories(root / "empty");
+        for (size_t branch = 0; branch != 4; ++branch)
+        {
+            fs::path path = root / fmt::format("branch{}", branch);
+            for (size_t depth = 0; depth != branch + 2; ++depth)
+            {
+                for (size_t file = 0; file != depth * 3 + 1; ++file)
+                {
+                    const size_t size = 1 + (files_count % 50) * 7;
+                    directory.WriteFile(
+                        fs::relative(path / fmt::format("file{}.dat", file), directory.GetPath()),
+                        std::string(size, 'x'));
+                    total_size += size;
+                    ++files_count;
+                }
+
+                path /= fmt::format("level{}", depth);
+            }
+        }
+
+        directory.WriteFile(fs::relative(root / "big.bin", directory.GetPath()), std::string(100000, 'b'));
+        total_size += 100000;
+        ++files_count;
+    }
+
+    fs::path root;
+    uint64_t total_size = 0;
+    size_t files_count = 0;
+};
+
+struct ScanResult
+{
+    TreeNodes nodes;
+    std::unordered_map<NodeId, size_t> root_node_id_to_path_index;
+    ReadDirectoryTreeStats stats;
+};
+
+ReadDirectoryTreeParams MakeParams(size_t thread_count, size_t node_budget = 0, double min_file_fraction = 0)
+{
+    ReadDirectoryTreeParams params;
+    params.thread_count = thread_count;
+    params.node_budget = node_budget;
+    params.min_file_fraction = min_file_fraction;
+    return params;
+}
+
+ScanResult Scan(std::span<const fs::path> paths, const ReadDirectoryTreeParams& params)
+{
+    ScanResult result;
+    result.nodes = ReadDirectoryTreeMulti(
+        paths.size() > 1 ? std::optional<std::string_view>{"SELECTION"} : std::nullopt,
+        paths,
+        &result.root_node_id_to_path_index,
+        params,
+        &result.stats);
+    return result;
+}
+
+// Breadth-first numbering of the merged tree: children of a node have consecutive ids, and nodes are grouped by the
+// order of their parents
+void ExpectBreadthFirst(const TreeNodes& nodes)
+{
+    NodeId previous_parent = 0;
+    for (const NodeId node_id : nodes.Ids())
+    {
+        const NodeId parent = nodes.GetParent(node_id);
+        if (parent == kInvalidNodeId) continue;
+
+        EXPECT_GE(parent, previous_parent) << "Node " << node_id;
+        previous_parent = parent;
+
+        const std::vector<NodeId> children = GetChildren(nodes, parent);
+        EXPECT_EQ(std::ranges::max(children) - std::ranges::min(children) + 1, children.size()) << "Node " << parent;
+    }
+}
+
+// Leaves that are not aggregates are files, except the one empty directory of the sample
+size_t CountFiles(const TreeNodes& nodes)
+{
+    size_t files_count = 0;
+    for (const NodeId node_id : nodes.Ids())
+    {
+        if (const uint64_t aggregated_files_count = nodes.GetAggregatedFilesCount(node_id))
+        {
+            files_count += aggregated_files_count;
+        }
+        else if (nodes.GetFirstChild(node_id) == kInvalidNodeId && nodes.GetName(node_id) != "empty")
+        {
+            ++files_count;
+        }
+    }
+
+    return files_count;
+}
+
+// Slash separated names below the root, for FindPath
+std::string GetRelativePath(const TreeNodes& nodes, NodeId node_id)
+{
+    std::string path;
+    for (; nodes.GetParent(node_id) != kInvalidNodeId; node_id = nodes.GetParent(node_id))
+    {
+        path = path.empty() ? std::string{nodes.GetName(node_id)} : fmt::format("{}/{}", nodes.GetName(node_id), path);
+    }
+
+    return path;
+}
+
+}  // namespace
+
+TEST(ReadDirectoryTreeTest, MergedTreeKeepsLinksAndSizes)
+{
+    const TestDirectory directory;
+    const SampleDirectoryTree sample(directory);
+
+    for (const size_t thread_count : {1, 2, 4})
+    {
+        const ScanResult scan = Scan(std::span{&sample.root, 1}, MakeParams(thread_count));
+        const TreeNodes& nodes = scan.nodes;
+        ExpectValidTree(nodes);
+        ExpectBreadthFirst(nodes);
+
+        EXPECT_EQ(nodes.GetName(0), "scan");
+        EXPECT_EQ(nodes.GetValue(0), sample.total_size);
+        EXPECT_EQ(CountFiles(nodes), sample.files_count);
+        EXPECT_EQ(nodes.GetValue(FindChild(nodes, 0, "big.bin")), 100000u);
+        EXPECT_EQ(FindPath(nodes, 0, "empty/anything"), kInvalidNodeId);
+        EXPECT_NE(FindPath(nodes, 0, "branch3/level0/level1/level2/level3/file12.dat"), kInvalidNodeId);
+        EXPECT_EQ(scan.root_node_id_to_path_index, (std::unordered_map<NodeId, size_t>{{0, 0}}));
+        EXPECT_EQ(scan.stats.nodes_count, nodes.Size());
+    }
+}
+
+TEST(ReadDirectoryTreeTest, SeveralRootsGoUnderSelection)
+{
+    const TestDirectory directory;
+    const SampleDirectoryTree sample(directory);
+    const std::vector<fs::path> paths{sample.root / "branch1", sample.root / "branch2"};
+
+    const ScanResult scan = Scan(paths, MakeParams(2));
+    ExpectValidTree(scan.nodes);
+    ExpectBreadthFirst(scan.nodes);
+
+    EXPECT_EQ(scan.nodes.GetName(0), "SELECTION");
+    const NodeId branch1 = FindChild(scan.nodes, 0, "branch1");
+    const NodeId branch2 = FindChild(scan.nodes, 0, "branch2");
+    ASSERT_NE(branch1, kInvalidNodeId);
+    ASSERT_NE(branch2, kInvalidNodeId);
+    EXPECT_EQ(scan.root_node_id_to_path_index, (std::unordered_map<NodeId, size_t>{{branch1, 0}, {branch2, 1}}));
+}
+
+// Folded files leave one aggregate node per directory that knows how many files it stands for
+TEST(ReadDirectoryTreeTest, NodeBudgetFoldsFilesIntoAggregates)
+{
+    const TestDirectory directory;
+    const SampleDirectoryTree sample(directory);
+    const ScanResult full = Scan(std::span{&sample.root, 1}, MakeParams(2));
+
+    // 16 directories, each of the 14 with files gets an aggregate, and big.bin: 31 nodes when all is folded
+    constexpr size_t kNodeBudget = 40;
+    for (const size_t thread_count : {1, 4})
+    {
+        const ScanResult scan = Scan(std::span{&sample.root, 1}, MakeParams(thread_count, kNodeBudget));
+        const TreeNodes& nodes = scan.nodes;
+        ExpectValidTree(nodes);
+        ExpectBreadthFirst(nodes);
+
+        EXPECT_LE(nodes.Size(), kNodeBudget);
+        EXPECT_LT(nodes.Size(), full.nodes.Size());
+        EXPECT_GT(scan.stats.aggregate_nodes_count, 0u);
+        EXPECT_EQ(nodes.GetValue(0), sample.total_size);
+        EXPECT_EQ(CountFiles(nodes), sample.files_count);
+
+        size_t aggregate_nodes_count = 0;
+        size_t folded_files_count = 0;
+        for (const NodeId node_id : nodes.Ids())
+        {
+            const uint64_t aggregated_files_count = nodes.GetAggregatedFilesCount(node_id);
+            if (aggregated_files_count == 0) continue;
+
+            EXPECT_EQ(nodes.GetName(node_id), MakeAggregateNodeName(aggregated_files_count));
+            EXPECT_EQ(nodes.GetFirstChild(node_id), kInvalidNodeId);
+            ++aggregate_nodes_count;
+            folded_files_count += aggregated_files_count;
+        }
+
+        EXPECT_EQ(aggregate_nodes_count, scan.stats.aggregate_nodes_count);
+        EXPECT_EQ(folded_files_count, scan.stats.folded_files_count);
+
+        // Directories are never folded
+        for (const NodeId node_id : full.nodes.Ids())
+        {
+            if (full.nodes.GetFirstChild(node_id) == kInvalidNodeId) continue;
+            EXPECT_NE(FindPath(nodes, 0, GetRelativePath(full.nodes, node_id)), kInvalidNodeId);
+        }
+    }
+}
+
+TEST(ReadDirectoryTreeTest, MinFileFractionFoldsSmallFiles)
+{
+    const TestDirectory directory;
+    const SampleDirectoryTree sample(directory);
+
+    const ScanResult scan = Scan(std::span{&sample.root, 1}, MakeParams(2, 0, 0.01));
+    ExpectValidTree(scan.nodes);
+    ExpectBreadthFirst(scan.nodes);
+
+    // Only big.bin is above one percent of the total. The single files of branch directories are kept as they are:
+    // an aggregate of one file would not save a node
+    EXPECT_EQ(scan.stats.folded_files_count, sample.files_count - 1 - 4);
+    EXPECT_NE(FindChild(scan.nodes, 0, "big.bin"), kInvalidNodeId);
+    EXPECT_EQ(CountFiles(scan.nodes), sample.files_count);
+    EXPECT_EQ(scan.nodes.GetValue(0), sample.total_size);
+}
+
+// Directories with the same stamps are copied from the previous tree along with their aggregates
+TEST(ReadDirectoryTreeTest, IncrementalScanReusesDirectories)
+{
+    const TestDirectory directory;
+    const SampleDirectoryTree sample(directory);
+    const std::vector<fs::path> root_paths{sample.root};
+    const ScanResult previous = Scan(root_paths, MakeParams(2, 40));
+
+    ReadDirectoryTreeParams params = MakeParams(2, 40);
+    params.previous_tree = {
+        .nodes = &previous.nodes,
+        .root_paths = root_paths,
+        .root_node_id_to_path_index = &previous.root_node_id_to_path_index,
+    };
+    const ScanResult unchanged = Scan(root_paths, params);
+    ExpectValidTree(unchanged.nodes);
+    ExpectBreadthFirst(unchanged.nodes);
+    EXPECT_GT(unchanged.stats.reused_directories_count, 0u);
+    EXPECT_EQ(unchanged.nodes.GetValue(0), sample.total_size);
+    EXPECT_EQ(CountFiles(unchanged.nodes), sample.files_count);
+    EXPECT_EQ(unchanged.stats.folded_files_count, previous.stats.folded_files_count);
+
+    directory.WriteFile(fs::relative(sample.root / "branch0/added.bin", directory.GetPath()), std::string(5000, 'a'));
+    const ScanResult changed = Scan(root_paths, params);
+    ExpectValidTree(changed.nodes);
+    ExpectBreadthFirst(changed.nodes);
+    EXPECT_EQ(changed.nodes.GetValue(0), sample.total_size + 5000);
+    EXPECT_EQ(CountFiles(changed.nodes), sample.files_count + 1);
+}
@@ -0,0 +1,194 @@
+#include <gtest/gtest.h>
+
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include "rect_draw_list.hpp"
+#include "rect_tree_draw_data.hpp"
+#include "tree.hpp"
+
+namespace
+{
+
+using namespace rect_tree_viewer;  // NOLINT
+
+// Unit squares in a row, one per node
+struct Rects
+{
+    explicit Rects(size_t count)
+    {
+        for (size_t i = 0; i != count; ++i) Add();
+    }
+
+    void Add()
+    {
+        const auto x = static_cast<float>(rects.size());
+        rects.push_back({.bottom_left = edt::Vec2f{x, 0.f}, .size = edt::Vec2f{1.f, 1.f}});
+        colors.push_back(edt::Vec4u8{255, 255, 255, 255});
+    }
+
+    std::vector<Rect2d> rects;
+    std::vector<edt::Vec4u8> colors;
+};
+
+// Keeps the arguments of every upload on top of the counters
+class RecordingRectDrawBackend final : public IRectDrawBackend
+{
+public:
+    struct UploadCall
+    {
+        size_t instances_count = 0;
+        size_t offset = 0;
+        size_t size = 0;
+    };
+
+    void Upload(size_t instances_count, size_t offset, std::span<const RectInstance> instances) override
+    {
+        counting.Upload(instances_count, offset, instances);
+        uploads.push_back({.instances_count = instances_count, .offset = offset, .size = instances.size()});
+    }
+
+    void Draw(std::span<const RectInstance> instances, std::span<const RectDrawBatch> batches) override
+    {
+        counting.Draw(instances, batches);
+    }
+
+    CountingRectDrawBackend counting;
+    std::vector<UploadCall> uploads;
+};
+
+std::vector<NodeId> MakeIds(NodeId begin, NodeId end)
+{
+    std::vector<NodeId> ids(end - begin);
+    std::iota(ids.begin(), ids.end(), begin);
+    return ids;
+}
+
+}  // namespace
+
+// Runs of consecutive ids make one batch each, whatever the order of the runs
+TEST(RectDrawListTest, BatchesRunsOfConsecutiveIds)
+{
+    const Rects rects(100);
+    RectDrawList draw_list;
+    draw_list.Rebuild(rects.rects, rects.colors);
+
+    CountingRectDrawBackend backend;
+    draw_list.Upload(backend);
+    draw_list.Draw(backend, MakeIds(0, 100));
+    EXPECT_EQ(backend.draw_calls_count, 1u);
+    EXPECT_EQ(backend.batches_count, 1u);
+    EXPECT_EQ(backend.drawn_instances_count, 100u);
+
+    const std::vector<NodeId> nodes{40, 41, 42, 10, 11, 7, 50, 52, 53, 43};
+    draw_list.Draw(backend, nodes);
+    EXPECT_EQ(backend.draw_calls_count, 2u);
+    EXPECT_EQ(backend.batches_count, 1u + 6u);
+    EXPECT_EQ(backend.drawn_instances_count, 100u + nodes.size());
+
+    const std::span<const RectDrawBatch> batches = draw_list.GetLastBatches();
+    ASSERT_EQ(batches.size(), 6u);
+    EXPECT_EQ(batches[0].first, 40u);
+    EXPECT_EQ(batches[0].count, 3u);
+    EXPECT_EQ(batches[1].first, 10u);
+    EXPECT_EQ(batches[1].count, 2u);
+    EXPECT_EQ(batches[4].first, 52u);
+    EXPECT_EQ(batches[4].count, 2u);
+
+    draw_list.Draw(backend, {});
+    EXPECT_TRUE(draw_list.GetLastBatches().empty());
+}
+
+TEST(RectDrawListTest, UploadsOnlyChanges)
+{
+    Rects rects(1000);
+    RectDrawList draw_list;
+    draw_list.Rebuild(rects.rects, rects.colors);
+
+    CountingRectDrawBackend backend;
+    draw_list.Upload(backend);
+    EXPECT_EQ(backend.upload_calls_count, 1u);
+    EXPECT_EQ(backend.uploaded_instances_count, 1000u);
+    EXPECT_EQ(backend.allocated_instances_count, 1000u);
+
+    // Nothing changed
+    draw_list.Upload(backend);
+    EXPECT_EQ(backend.upload_calls_count, 1u);
+
+    const std::vector<NodeId> changed{5, 900};
+    draw_list.Update(rects.rects, rects.colors, changed);
+    draw_list.Upload(backend);
+    EXPECT_EQ(backend.upload_calls_count, 3u);
+    EXPECT_EQ(backend.uploaded_instances_count, 1002u);
+
+    // Nodes added to the tree are packed and uploaded with the next update
+    for (size_t i = 0; i != 10; ++i) rects.Add();
+    draw_list.Update(rects.rects, rects.colors, {});
+    draw_list.Upload(backend);
+    EXPECT_EQ(draw_list.GetInstancesCount(), 1010u);
+    EXPECT_EQ(backend.allocated_instances_count, 1010u);
+    EXPECT_EQ(backend.uploaded_instances_count, 1012u);
+}
+
+TEST(RectDrawListTest, MergesCloseDirtyRanges)
+{
+    constexpr size_t kGap = RectDrawList::kMergeGap;
+    const Rects rects(10 * kGap);
+    RectDrawList draw_list;
+    draw_list.Rebuild(rects.rects, rects.colors);
+
+    RecordingRectDrawBackend backend;
+    draw_list.Upload(backend);
+    backend.uploads.clear();
+
+    // 10 and 10 + kGap + 1 are within the gap of each other, 4 * kGap is too far. Unsorted and repeated ids too
+    const auto close = static_cast<NodeId>(10 + kGap + 1);
+    const auto far = static_cast<NodeId>(4 * kGap);
+    const std::vector<NodeId> changed{far, close, 10, close, 11};
+    draw_list.Update(rects.rects, rects.colors, changed);
+    draw_list.Upload(backend);
+
+    ASSERT_EQ(backend.uploads.size(), 2u);
+    EXPECT_EQ(backend.uploads[0].offset, 10u);
+    EXPECT_EQ(backend.uploads[0].size, kGap + 2);
+    EXPECT_EQ(backend.uploads[1].offset, far);
+    EXPECT_EQ(backend.uploads[1].size, 1u);
+    EXPECT_EQ(backend.uploads[1].instances_count, rects.rects.size());
+
+    // One past the gap is a separate upload
+    backend.uploads.clear();
+    const std::vector<NodeId> apart{0, static_cast<NodeId>(kGap + 2)};
+    draw_list.Update(rects.rects, rects.colors, apart);
+    draw_list.Upload(backend);
+    ASSERT_EQ(backend.uploads.size(), 2u);
+    EXPECT_EQ(backend.counting.uploaded_instances_count, 10 * kGap + (kGap + 2) + 1 + 1 + 1);
+}
+
+// Instances added by an update are uploaded along with the new size of the array
+TEST(RectDrawListTest, UploadsAddedInstancesAfterUpdate)
+{
+    Rects rects(3);
+    RectDrawList draw_list;
+    draw_list.Rebuild(rects.rects, rects.colors);
+
+    RecordingRectDrawBackend backend;
+    draw_list.Upload(backend);
+
+    rects.Add();
+    rects.Add();
+    draw_list.Update(rects.rects, rects.colors, {});
+    draw_list.Upload(backend);
+    ASSERT_EQ(backend.uploads.size(), 2u);
+    EXPECT_EQ(backend.uploads[1].instances_count, 5u);
+    EXPECT_EQ(backend.uploads[1].offset, 3u);
+    EXPECT_EQ(backend.uploads[1].size, 2u);
+
+    // Ids without an instance are skipped
+    draw_list.Update(rects.rects, rects.colors, std::vector<NodeId>{2, 100});
+    draw_list.Upload(backend);
+    ASSERT_EQ(backend.uploads.size(), 3u);
+    EXPECT_EQ(backend.uploads[2].offset, 2u);
+    EXPECT_EQ(backend.uploads[2].size, 1u);
+    EXPECT_EQ(backend.counting.uploaded_instances_count, 3u + 2u + 1u);
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "tree.hpp"
+#include "tree_snapshot.hpp"
+
+// Empty directory under the temporary directory, named after the running test. Removed with its contents at the end
+class TestDirectory
+{
+public:
+    TestDirectory()
+    {
+        const testing::TestInfo* test_info = testing::UnitTest::GetInstance()->current_test_info();
+        path_ = std::filesystem::temp_directory_path() / "rect_tree_viewer_tests" /
+                (std::string{test_info->test_suite_name()} + "." + test_info->name());
+        std::filesystem::remove_all(path_);
+        std::filesystem::create_directories(path_);
+    }
+
+    TestDirectory(const TestDirectory&) = delete;
+    TestDirectory& operator=(const TestDirectory&) = delete;
+
+    ~TestDirectory()
+    {
+        std::error_code err;
+        std::filesystem::remove_all(path_, err);
+    }
+
+    [[nodiscard]] const std::filesystem::path& GetPath() const { return path_; }
+
+    // Creates the file and its missing parent directories
+    std::filesystem::path WriteFile(const std::filesystem::path& relative_path, std::string_view contents) const
+    {
+        const std::filesystem::path path = path_ / relative_path;
+        std::filesystem::create_directories(path.parent_path());
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+        return path;
+    }
+
+private:
+    std::filesystem::path path_;
+};
+
+// project/{README, src/{tree.cpp, tree.hpp}, 3 files} where the last node aggregates small files like a scan with a
+// minimal file fraction
+inline TreeNodes MakeSampleTree()
+{
+    TreeNodes nodes;
+    auto add = [&](std::string_view name, uint64_t value, NodeId parent)
+    {
+        const NodeId node_id = nodes.Add(name, value, parent);
+        if (parent != kInvalidNodeId) nodes.LinkChild(parent, node_id);
+        nodes.AddValueDelta(parent, static_cast<int64_t>(value));
+        return node_id;
+    };
+
+    const NodeId root = add("project", 0, kInvalidNodeId);
+    add("README", 100, root);
+    const NodeId src = add("src", 0, root);
+    add("3 files", 30, root);
+    add("tree.cpp", 2000, src);
+    add("tree.hpp", 500, src);
+    nodes.AddAggregate(3, 3);
+    return nodes;
+}
+
+// kInvalidNodeId when the node has no child with this name
+[[nodiscard]] inline NodeId FindChild(const TreeNodes& nodes, NodeId parent, std::string_view name)
+{
+    for (NodeId child = nodes.GetFirstChild(parent); child != kInvalidNodeId; child = nodes.GetNextSibling(child))
+    {
+        if (nodes.GetName(child) == name) return child;
+    }
+
+    return kInvalidNodeId;
+}
+
+// Node at a slash separated path of names below the node
+[[nodiscard]] inline NodeId FindPath(const TreeNodes& nodes, NodeId node_id, std::string_view path)
+{
+    while (!path.empty() && node_id != kInvalidNodeId)
+    {
+        const size_t name_end = std::min(path.find('/'), path.size());
+        node_id = FindChild(nodes, node_id, path.substr(0, name_end));
+        path.remove_prefix(std::min(name_end + 1, path.size()));
+    }
+
+    return node_id;
+}
+
+[[nodiscard]] inline std::vector<NodeId> GetChildren(const TreeNodes& nodes, NodeId node_id)
+{
+    std::vector<NodeId> children;
+    TreeHelper::GetChildren(nodes, node_id, children);
+    return children;
+}
+
+// Same nodes with the same ids, links and aggregates
+inline void ExpectSameTree(const TreeNodes& actual, const TreeNodes& expected)
+{
+    ASSERT_EQ(actual.Size(), expected.Size());
+    for (const NodeId node_id : expected.Ids())
+    {
+        EXPECT_EQ(actual.GetName(node_id), expected.GetName(node_id)) << "Node " << node_id;
+        EXPECT_EQ(actual.GetValue(node_id), expected.GetValue(node_id)) << "Node " << node_id;
+        EXPECT_EQ(actual.GetParent(node_id), expected.GetParent(node_id)) << "Node " << node_id;
+        EXPECT_EQ(actual.GetFirstChild(node_id), expected.GetFirstChild(node_id)) << "Node " << node_id;
+        EXPECT_EQ(actual.GetNextSibling(node_id), expected.GetNextSibling(node_id)) << "Node " << node_id;
+        EXPECT_EQ(actual.GetAggregatedFilesCount(node_id), expected.GetAggregatedFilesCount(node_id))
+            << "Node " << node_id;
+    }
+}
+
+// Links and sorted columns are checked like a loaded snapshot, values of nodes with children have to be the sums of
+// their children
+inline void ExpectValidTree(const TreeNodes& nodes)
+{
+    EXPECT_NO_THROW(ValidateTreeColumns(nodes.GetColumns(), "test tree"));
+    for (const NodeId node_id : nodes.Ids())
+    {
+        if (nodes.GetFirstChild(node_id) == kInvalidNodeId) continue;
+
+        uint64_t children_value = 0;
+        for (const NodeId child : GetChildren(nodes, node_id)) children_value += nodes.GetValue(child);
+        EXPECT_EQ(nodes.GetValue(node_id), children_value) << "Node " << node_id << " " << nodes.GetName(node_id);
+    }
+}
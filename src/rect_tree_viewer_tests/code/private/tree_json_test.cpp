@@ -0,0 +1,114 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "test_helpers.hpp"
+#include "tree.hpp"
+#include "tree_json.hpp"
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+TreeSnapshot WriteAndRead(
+    const TestDirectory& directory,
+    const TreeNodes& nodes,
+    const std::vector<fs::path>& root_paths,
+    const std::unordered_map<NodeId, size_t>& root_node_id_to_path_index,
+    bool compact)
+{
+    const fs::path path = directory.GetPath() / "tree.json";
+    WriteTreeJson(path, nodes, root_paths, root_node_id_to_path_index, compact);
+    return ReadTreeJson(path);
+}
+
+}  // namespace
+
+TEST(TreeJsonTest, RoundTrip)
+{
+    const TestDirectory directory;
+    const TreeNodes nodes = MakeSampleTree();
+    const std::vector<fs::path> root_paths{"/home/user/project"};
+    const std::unordered_map<NodeId, size_t> root_node_id_to_path_index{{0, 0}};
+
+    for (const bool compact : {false, true})
+    {
+        const TreeSnapshot snapshot = WriteAndRead(directory, nodes, root_paths, root_node_id_to_path_index, compact);
+        ExpectSameTree(snapshot.nodes, nodes);
+        EXPECT_EQ(snapshot.root_paths, root_paths);
+        EXPECT_EQ(snapshot.root_node_id_to_path_index, root_node_id_to_path_index);
+        EXPECT_EQ(snapshot.nodes.GetAggregatedFilesCount(3), 3u);
+    }
+}
+
+TEST(TreeJsonTest, RoundTripKeepsNamesThatAreNotUtf8)
+{
+    const TestDirectory directory;
+    TreeNodes nodes;
+    const NodeId root = nodes.Add("root", 0);
+    constexpr std::string_view names[]{
+        "caf\xc3\xa9",          // valid two byte sequence
+        "latin1 caf\xe9",       // lone lead byte
+        "\x80\xbf continued",   // stray continuation bytes
+        "cut \xe2\x82",         // truncated three byte sequence
+        "quote \" slash \\ \n", // escapes of JSON itself
+        "\xff\xfe",
+    };
+    for (const std::string_view name : names) nodes.LinkChild(root, nodes.Add(name, 1, root));
+    nodes.SetValue(root, std::size(names));
+
+    const std::vector<fs::path> root_paths{"/tmp/caf\xe9"};
+    const TreeSnapshot snapshot = WriteAndRead(directory, nodes, root_paths, {{root, 0}}, false);
+    ExpectSameTree(snapshot.nodes, nodes);
+    EXPECT_EQ(snapshot.root_paths, root_paths);
+}
+
+TEST(TreeJsonTest, ReadsRootsThatWereNotScanned)
+{
+    const TestDirectory directory;
+    const fs::path path = directory.WriteFile(
+        "tree.json",
+        R"({"nodes": [{"name": "a", "value": 4096.0}], "root_nodes": [4294967295, 0], "root_paths": ["/b", "/a"]})");
+    const TreeSnapshot snapshot = ReadTreeJson(path);
+    ASSERT_EQ(snapshot.nodes.Size(), 1u);
+    EXPECT_EQ(snapshot.nodes.GetValue(0), 4096u);
+    EXPECT_EQ(snapshot.root_node_id_to_path_index, (std::unordered_map<NodeId, size_t>{{0, 1}}));
+}
+
+// Links are validated like in a binary snapshot: walks over a corrupted tree would never end or read out of bounds
+TEST(TreeJsonTest, RejectsCorruptedTrees)
+{
+    const TestDirectory directory;
+    const std::string_view trees[]{
+        // Cycle between two nodes
+        R"({"nodes": [{"first_child": 1, "name": "a", "parent": 1}, {"first_child": 0, "name": "b", "parent": 0}],
+            "root_nodes": [], "root_paths": []})",
+        // Child listed before its parent
+        R"({"nodes": [{"name": "child", "parent": 1}, {"first_child": 0, "name": "root"}],
+            "root_nodes": [1], "root_paths": ["/"]})",
+        // Child list of the parent does not contain the child
+        R"({"nodes": [{"name": "root"}, {"name": "child", "parent": 0}], "root_nodes": [0], "root_paths": ["/"]})",
+        // Link out of bounds
+        R"({"nodes": [{"first_child": 7, "name": "root"}], "root_nodes": [0], "root_paths": ["/"]})",
+        // Root node that does not exist
+        R"({"nodes": [{"name": "root"}], "root_nodes": [3], "root_paths": ["/"]})",
+        // Negative size
+        R"({"nodes": [{"name": "root", "value": -1}], "root_nodes": [0], "root_paths": ["/"]})",
+        // Truncated document
+        R"({"nodes": [{"name": "root")",
+    };
+
+    for (const std::string_view tree : trees)
+    {
+        const fs::path path = directory.WriteFile("tree.json", tree);
+        EXPECT_THROW(std::ignore = ReadTreeJson(path), std::runtime_error) << tree;
+    }
+}
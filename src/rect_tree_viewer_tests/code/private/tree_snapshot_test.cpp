@@ -0,0 +1,167 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "test_helpers.hpp"
+#include "tree.hpp"
+#include "tree_snapshot.hpp"
+
+namespace
+{
+
+namespace fs = std::filesystem;
+
+// Columns of a tree that the tests corrupt one at a time
+struct ColumnsCopy
+{
+    explicit ColumnsCopy(const TreeNodes& nodes)
+    {
+        const TreeNodes::Columns columns = nodes.GetColumns();
+        names.assign(columns.names.begin(), columns.names.end());
+        name_offsets.assign(columns.name_offsets.begin(), columns.name_offsets.end());
+        name_lengths.assign(columns.name_lengths.begin(), columns.name_lengths.end());
+        values.assign(columns.values.begin(), columns.values.end());
+        parents.assign(columns.parents.begin(), columns.parents.end());
+        first_children.assign(columns.first_children.begin(), columns.first_children.end());
+        next_siblings.assign(columns.next_siblings.begin(), columns.next_siblings.end());
+        stamped_directories.assign(columns.stamped_directories.begin(), columns.stamped_directories.end());
+        directory_stamps.assign(columns.directory_stamps.begin(), columns.directory_stamps.end());
+        aggregate_nodes.assign(columns.aggregate_nodes.begin(), columns.aggregate_nodes.end());
+        aggregated_files_counts.assign(columns.aggregated_files_counts.begin(), columns.aggregated_files_counts.end());
+    }
+
+    [[nodiscard]] TreeNodes::Columns GetColumns() const
+    {
+        return {
+            .names = names,
+            .name_offsets = name_offsets,
+            .name_lengths = name_lengths,
+            .values = values,
+            .parents = parents,
+            .first_children = first_children,
+            .next_siblings = next_siblings,
+            .stamped_directories = stamped_directories,
+            .directory_stamps = directory_stamps,
+            .aggregate_nodes = aggregate_nodes,
+            .aggregated_files_counts = aggregated_files_counts,
+        };
+    }
+
+    std::vector<char> names;
+    std::vector<uint64_t> name_offsets;
+    std::vector<uint16_t> name_lengths;
+    std::vector<uint64_t> values;
+    std::vector<NodeId> parents;
+    std::vector<NodeId> first_children;
+    std::vector<NodeId> next_siblings;
+    std::vector<NodeId> stamped_directories;
+    std::vector<DirectoryStamp> directory_stamps;
+    std::vector<NodeId> aggregate_nodes;
+    std::vector<uint64_t> aggregated_files_counts;
+};
+
+// Sample tree with stamps on both directories
+TreeNodes MakeStampedTree()
+{
+    TreeNodes nodes = MakeSampleTree();
+    nodes.AddDirectoryStamp(0, {.device = 1, .inode = 2, .modification_time = 3, .change_time = 4});
+    nodes.AddDirectoryStamp(2, {.device = 1, .inode = 5, .modification_time = 6, .change_time = 7});
+    return nodes;
+}
+
+}  // namespace
+
+TEST(TreeSnapshotTest, RoundTrip)
+{
+    const TestDirectory directory;
+    const TreeNodes nodes = MakeStampedTree();
+    const std::vector<fs::path> root_paths{"/home/user/project"};
+    const std::unordered_map<NodeId, size_t> root_node_id_to_path_index{{0, 0}};
+
+    const fs::path path = directory.GetPath() / "tree.snapshot";
+    WriteTreeSnapshot(path, nodes, root_paths, root_node_id_to_path_index);
+    const TreeSnapshot snapshot = LoadTreeSnapshot(path);
+
+    ExpectSameTree(snapshot.nodes, nodes);
+    EXPECT_EQ(snapshot.root_paths, root_paths);
+    EXPECT_EQ(snapshot.root_node_id_to_path_index, root_node_id_to_path_index);
+    for (const NodeId node_id : nodes.Ids())
+    {
+        const DirectoryStamp* expected = nodes.FindDirectoryStamp(node_id);
+        const DirectoryStamp* actual = snapshot.nodes.FindDirectoryStamp(node_id);
+        ASSERT_EQ(actual != nullptr, expected != nullptr) << "Node " << node_id;
+        if (expected)
+        {
+            EXPECT_EQ(*actual, *expected) << "Node " << node_id;
+        }
+    }
+}
+
+TEST(TreeSnapshotTest, RejectsDamagedFiles)
+{
+    const TestDirectory directory;
+    const fs::path path = directory.GetPath() / "tree.snapshot";
+    WriteTreeSnapshot(path, MakeStampedTree(), std::vector<fs::path>{"/project"}, {{0, 0}});
+
+    // Truncated before the last section
+    std::ifstream file(path, std::ios::binary);
+    const std::string bytes{std::istreambuf_iterator<char>(file), {}};
+    const fs::path truncated_path =
+        directory.WriteFile("truncated.snapshot", std::string_view{bytes}.substr(0, bytes.size() - 8));
+    EXPECT_THROW(std::ignore = LoadTreeSnapshot(truncated_path), std::runtime_error);
+
+    // Different magic
+    std::string foreign = bytes;
+    foreign[0] = static_cast<char>(~foreign[0]);
+    const fs::path foreign_path = directory.WriteFile("foreign.snapshot", foreign);
+    EXPECT_THROW(std::ignore = LoadTreeSnapshot(foreign_path), std::runtime_error);
+
+    const fs::path tiny_path = directory.WriteFile("tiny.snapshot", "RTV");
+    EXPECT_THROW(std::ignore = LoadTreeSnapshot(tiny_path), std::runtime_error);
+}
+
+TEST(TreeSnapshotTest, ValidatesColumns)
+{
+    const TreeNodes nodes = MakeStampedTree();
+    EXPECT_NO_THROW(ValidateTreeColumns(nodes.GetColumns(), "valid"));
+
+    auto expect_corrupted = [&](std::string_view what, auto&& corrupt)
+    {
+        ColumnsCopy columns(nodes);
+        corrupt(columns);
+        EXPECT_THROW(ValidateTreeColumns(columns.GetColumns(), "corrupted"), std::runtime_error) << what;
+    };
+
+    expect_corrupted("name past the pool", [](ColumnsCopy& c) { c.name_offsets[1] = c.names.size(); });
+    expect_corrupted("name longer than the pool", [](ColumnsCopy& c) { c.name_lengths[4] = 0xFFFF; });
+    expect_corrupted("parent after the child", [](ColumnsCopy& c) { c.parents[2] = 4; });
+    expect_corrupted("parent of itself", [](ColumnsCopy& c) { c.parents[3] = 3; });
+    expect_corrupted("child out of bounds", [](ColumnsCopy& c) { c.first_children[2] = 100; });
+    expect_corrupted("child of another parent", [](ColumnsCopy& c) { c.first_children[2] = c.first_children[0]; });
+    expect_corrupted("sibling cycle", [](ColumnsCopy& c) { c.next_siblings[4] = c.first_children[2]; });
+    expect_corrupted(
+        "child missing from the list",
+        [](ColumnsCopy& c) { c.next_siblings[c.first_children[0]] = kInvalidNodeId; });
+    expect_corrupted("sibling of a root", [](ColumnsCopy& c) { c.next_siblings[0] = 1; });
+    expect_corrupted(
+        "unsorted stamps",
+        [](ColumnsCopy& c) { std::swap(c.stamped_directories[0], c.stamped_directories[1]); });
+    expect_corrupted("stamp out of bounds", [](ColumnsCopy& c) { c.stamped_directories[1] = 100; });
+    expect_corrupted("aggregate out of bounds", [](ColumnsCopy& c) { c.aggregate_nodes[0] = 100; });
+    expect_corrupted(
+        "unsorted aggregates",
+        [](ColumnsCopy& c)
+        {
+            c.aggregate_nodes.push_back(1);
+            c.aggregated_files_counts.push_back(1);
+        });
+}